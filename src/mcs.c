@@ -1,10 +1,63 @@
 #include "mcs.h"
+#include "mcs_art.h"
+#include "mcs_ctrl.h"
+#include "mcs_daemon.h"
+#include "mcs_enc.h"
+#include "mcs_fed.h"
+#include "mcs_index.h"
+#include "mcs_listen.h"
+#include "mcs_log.h"
+#include "mcs_map.h"
+#include "mcs_meta.h"
+#include "mcs_notify.h"
+#include "mcs_queue.h"
+#include "mcs_session.h"
+#include "mcs_snap.h"
+#include "mcs_spawn.h"
+#include "mcs_tree.h"
+#include "mcs_usage.h"
+#include "mcs_worker.h"
+#include "mcs_zip.h"
 
 #ifdef MCS_TAGLIB
 #include "mcs_taglib.h"
 #endif
 
-static int invokeKillChild = 0;
+// types that are reported by STAT
+static const struct {
+	int id;
+	char* name;
+} MCS_types[] = {
+	{ MCS_TYPE_AUDIO, "audio" },
+	{ MCS_TYPE_ROM, "rom" },
+	{ MCS_TYPE_ROM_GB, "rom/gb" },
+	{ MCS_TYPE_ROM_NES, "rom/nes" },
+	{ MCS_TYPE_VIDEO, "video" }
+};
+
+#define MCS_NUM_TYPES (sizeof(MCS_types) / sizeof(MCS_types[0]))
+
+// binaries that play the items, type 0 is used for unkown types
+static const struct {
+	int type;
+	char* command;
+} MCS_playerCommands[] = {
+	{ MCS_TYPE_AUDIO, MCS_BIN_AUDIO },
+	{ MCS_TYPE_ROM_NES, MCS_BIN_ROM_NES },
+	{ MCS_TYPE_VIDEO, MCS_BIN_VIDEO },
+#ifdef MCS_BIN_UNKOWN
+	{ 0, MCS_BIN_UNKOWN }
+#endif
+};
+
+#define MCS_NUM_PLAYERS (sizeof(MCS_playerCommands) \
+		/ sizeof(MCS_playerCommands[0]))
+
+// signals that are sent to stop a child process, in that order
+static const int MCS_killSignals[] = { SIGINT, SIGTERM, SIGKILL };
+static char* MCS_killNames[] = { "SIGINT", "SIGTERM", "SIGKILL" };
+
+#define MCS_NUM_SIGNALS 3
 
 #ifdef MCS_DEBUG
 int MCS_checkIDs(struct MCS_Item** items, int numItems) {
@@ -12,8 +65,8 @@ int MCS_checkIDs(struct MCS_Item** items, int numItems) {
 	for (i = 0; i < numItems - 1; i++) {
 		for (j = i + 1; j < numItems; j++) {
 			if (items[i]->id == items[j]->id) {
-				printf("MCS_checkIDs: %d %s %s\n", items[i]->id,
-						items[i]->filepath, items[j]->filepath);
+				MCS_log(MCS_LOG_ERROR, "MCS_checkIDs: %d %s %s\n", items[i]->id,
+						items[i]->label, items[j]->label);
 				return -1;
 			}
 		}
@@ -30,7 +83,14 @@ long MCS_getSize(struct MCS_Context* mcc) {
 
 	int i;
 	for (i = 0; i < mcc->size; i++) {
-		size += strlen(mcc->items[i]->filepath) * sizeof(char);
+		size += (strlen(mcc->items[i]->label) + 1) * sizeof(char);
+	}
+
+	size += mcc->dirNodeCapacity * sizeof(struct MCS_Dir*);
+	size += mcc->numDirNodes * sizeof(struct MCS_Dir);
+
+	for (i = 0; i < mcc->numDirNodes; i++) {
+		size += (strlen(mcc->dirNodes[i]->name) + 1) * sizeof(char);
 	}
 
 	size += mcc->numDirs * sizeof(char*);
@@ -39,13 +99,6 @@ long MCS_getSize(struct MCS_Context* mcc) {
 }
 #endif
 
-void handle_sigchld(int sig) {
-#ifdef MCS_DEBUG
-	printf("handle_sigchld: Child process terminated.\n");
-#endif
-	invokeKillChild = 1;
-}
-
 
 // SOURCE: http://www.eternallyconfuzzled.com/tuts/algorithms/jsw_tut_hashing.aspx
 unsigned int sax_hash(char* msg, int len, int modn) {
@@ -69,6 +122,8 @@ struct MCS_Context* MCS_createContext() {
 	mcc->state = 0;
 	mcc->dirs = NULL;
 	mcc->numDirs = 0;
+	memset(mcc->listeners, -1, sizeof(mcc->listeners));
+	mcc->numListeners = 0;
 
 	// item data
 	mcc->items = NULL;
@@ -76,29 +131,120 @@ struct MCS_Context* MCS_createContext() {
 	mcc->capacity = 0;
 	mcc->version = 0;
 
-	// only one child process should run at a time
-	mcc->child = 0;
-	mcc->wpipe = 0; // write to child pipe
-	mcc->playingItem = NULL; // ref to item that is currenty playing
+	// directory tree
+	mcc->dirNodes = NULL;
+	mcc->numDirNodes = 0;
+	mcc->dirNodeCapacity = 0;
+
+	// response compression contexts and metrics
+	mcc->zip = MCS_createZip();
+
+	// player argv templates
+	MCS_parsePlayers(mcc);
+
+	// playback sessions, the default session always exists
+	memset(mcc->sessionTable, -1, sizeof(mcc->sessionTable));
+	mcc->numSessions = 0;
+	MCS_getSession(mcc, MCS_SESSION_DEFAULT, 1);
+
+	// child supervision
+	mcc->sigfd = -1;
+	mcc->timeoutSigint = MCS_TIMEOUT_SIGINT;
+	mcc->timeoutSigterm = MCS_TIMEOUT_SIGTERM;
+	mcc->numStopping = 0;
+
+	// subscribers
+	int i;
+	for (i = 0; i < MCS_MAX_SUBSCRIBERS; i++) {
+		mcc->subscribers[i].socket = -1;
+	}
+
+	mcc->numSubscribers = 0;
+
+	// the clients are served by the main loop until workers are started,
+	// from an empty snapshot until the items are collected
+	mcc->workers = NULL;
+	mcc->numWorkers = 0;
+	mcc->mapfd = -1;
+	mcc->map = NULL;
+	mcc->mapSize = 0;
+	mcc->mapPath = NULL;
+	MCS_publishSnapshot(mcc);
 
 	return mcc;
 }
 
 void MCS_freeContext(struct MCS_Context* mcc) {
 	MCS_freeItems(mcc->items, mcc->capacity);
+	MCS_freeDirNodes(mcc->dirNodes, mcc->numDirNodes);
+	MCS_freeSnapshots(mcc);
+	MCS_freeZip(mcc->zip);
+
+	int i;
+	for (i = 0; i < mcc->numPlayers; i++) {
+		MCS_freePlayer(&mcc->players[i]);
+	}
 
+	free(mcc->players);
 	free(mcc->dirs);
 	free(mcc);
 }
 
+// writes the status line of the status code into the buffer (at least 64
+// bytes). returns 0 if nothing needs to be sent
+int MCS_formatStatus(char* buffer, int statusCode) {
+	switch (statusCode) {
+	case MCS_ERR_OK:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_OK, MCS_MSG_OK);
+		break;
+	case MCS_ERR_NOT_MODIFIED:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_NOT_MODIFIED, MCS_MSG_NOT_MODIFIED);
+		break;
+	case MCS_ERR_BAD_REQUEST:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_BAD_REQUEST, MCS_MSG_BAD_REQUEST);
+		break;
+	case MCS_ERR_BAD_PARAMS:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_BAD_PARAMS, MCS_MSG_BAD_PARAMS);
+		break;
+	case MCS_ERR_UNAUTHORIZED:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_UNAUTHORIZED, MCS_MSG_UNAUTHORIZED);
+		break;
+	case MCS_ERR_SERVER_ERROR:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_SERVER_ERROR, MCS_MSG_SERVER_ERROR); 
+		break;
+	case MCS_ERR_ITEM_PLAYING:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_ITEM_PLAYING, MCS_MSG_ITEM_PLAYING);
+		break;
+	case MCS_ERR_NOT_FOUND:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_NOT_FOUND, MCS_MSG_NOT_FOUND);
+		break;
+	case MCS_ERR_TOO_LONG:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_TOO_LONG, MCS_MSG_TOO_LONG);
+		break;
+	case MCS_ERR_NOT_IMPLEMENTED:
+		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_NOT_IMPLEMENTED, MCS_MSG_NOT_IMPLEMENTED);
+		break;
+	case -1:
+		MCS_log(MCS_LOG_ERROR, "MCS_formatStatus: Default error type\n");
+		break;
+	case 0:
+		// everything OK, don't write to socket
+		break;
+	default:
+		MCS_log(MCS_LOG_ERROR, "MCS_formatStatus: Unkown error type\n");
+		exit(1);
+	}
+
+	return statusCode != 0 && statusCode != -1;
+}
+
 void MCS_freeItems(struct MCS_Item** items, int numItems) {
 	int i;
 	for (i = 0; i < numItems; i++) {
 		struct MCS_Item* item = items[i];
 
 		if (item != NULL) {
-			free(item->filepath);
-			// free(item->label); // reference
+			free(item->label);
 		}
 
 		free(item);
@@ -107,6 +253,21 @@ void MCS_freeItems(struct MCS_Item** items, int numItems) {
 	free(items);
 }
 
+// the validator of an item changes with its file
+int MCS_getItemTag(struct MCS_Item* item, char* etag) {
+	char filepath[MCS_PATH_SIZE];
+	struct stat st;
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0
+			|| stat(filepath, &st) < 0)
+		return -1;
+
+	snprintf(etag, MCS_ETAG_SIZE, "%lx-%lx", (unsigned long) st.st_mtime,
+			(unsigned long) st.st_size);
+
+	return 0;
+}
+
 int MCS_getItemType(char* filename) {
 	char* p = strrchr(filename, '.');
 
@@ -142,270 +303,215 @@ int MCS_getItemType(char* filename) {
 	return -1;
 }
 
-int MCS_handleKillChild(struct MCS_Context* mcc) {
-	// if fork wasn't called
-	if (mcc->child == 0)
-		return MCS_ERR_OK;
+// monotonic time in microseconds
+long long MCS_getTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	// close pipe to child process
-	close(mcc->wpipe);
-	mcc->wpipe = 0;
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
-	int d = 0;
-	char* method[] = { "SIGINT", "SIGTERM", "SIGKILL" };
+struct MCS_Player* MCS_getPlayer(struct MCS_Context* mcc, int type) {
+	struct MCS_Player* fallback = NULL;
 
-	if (kill(-mcc->child, SIGINT) < 0) {
-		if (kill(-mcc->child, SIGTERM) < 0) {
-			if (kill(-mcc->child, SIGKILL) < 0) {
-				printf("Process %d could not be killed\n", mcc->child);
-				return MCS_ERR_SERVER_ERROR;
-			} else {
-				d = 2;
-			}
-		} else {
-			d = 1;
-		}
-	} else {
-		d = 0;
+	int i;
+	for (i = 0; i < mcc->numPlayers; i++) {
+		if (mcc->players[i].type == type)
+			return &mcc->players[i];
+
+		if (mcc->players[i].type == 0)
+			fallback = &mcc->players[i];
 	}
 
-	int status;
-	wait(&status); // collect zombies
+	return fallback;
+}
 
-	printf("Process %d killed by %s. (status: %d exited: %s)\n", mcc->child,
-			method[d], WEXITSTATUS(status),
-			WIFEXITED(status) ? "true" : "false");
+void MCS_handleChildExit(struct MCS_Context* mcc) {
+	// drain the signalfd, several SIGCHLDs may be merged into one
+	struct signalfd_siginfo info;
+	while (read(mcc->sigfd, &info, sizeof(info)) == sizeof(info));
 
-	// after this point the child should not exist anymore
-	mcc->child = 0;
-	mcc->playingItem = NULL;
+	int status;
+	struct rusage ru;
+	pid_t pid;
 
-	// keep in mind that invokeKillChild will be set even if the STOP
-	// command was called, so we need to set it to false at this point
-	// ALTERNATIVE:
-	// block the signal for STOP and unblock it (we would have to pass the
-	// sigset_t in the MCS_Context for that)
-	invokeKillChild = 0;
+	while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+		struct MCS_Child* child = MCS_lookupChild(mcc, pid);
 
-	return MCS_ERR_OK;
-}
+		if (child == NULL) {
+			struct MCS_Daemon* daemon = MCS_lookupDaemon(mcc, pid);
 
-int MCS_handlePlayItem(struct MCS_Context* mcc, struct MCS_Item* item) {
-	// check if file exists
-	// file can still disappear between access and execv but at least we
-	// don't pipe and fork
-	if (access(item->filepath, F_OK) < 0) {
-		printf("File does not exist: %s\n", item->filepath);
-		return MCS_ERR_NOT_FOUND;
-	}
+			if (daemon != NULL)
+				MCS_handleDaemonExit(mcc, daemon, status);
 
-	// create a pipe so that we can pass commands to the child process
-	// see http://tldp.org/LDP/lpg/node11.html
-	int fds[2];
-	
-	if (pipe(fds) < 0) {
-		printf("MCS_handlePlayItem: Error piping\n");
-		return MCS_ERR_SERVER_ERROR;
-	}
+			continue;
+		}
 
-	int pid = fork();
-	
-	if (pid < 0) {
-		printf("MCS_handlePlayItem: Failed to fork\n");
-		return MCS_ERR_SERVER_ERROR;
-	}
+		struct MCS_Session* session = child->session;
 
-	if (pid == 0) {
-		// child
-		int r = 0;
+		if (session == NULL) {
+			MCS_log(MCS_LOG_INFO,
+					"Process %d killed by %s. (status: %d exited: %s)\n", pid,
+					MCS_killNames[child->signal], WEXITSTATUS(status),
+					WIFEXITED(status) ? "true" : "false");
 
-		// configure child side of the pipe
-		close(fds[1]); // close write to parent
-		close(0); // close STDIN
-		dup(fds[0]); // connect pipe from exec to STDIN
+			MCS_removeChild(mcc, child);
+			mcc->numStopping--;
+			continue;
+		}
 
-		// set the process group
-		setpgid(0, 0);
+		MCS_log(MCS_LOG_INFO, "Process %d exited. (status: %d exited: %s)\n",
+				pid, WEXITSTATUS(status), WIFEXITED(status) ? "true" : "false");
 
-		char* bin = NULL;
+		MCS_removeChild(mcc, child);
+		MCS_finishUsage(&session->usage, &ru);
+		MCS_handleItemEnd(mcc, session, WEXITSTATUS(status));
+	}
+}
 
-		switch(item->type) {
-		case MCS_TYPE_AUDIO:
-			bin = MCS_BIN_AUDIO;
-			break;
-		case MCS_TYPE_ROM_NES:
-			bin = MCS_BIN_ROM_NES;
-			break;
-		case MCS_TYPE_VIDEO:
-			bin = MCS_BIN_VIDEO;
-			break;
-		default:
-#ifdef MCS_BIN_UNKOWN
-			bin = MCS_BIN_UNKOWN;
-#else
-			printf("Unkown item type %d\n", item->type);
-			r = 2;
-#endif
-			break;
+// handles a request on the main loop, the request was read by
+// MCS_readRequest. returns 1 if the client is a subscriber now and keeps the
+// socket
+int MCS_handleCommand(struct MCS_Context* mcc, int clientSocket, char* buffer,
+		int len) {
+	int statusCode = 0;
+	int subscribed = 0;
+
+	struct MCS_Request req;
+	memset(&req, 0, sizeof(req));
+	req.clientSocket = clientSocket;
+	req.snapshot = mcc->snapshot;
+	req.encoding = MCS_ENC_XML;
+	req.compression = MCS_ZIP_NONE;
+	req.zip = mcc->zip;
+
+	struct MCS_Session* session;
+
+	if (MCS_handleQuery(mcc, &req, buffer, len, &statusCode)) {
+		// served from the snapshot
+	} else if (strncmp("CTRL ", buffer, 5) == 0 && len > 5) {
+		statusCode = MCS_handleCtrl(mcc, &req, buffer, len);
+	} else if (strncmp("CLEAR", buffer, 5) == 0
+			&& (len == 5 || buffer[5] == ' ')) {
+		MCS_parseOptions(&req, buffer);
+		session = MCS_getSession(mcc, req.session, 0);
+
+		if (session == NULL) {
+			statusCode = MCS_ERR_NOT_FOUND;
+			goto write_status;
 		}
 
-		if (bin != NULL) {
-			mcc->playingItem = item;
-
-			// split the binary string (with options) into argvs using the
-			// the same memory by replacing ' ' with '\0' and setting the
-			// pointer correctly
-			int slen = strlen(bin);
+		MCS_clearQueue(&session->queue);
+		mcc->changes++;
+		statusCode = MCS_ERR_OK;
+	} else if (strncmp("ENQUEUE ", buffer, 8) == 0 && len > 8) {
+		// check all IDs before the queue is modified
+		unsigned int itemIDs[MCS_REQUEST_SIZE / 2];
+		int numIDs = 0;
 
-			char sbin[slen + 1];
-			strncpy(sbin, bin, slen);
-			sbin[slen] = '\0';
+		char* p = buffer + 8;
+		char* end;
 
-			char* sbinp = sbin;
-			char* sbinend = sbin + slen;
+		while (*p != '\0') {
+			unsigned int itemID = strtoul(p, &end, 10);
 
-			int count = 0;
-			while (sbinp < sbinend) {
-				if (*sbinp == ' ') {
-					count++;
-				}
+			// the IDs are followed by options
+			if (end == p && strchr(p, '=') != NULL)
+				break;
 
-				sbinp++;
+			if (end == p) {
+				statusCode = MCS_ERR_BAD_REQUEST;
+				goto write_status;
 			}
 
-			char* argv[count + 2];
-			argv[0] = sbin;
-			argv[count + 1] = (char*) NULL;
-
-			if (count > 0) {
-				int skip = 0;
-
-				count = 1;
-				sbinp = sbin;
-				while (sbinp < sbinend) {
-					// for arguments that are enclosed in '"' ignore ' '
-					if (*sbinp == '"') {
-						skip = !skip;
-					}
-
-					if (!skip && *sbinp == ' ') {
-						if (strncmp(sbinp + 1, "%s", 2) == 0) {
-							// replace %s with the filepath
-							argv[count] = item->filepath;
-						} else {
-							argv[count] = sbinp + 1;
-						}
-						
-						*sbinp = '\0';
-						count++;
-					}
-
-					sbinp++;
-				}
+			if (MCS_lookupItem(mcc->items, mcc->size, itemID) == NULL) {
+				statusCode = MCS_ERR_NOT_FOUND;
+				goto write_status;
 			}
 
-			r = execv(argv[0], argv);
-		} else {
-			printf("BIN is null\n");
+			itemIDs[numIDs++] = itemID;
+			p = end;
 		}
 
-		close(fds[0]); // close read from parent
-		close(fds[1]); // close write to parent
-
-		mcc->playingItem = NULL;
-
-		_exit(r);
-	} else {
-		// parent
-		// configure parent side of the pipe
-		close(fds[0]); // close read from child 
-	
-		mcc->wpipe = fds[1]; // write to child
-		mcc->child = pid;
-	}
-
-	return MCS_ERR_OK;
-}
-
-void MCS_handleRequest(struct MCS_Context* mcc, int clientSocket) {
-	const int SIZE = 128;
-	char* buffer = (char*) malloc((SIZE + 1) * sizeof(char));
-
-	int len = read(clientSocket, buffer, SIZE);
-
-	if (len < 0) {
-		printf("MCS_handleRequest: Error reading from socket.\n");
-		free(buffer);
-		return;
-	}
-
-	if (len == 0) {
-		printf("MCS_handleRequest: Empty string.\n");
-		free(buffer);
-		return;
-	}
+		MCS_parseOptions(&req, buffer);
+		session = MCS_getSession(mcc, req.session, 1);
 
-	// escape the buffer just in case
-	buffer[len] = '\0';
-	printf("%s (%d)\n", buffer, len);
+		if (session == NULL) {
+			statusCode = MCS_ERR_BAD_PARAMS;
+			goto write_status;
+		}
 
-	int statusCode = 0;
+		if (session->queue.size + numIDs > MCS_QUEUE_SIZE) {
+			statusCode = MCS_ERR_BAD_PARAMS;
+			goto write_status;
+		}
 
-	if (strncmp("CTRL ", buffer, 5) == 0 && len == 6) {
-		if (mcc->wpipe == 0) {
-			statusCode = MCS_ERR_SERVER_ERROR;
-			goto free_and_return;
+		int i;
+		for (i = 0; i < numIDs; i++) {
+			MCS_enqueueItem(&session->queue, itemIDs[i]);
 		}
 
-		// only send one char at a time through the pipe
-		if (write(mcc->wpipe, buffer + 5, 1) < 0) {
-			statusCode = MCS_ERR_SERVER_ERROR;
+		mcc->changes++;
+
+		// start playing if nothing is playing, otherwise prepare the next
+		// item
+		if (session->child == 0 && session->node == NULL) {
+			statusCode = MCS_playNext(mcc, session, MCS_getTime());
 		} else {
+			MCS_warmNext(mcc, session);
 			statusCode = MCS_ERR_OK;
 		}
-	} else if (strncmp("INFO ", buffer, 5) == 0 && len > 5) {
-		int itemID = atoi(buffer + 5);
+	} else if (strncmp("NEXT", buffer, 4) == 0
+			&& (len == 4 || buffer[4] == ' ')) {
+		long long start = MCS_getTime();
 
-		struct MCS_Item* item = MCS_lookupItem(mcc->items, mcc->size, itemID);
+		MCS_parseOptions(&req, buffer);
+		session = MCS_getSession(mcc, req.session, 0);
 
-		if (item == NULL) {
+		if (session == NULL) {
 			statusCode = MCS_ERR_NOT_FOUND;
-			goto free_and_return;
+			goto write_status;
 		}
 
-		statusCode = MCS_sendInfo(item, clientSocket);
-	} else if (strncmp("LIST ", buffer, 5) == 0 && len > 5) {
-		int type, offset, length;
+		statusCode = MCS_handleKillChild(mcc, session);
 
-		if (sscanf(buffer, "LIST %d %d %d", &type, &offset, &length) != 3) {
-			statusCode = MCS_ERR_BAD_REQUEST;
-			goto free_and_return;
+		if (statusCode == MCS_ERR_OK && session->queue.size > 0) {
+			statusCode = MCS_playNext(mcc, session, start);
 		}
-
-		statusCode = MCS_sendItems(mcc, type, offset, length, clientSocket);
 	} else if (strncmp("PLAY ", buffer, 5) == 0 && len > 5) {
-		if (mcc->child != 0 || mcc->playingItem != NULL) {
-			statusCode = MCS_ERR_ITEM_PLAYING;
-			goto free_and_return;
-		}
-
+		// a session is only created for an item that exists
 		int itemID = atoi(buffer + 5);
 
 		struct MCS_Item* item = MCS_lookupItem(mcc->items, mcc->size, itemID);
 
 		if (item == NULL) {
 			statusCode = MCS_ERR_NOT_FOUND;
-			goto free_and_return;
+			goto write_status;
+		}
+
+		MCS_parseOptions(&req, buffer);
+		session = MCS_getSession(mcc, req.session, 1);
+
+		if (session == NULL) {
+			statusCode = MCS_ERR_BAD_PARAMS;
+			goto write_status;
 		}
 
-		statusCode = MCS_handlePlayItem(mcc, item);
+		if (session->child != 0 || session->playingItem != NULL
+				|| session->node != NULL) {
+			statusCode = MCS_ERR_ITEM_PLAYING;
+			goto write_status;
+		}
+
+		statusCode = MCS_handlePlayItem(mcc, session, item);
+		MCS_warmNext(mcc, session);
 	} else if (strncmp("RESTART ", buffer, 8) == 0 && len > 8) {
 		char* p = strchr(buffer, ' ');
 
 		if (len != (8 + strlen(MCS_ADMIN_KEY))
 				|| strncmp(p + 1, MCS_ADMIN_KEY, strlen(MCS_ADMIN_KEY)) != 0) {
 			statusCode = MCS_ERR_UNAUTHORIZED;
-			goto free_and_return;
+			goto write_status;
 		}
 
 		mcc->state = MCS_STATE_RESTART;
@@ -416,314 +522,987 @@ void MCS_handleRequest(struct MCS_Context* mcc, int clientSocket) {
 		if (len != (9 + strlen(MCS_ADMIN_KEY))
 				|| strncmp(p + 1, MCS_ADMIN_KEY, strlen(MCS_ADMIN_KEY)) != 0) {
 			statusCode = MCS_ERR_UNAUTHORIZED;
-			goto free_and_return;
+			goto write_status;
 		} 
 
 		mcc->state = MCS_STATE_SHUTDOWN;
 		statusCode = MCS_ERR_OK;
-	} else if (strncmp("STAT", buffer, 4) == 0 && len == 4) {
-		statusCode = MCS_sendStatus(mcc, clientSocket);
-	} else if (strncmp("STOP", buffer, 4) == 0 && len == 4) {
-		statusCode = MCS_handleKillChild(mcc);
+	} else if (strncmp("STOP", buffer, 4) == 0
+			&& (len == 4 || buffer[4] == ' ')) {
+		MCS_parseOptions(&req, buffer);
+		session = MCS_getSession(mcc, req.session, 0);
+
+		if (session == NULL) {
+			statusCode = MCS_ERR_NOT_FOUND;
+			goto write_status;
+		}
+
+		statusCode = MCS_handleKillChild(mcc, session);
+	} else if (strncmp("SUBSCRIBE", buffer, 9) == 0
+			&& (len == 9 || buffer[9] == ' ')) {
+		if (MCS_addSubscriber(mcc, clientSocket) < 0) {
+			statusCode = MCS_ERR_SERVER_ERROR;
+			goto write_status;
+		}
+
+		// the subscriber owns the socket from now on
+		subscribed = 1;
 	} else {
 		statusCode = MCS_ERR_BAD_REQUEST;
 	}
 
-free_and_return:
-	switch (statusCode) {
-	case MCS_ERR_OK:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_OK, MCS_MSG_OK);
-		break;
-	case MCS_ERR_BAD_REQUEST:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_BAD_REQUEST, MCS_MSG_BAD_REQUEST);
-		break;
-	case MCS_ERR_BAD_PARAMS:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_BAD_PARAMS, MCS_MSG_BAD_PARAMS);
-		break;
-	case MCS_ERR_UNAUTHORIZED:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_UNAUTHORIZED, MCS_MSG_UNAUTHORIZED);
-		break;
-	case MCS_ERR_SERVER_ERROR:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_SERVER_ERROR, MCS_MSG_SERVER_ERROR); 
-		break;
-	case MCS_ERR_ITEM_PLAYING:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_ITEM_PLAYING, MCS_MSG_ITEM_PLAYING);
-		break;
-	case MCS_ERR_NOT_FOUND:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_NOT_FOUND, MCS_MSG_NOT_FOUND);
-		break;
-	case MCS_ERR_TOO_LONG:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_TOO_LONG, MCS_MSG_TOO_LONG);
-		break;
-	case MCS_ERR_NOT_IMPLEMENTED:
-		sprintf(buffer, "%s %d %s", MCP_VERSION, MCS_ERR_NOT_IMPLEMENTED, MCS_MSG_NOT_IMPLEMENTED);
-		break;
-	case -1:
-		printf("MCS_handleRequest: Default error type\n");
-		break;
-	case 0:
-		// everything OK, don't write to socket
-		break;
-	default:
-		printf("MCS_handleRequest: Unkown error type\n");
-		exit(1);
-	}
+write_status:
+	// the workers answer STAT with the sessions after this command
+	if (mcc->numWorkers > 0)
+		MCS_publishStatus(mcc);
 
-	if (statusCode != 0 && statusCode != -1) {
+	if (MCS_formatStatus(buffer, statusCode)) {
 		if (write(clientSocket, buffer, strlen(buffer)) < 0) {
-			printf("MCS_handleRequest: Could not write to socket\n");
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_handleCommand: Could not write to socket\n");
 		}
 	}
 
-	free(buffer);
+	return subscribed;
 }
 
-struct MCS_Item* MCS_lookupItem(struct MCS_Item** items, int numItems,
-			unsigned int itemID) {
-	// TODO consider benefits of a hash table lookup
-	// this function is only called when the server receives INFO and PLAY
-	// commands, which should be rare. in addition, it is very likely that
-	// the item count is low, i.e. for movies, it probably wouldn't exceed
-	// 1000-10000 items.
-	int i;
-	for (i = 0; i < numItems; i++) {
-		if (items[i]->id == itemID) {
-			return items[i];
-		}
-	}
+void MCS_handleItemEnd(struct MCS_Context* mcc, struct MCS_Session* session,
+		int status) {
+	MCS_notify(mcc, "EXIT %s %u %d", session->name,
+			session->playingItem ? session->playingItem->id : 0, status);
 
-	return NULL;
-}
+	long long start = MCS_getTime();
 
-void MCS_parseDirs(struct MCS_Context* mcc) {
-	if (mcc->dirs == NULL)
-		return;
+	MCS_stopUsage(&session->usage, start);
 
-	int c = 0; // counter
+	// a persistent player keeps its pipe for the next item, an item of a
+	// node has none
+	if (session->daemon == NULL && session->node == NULL)
+		close(session->wpipe);
 
-	// do a dry-run to determine the required list size
-	int i;
-	for (i = 0; i < mcc->numDirs; i++) {
-		if (mcc->dirs[i] != NULL) {
-			MCS_populateList(NULL, &c, mcc->dirs[i], 1);
-		}
-	}
+	session->wpipe = 0;
+	session->child = 0;
+	session->playingItem = NULL;
+	session->daemon = NULL;
+	session->node = NULL;
+	session->keys.numKeys = 0;
+	mcc->changes++;
 
-	if (c > MCS_MAX_ITEMS) {
-		c = MCS_MAX_ITEMS;
-		printf("Item count capped to %d items.\n", MCS_MAX_ITEMS);
-	}
+	// the item has finished, continue with the queue
+	MCS_playNext(mcc, session, start);
+}
 
-	mcc->capacity = c;
-	mcc->items = (struct MCS_Item**) malloc(mcc->capacity *
-			sizeof(struct MCS_Item*));
-	memset(mcc->items, 0, mcc->capacity * sizeof(struct MCS_Item*));
+int MCS_handleKillChild(struct MCS_Context* mcc, struct MCS_Session* session) {
+	// the item plays on another server
+	if (session->node != NULL)
+		return MCS_stopNodeItem(mcc, session);
 
-	printf("Collecting data from:\n");
+	// if no child was spawned
+	if (session->child == 0)
+		return MCS_ERR_OK;
 
-	c = 0;
-	for (i = 0; i < mcc->numDirs; i++) {
-		if (mcc->dirs[i] != NULL) {
-			printf("%d %s\n", i, mcc->dirs[i]);
-			MCS_populateList(mcc, &c, mcc->dirs[i], 0);
-		}
+	// a persistent player only stops the item, otherwise close pipe to
+	// child process
+	struct MCS_Daemon* daemon = session->daemon;
+
+	if (daemon != NULL) {
+		MCS_stopDaemonItem(daemon);
+	} else {
+		close(session->wpipe);
 	}
-	mcc->size = c;
-	mcc->version = time(NULL);
-}
 
-void MCS_populateList(struct MCS_Context* mcc, int* i, char* dirpath,
-		int dryrun) {
-	// TODO might be bad "opening" dozens of dirs while going down the
-	// directory hierarchy
-	DIR* dir = opendir(dirpath);
+	session->wpipe = 0;
+	session->keys.numKeys = 0;
 
-	if (dir == NULL) {
-		printf("Error opening directory. \"%s\"\n", dirpath);
-		return;
-	}
+	MCS_notify(mcc, "STOP %s %u", session->name,
+			session->playingItem ? session->playingItem->id : 0);
 
-	int dirlen = strlen(dirpath);
-	
-	const int SIZE = 256;
-	char filepath[SIZE];
+	struct MCS_Child* child = daemon == NULL
+			? MCS_lookupChild(mcc, session->child) : NULL;
 
-	strncpy(filepath, dirpath, dirlen);
+	// the item is stopped as far as clients are concerned. the child is
+	// reaped in the main loop, so we don't block other clients while it
+	// shuts down
+	MCS_stopUsage(&session->usage, MCS_getTime());
 
-	struct dirent* entry;
+	session->child = 0;
+	session->playingItem = NULL;
+	session->daemon = NULL;
+	mcc->changes++;
 
-	while ((entry = readdir(dir))) {
-		int type = entry->d_type;
-		char* filename = entry->d_name;
+	if (daemon != NULL)
+		return MCS_ERR_OK;
 
-		// skip "." and ".." directory entries
-		if (type == DT_DIR && filename[0] == '.' && filename[1] == '\0')
-			continue;
+	if (child == NULL)
+		return MCS_ERR_SERVER_ERROR;
 
-		if (type == DT_DIR && filename[0] == '.' && filename[1] == '.'
-				&& filename[2] == '\0')
-			continue;
-	
+	child->session = NULL;
+	mcc->numStopping++;
+
+	if (MCS_signalChild(mcc, child) < 0) {
+		MCS_removeChild(mcc, child);
+		mcc->numStopping--;
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	return MCS_ERR_OK;
+}
+
+int MCS_handleKillTimeouts(struct MCS_Context* mcc) {
+	if (mcc->numStopping == 0)
+		return -1;
+
+	long long now = MCS_getTime();
+	long long next = -1;
+
+	int i;
+	for (i = 0; i < MCS_CHILD_BUCKETS; i++) {
+		struct MCS_Child* child = &mcc->children[i];
+
+		// skip free slots and playing children
+		if (child->pid <= 0 || child->session != NULL)
+			continue;
+
+		// SIGKILL was sent, wait for the child to be reaped
+		if (child->signal == MCS_NUM_SIGNALS - 1)
+			continue;
+
+		if (child->deadline <= now) {
+			if (MCS_signalChild(mcc, child) < 0) {
+				MCS_removeChild(mcc, child);
+				mcc->numStopping--;
+				continue;
+			}
+
+			if (child->signal == MCS_NUM_SIGNALS - 1)
+				continue;
+		}
+
+		if (next < 0 || child->deadline < next)
+			next = child->deadline;
+	}
+
+	// poll timeout in ms until the next signal is due
+	return next < 0 ? -1 : (int) ((next - now + 999) / 1000);
+}
+
+int MCS_handlePlayItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Item* item) {
+	// the items of other servers are played there
+	struct MCS_Node* node = MCS_getItemNode(mcc, item);
+
+	if (node != NULL)
+		return MCS_playNodeItem(mcc, session, node, item);
+
+	long long start = MCS_getTime();
+	char filepath[MCS_PATH_SIZE];
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0)
+		return MCS_ERR_TOO_LONG;
+
+	// check if file exists
+	// file can still disappear between access and posix_spawn but at least
+	// we don't pipe and spawn
+	if (access(filepath, F_OK) < 0) {
+		MCS_log(MCS_LOG_WARN, "File does not exist: %s\n", filepath);
+		return MCS_ERR_NOT_FOUND;
+	}
+
+	// a persistent player of the type loads the item, if that fails a child
+	// is spawned for the item
+	struct MCS_Daemon* daemon = MCS_getDaemon(mcc, session, item->type,
+			filepath);
+
+	if (daemon != NULL && MCS_loadDaemonItem(daemon, filepath) == 0) {
+		session->wpipe = daemon->wpipe;
+		session->child = daemon->pid;
+		session->daemon = daemon;
+		session->playingItem = item;
+		mcc->changes++;
+
+		MCS_startUsage(&session->usage, session->child, filepath, start);
+		MCS_notify(mcc, "PLAY %s %u", session->name, item->id);
+
+		return MCS_ERR_OK;
+	}
+
+	int r = MCS_spawnItem(mcc, session, item, filepath, start);
+
+	if (r == MCS_ERR_OK)
+		MCS_notify(mcc, "PLAY %s %u", session->name, item->id);
+
+	return r;
+}
+
+// the commands that only read the item list and the status, served by the
+// workers from the snapshot of the request as well as by the main loop.
+// returns 0 if the request is none of them or if only the main loop can
+// serve it (the items of other servers), otherwise the status code is set
+int MCS_handleQuery(struct MCS_Context* mcc, struct MCS_Request* req,
+		char* buffer, int len, int* statusCode) {
+	struct MCS_Snapshot* snapshot = req->snapshot;
+
+	if (strncmp("ART ", buffer, 4) == 0 && len > 4) {
+		int itemID = atoi(buffer + 4);
+
+		struct MCS_Item* item = MCS_lookupItem(snapshot->items, snapshot->size,
+				itemID);
+
+		if (item == NULL) {
+			*statusCode = MCS_ERR_NOT_FOUND;
+			return 1;
+		}
+
+		// the items of other servers are served by the main loop, that
+		// talks to the nodes
+		if (MCS_isNodeName(item->dir->name)) {
+			if (req->worker != NULL)
+				return 0;
+
+			item = MCS_lookupItem(mcc->items, mcc->size, itemID);
+
+			if (item == NULL) {
+				*statusCode = MCS_ERR_NOT_FOUND;
+				return 1;
+			}
+
+			MCS_parseOptions(req, buffer);
+			*statusCode = MCS_forwardArt(mcc, item, req);
+			return 1;
+		}
+
+		MCS_parseOptions(req, buffer);
+		*statusCode = MCS_sendArt(item, req);
+	} else if (strncmp("BROWSE-DIR ", buffer, 11) == 0 && len > 11) {
+		char* end;
+		unsigned long dirID = strtoul(buffer + 11, &end, 10);
+
+		if (end == buffer + 11) {
+			*statusCode = MCS_ERR_BAD_REQUEST;
+			return 1;
+		}
+
+		if (dirID >= snapshot->numDirNodes) {
+			*statusCode = MCS_ERR_NOT_FOUND;
+			return 1;
+		}
+
+		MCS_parseOptions(req, buffer);
+		snprintf(req->etag, MCS_ETAG_SIZE, "%u", snapshot->version);
+
+		if (!MCS_isModified(req)) {
+			*statusCode = MCS_ERR_NOT_MODIFIED;
+			return 1;
+		}
+
+		*statusCode = MCS_sendDir(snapshot, snapshot->dirNodes[dirID], req);
+	} else if (strncmp("INFO ", buffer, 5) == 0 && len > 5) {
+		int itemID = atoi(buffer + 5);
+
+		struct MCS_Item* item = MCS_lookupItem(snapshot->items, snapshot->size,
+				itemID);
+
+		if (item == NULL) {
+			*statusCode = MCS_ERR_NOT_FOUND;
+			return 1;
+		}
+
+		if (MCS_isNodeName(item->dir->name)) {
+			if (req->worker != NULL)
+				return 0;
+
+			item = MCS_lookupItem(mcc->items, mcc->size, itemID);
+
+			if (item == NULL) {
+				*statusCode = MCS_ERR_NOT_FOUND;
+				return 1;
+			}
+
+			MCS_parseOptions(req, buffer);
+			*statusCode = MCS_forwardInfo(mcc, item, req);
+			return 1;
+		}
+
+		MCS_parseOptions(req, buffer);
+
+		if (MCS_getItemTag(item, req->etag) == 0 && !MCS_isModified(req)) {
+			*statusCode = MCS_ERR_NOT_MODIFIED;
+			return 1;
+		}
+
+		*statusCode = MCS_sendInfo(item, req);
+	} else if (strncmp("LIST ", buffer, 5) == 0 && len > 5) {
+		int type, offset, length;
+
+		if (sscanf(buffer, "LIST %d %d %d", &type, &offset, &length) != 3) {
+			*statusCode = MCS_ERR_BAD_REQUEST;
+			return 1;
+		}
+
+		MCS_parseOptions(req, buffer);
+		snprintf(req->etag, MCS_ETAG_SIZE, "%u", snapshot->version);
+
+		if (!MCS_isModified(req)) {
+			*statusCode = MCS_ERR_NOT_MODIFIED;
+			return 1;
+		}
+
+		*statusCode = MCS_sendItems(snapshot, type, offset, length, req);
+	} else if (strncmp("LOG", buffer, 3) == 0
+			&& (len == 3 || buffer[3] == ' ')) {
+		char level[16];
+		char key[64];
+		int n = sscanf(buffer, "LOG %15s %63s", level, key);
+
+		// without a level (options only) the log is described
+		if (n < 1 || strchr(level, '=') != NULL) {
+			MCS_parseOptions(req, buffer);
+			*statusCode = MCS_sendLog(req);
+			return 1;
+		}
+
+		if (n < 2 || strcmp(key, MCS_ADMIN_KEY) != 0) {
+			*statusCode = MCS_ERR_UNAUTHORIZED;
+			return 1;
+		}
+
+		int logLevel = MCS_parseLogLevel(level);
+
+		if (logLevel < 0) {
+			*statusCode = MCS_ERR_BAD_PARAMS;
+			return 1;
+		}
+
+		// the level is an atomic, any thread may set it
+		MCS_setLogLevel(logLevel);
+		*statusCode = MCS_ERR_OK;
+	} else if (strncmp("STAT", buffer, 4) == 0
+			&& (len == 4 || buffer[4] == ' ')) {
+		MCS_parseOptions(req, buffer);
+		*statusCode = MCS_sendStatus(mcc, req);
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+// returns 1 if the connection is kept open by a subscriber
+int MCS_handleRequest(struct MCS_Context* mcc, int clientSocket) {
+	char buffer[MCS_REQUEST_SIZE + 1];
+
+	int len = MCS_readRequest(clientSocket, buffer);
+
+	if (len == 0)
+		return 0;
+
+	return MCS_handleCommand(mcc, clientSocket, buffer, len);
+}
+
+// returns 0 if the client has the body of the validator already
+int MCS_isModified(struct MCS_Request* req) {
+	return req->ifTag[0] == '\0' || strcmp(req->ifTag, req->etag) != 0;
+}
+
+struct MCS_Item* MCS_lookupItem(struct MCS_Item** items, int numItems,
+			unsigned int itemID) {
+	// TODO consider benefits of a hash table lookup
+	// this function is only called when the server receives INFO and PLAY
+	// commands, which should be rare. in addition, it is very likely that
+	// the item count is low, i.e. for movies, it probably wouldn't exceed
+	// 1000-10000 items.
+	int i;
+	for (i = 0; i < numItems; i++) {
+		if (items[i]->id == itemID) {
+			return items[i];
+		}
+	}
+
+	return NULL;
+}
+
+void MCS_parseOptions(struct MCS_Request* req, char* buffer) {
+	// options follow the arguments of a command, i.e. "STAT ENC=BIN".
+	// unknown options are ignored
+	char* p = buffer;
+
+	while ((p = strchr(p, ' ')) != NULL) {
+		p++;
+
+		if (strncmp("ENC=BIN", p, 7) == 0) {
+			req->encoding = MCS_ENC_BIN;
+		} else if (strncmp("ENC=XML", p, 7) == 0) {
+			req->encoding = MCS_ENC_XML;
+		} else if (strncmp("ZIP=DEFLATE", p, 11) == 0) {
+			req->compression = MCS_ZIP_DEFLATE;
+		} else if (strncmp("ZIP=ZSTD", p, 8) == 0) {
+			req->compression = MCS_ZIP_ZSTD;
+		} else if (strncmp("IF=", p, 3) == 0) {
+			int len = strcspn(p + 3, " ");
+
+			if (len >= MCS_ETAG_SIZE)
+				len = MCS_ETAG_SIZE - 1;
+
+			strncpy(req->ifTag, p + 3, len);
+			req->ifTag[len] = '\0';
+			req->validate = 1;
+		} else if (strncmp("SESSION=", p, 8) == 0) {
+			int len = strcspn(p + 8, " ");
+
+			if (len >= MCS_SESSION_NAME)
+				len = MCS_SESSION_NAME - 1;
+
+			strncpy(req->session, p + 8, len);
+			req->session[len] = '\0';
+		}
+	}
+}
+
+void MCS_parsePlayers(struct MCS_Context* mcc) {
+	mcc->players = (struct MCS_Player*) malloc(MCS_NUM_PLAYERS
+			* sizeof(struct MCS_Player));
+	mcc->numPlayers = 0;
+
+	int i;
+	for (i = 0; i < MCS_NUM_PLAYERS; i++) {
+		struct MCS_Player* player = &mcc->players[mcc->numPlayers];
+
+		if (MCS_parsePlayer(player, MCS_playerCommands[i].type,
+				MCS_playerCommands[i].command) == 0) {
+			mcc->numPlayers++;
+		}
+	}
+}
+
+int MCS_signalChild(struct MCS_Context* mcc, struct MCS_Child* child) {
+	// send the next signal to the process group of the child. if a signal
+	// can't be sent try the next one
+	while (++child->signal < MCS_NUM_SIGNALS) {
+		if (kill(-child->pid, MCS_killSignals[child->signal]) == 0)
+			break;
+	}
+
+	if (child->signal == MCS_NUM_SIGNALS) {
+		MCS_log(MCS_LOG_WARN, "Process %d could not be killed\n", child->pid);
+		return -1;
+	}
+
+	long long timeout = 0;
+
+	if (MCS_killSignals[child->signal] == SIGINT) {
+		timeout = mcc->timeoutSigint;
+	} else if (MCS_killSignals[child->signal] == SIGTERM) {
+		timeout = mcc->timeoutSigterm;
+	}
+
+	child->deadline = MCS_getTime() + timeout * 1000;
+
+	return 0;
+}
+
+void MCS_parseDirs(struct MCS_Context* mcc) {
+	if (mcc->dirs == NULL)
+		return;
+
+	mcc->items = NULL;
+	mcc->size = 0;
+	mcc->capacity = 0;
+
+	mcc->dirNodes = NULL;
+	mcc->numDirNodes = 0;
+	mcc->dirNodeCapacity = 0;
+
+	// the configured directories are the children of the root
+	struct MCS_Dir* root = MCS_addDirNode(mcc, NULL, "");
+
+	int i;
+	for (i = 0; i < mcc->numDirs; i++) {
+		if (mcc->dirs[i] != NULL) {
+			MCS_addDirNode(mcc, root, mcc->dirs[i]);
+		}
+	}
+
+	MCS_log(MCS_LOG_INFO, "Collecting data from:\n");
+
+	for (i = 0; i < root->numDirs; i++) {
+		struct MCS_Dir* node = mcc->dirNodes[root->firstDir + i];
+
+		MCS_log(MCS_LOG_INFO, "%d %s\n", i, node->name);
+
+		// other servers are asked for their items by the main loop
+		if (!MCS_isNodeName(node->name))
+			MCS_populateList(mcc, node, node->name);
+	}
+
+#ifdef MCS_CONTENT_ID
+	MCS_assignContentIDs(mcc);
+#endif
+
+	// the items of other servers follow the local items
+	MCS_attachNodes(mcc);
+
+	mcc->version = time(NULL);
+
+	MCS_publishSnapshot(mcc);
+	MCS_notify(mcc, "LIST %u %d", mcc->version, mcc->size);
+}
+
+void MCS_populateList(struct MCS_Context* mcc, struct MCS_Dir* node,
+		char* dirpath) {
+	DIR* dir = opendir(dirpath);
+
+	if (dir == NULL) {
+		MCS_log(MCS_LOG_ERROR, "Error opening directory. \"%s\"\n", dirpath);
+		return;
+	}
+
+	int dirlen = strlen(dirpath);
+	
+	const int SIZE = MCS_PATH_SIZE;
+	char filepath[SIZE];
+
+	memcpy(filepath, dirpath, dirlen);
+
+	// configured directories may be given without the trailing '/'
+	if (dirlen > 0 && dirpath[dirlen - 1] != '/') {
+		filepath[dirlen++] = '/';
+	}
+
+	// the items of the directory are added first, so that they are
+	// contiguous
+	node->firstItem = mcc->size;
+
+	struct dirent* entry;
+
+	while ((entry = readdir(dir))) {
+		int type = entry->d_type;
+		char* filename = entry->d_name;
+
+		// skip "." and ".." directory entries
+		if (type == DT_DIR && filename[0] == '.' && filename[1] == '\0')
+			continue;
+
+		if (type == DT_DIR && filename[0] == '.' && filename[1] == '.'
+				&& filename[2] == '\0')
+			continue;
+	
 		int filelen = strlen(filename);
 		int pathlen = dirlen + filelen;
 
-		if (pathlen >= SIZE) {
-			printf("MCS_populateList: Buffer too small for filename. %d %d\n", pathlen, SIZE);
+		if (pathlen + 1 >= SIZE) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_populateList: Buffer too small for filename. %d %d\n",
+					pathlen, SIZE);
 			exit(1);
 		}
 
-		// expand file name
-		strncpy(filepath + dirlen, filename, SIZE - dirlen);
-		filepath[pathlen] = '\0';
-	
 		if (type == DT_DIR) {
-			// recurse down the hierarchy
-			filepath[pathlen] = '/';
-			filepath[pathlen + 1] = '\0'; 
-
-			MCS_populateList(mcc, i, filepath, dryrun);
+			// descended into after the directory is closed
+			MCS_addDirNode(mcc, node, filename);
 		} else if (type == DT_REG) {
 			int type = MCS_getItemType(filename);
 
 			if (type < 0)
 				continue;
 
-			if (!dryrun) {
-				// calculate ID
-				// FIXME buffer size not clear!
-				char hashMessage[33 + pathlen + 1];
-	
-				if (sprintf(hashMessage, "%ld", entry->d_ino) < 0) {
-					printf("MCS_populateList: Converting int to string failed\n");
-					exit(1);
-				}
-				
-				int nodelen = strlen(hashMessage);
-				strncpy(hashMessage + nodelen, strrchr(filepath, '/'),
-						pathlen);
-				hashMessage[nodelen + pathlen] = '\0';
-
-				// create item and add to list
-				struct MCS_Item* item;
-				item = (struct MCS_Item*) malloc(sizeof(struct MCS_Item));
-				memset(item, 0, sizeof(struct MCS_Item));
-
-				item->id = sax_hash(hashMessage, strlen(hashMessage),
-						MCS_HASH_SIZE);
-
-				item->filepath = (char*) malloc((pathlen + 1)
-						* sizeof(char));
-				strncpy(item->filepath, filepath, pathlen);
-				item->filepath[pathlen] = '\0';
-
-				item->label = strrchr(item->filepath, '/') + 1;
-				item->type = type;
-
-				mcc->items[*i] = item;
+			if (mcc->size == MCS_MAX_ITEMS) {
+				MCS_log(MCS_LOG_WARN, "Item count capped to %d items.\n",
+						MCS_MAX_ITEMS);
+				break;
+			}
+
+			if (mcc->size == mcc->capacity) {
+				int capacity = mcc->capacity > 0 ? mcc->capacity * 2 : 1024;
+
+				if (capacity > MCS_MAX_ITEMS)
+					capacity = MCS_MAX_ITEMS;
+
+				mcc->items = (struct MCS_Item**) realloc(mcc->items,
+						capacity * sizeof(struct MCS_Item*));
+				memset(mcc->items + mcc->capacity, 0, (capacity
+						- mcc->capacity) * sizeof(struct MCS_Item*));
+				mcc->capacity = capacity;
+			}
+
+			// calculate ID
+			// FIXME buffer size not clear!
+			char hashMessage[33 + filelen + 2];
+
+			if (sprintf(hashMessage, "%ld/%s", entry->d_ino, filename) < 0) {
+				MCS_log(MCS_LOG_ERROR,
+						"MCS_populateList: Converting int to string failed\n");
+				exit(1);
 			}
 
-			(*i)++; // important
+			// create item and add to list
+			struct MCS_Item* item;
+			item = (struct MCS_Item*) malloc(sizeof(struct MCS_Item));
+			memset(item, 0, sizeof(struct MCS_Item));
+
+			item->id = sax_hash(hashMessage, strlen(hashMessage),
+					MCS_HASH_SIZE);
+
+			// only the file name is stored, the directory is shared
+			item->label = (char*) malloc((filelen + 1) * sizeof(char));
+			memcpy(item->label, filename, filelen + 1);
+
+			item->dir = node;
+			item->type = type;
+
+			mcc->items[mcc->size++] = item;
+			node->numItems++;
+
+			if (mcc->size % MCS_SCAN_PROGRESS == 0) {
+				MCS_notify(mcc, "SCAN %d", mcc->size);
+			}
 		}
-	
-		if (!dryrun && ((*i) == mcc->capacity))
-			break;
 	}
 
 	closedir(dir);
+
+	// recurse down the hierarchy, only one directory is open at a time
+	int i;
+	for (i = 0; i < node->numDirs; i++) {
+		struct MCS_Dir* child = mcc->dirNodes[node->firstDir + i];
+		int pathlen = dirlen + strlen(child->name);
+
+		// expand directory name
+		strcpy(filepath + dirlen, child->name);
+		filepath[pathlen] = '/';
+		filepath[pathlen + 1] = '\0';
+
+		MCS_populateList(mcc, child, filepath);
+	}
 }
 
-void MCS_runServer(struct MCS_Context* mcc) {
-	int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+// reads the request of the client into the buffer (MCS_REQUEST_SIZE + 1
+// bytes), returns its length or 0 if there is none
+int MCS_readRequest(int clientSocket, char* buffer) {
+	int len = read(clientSocket, buffer, MCS_REQUEST_SIZE);
 
-	if (serverSocket < 0) {
-		printf("MCS_runServer: Error opening socket.\n");
-		exit(1);
+	if (len < 0) {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_readRequest: Error reading from socket.\n");
+		return 0;
 	}
 
-	struct sockaddr_in serverAddress;
-	memset(&serverAddress, 0, sizeof(serverAddress));
+	if (len == 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_readRequest: Empty string.\n");
+		return 0;
+	}
 
-	serverAddress.sin_family = AF_INET;
-	serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-	serverAddress.sin_port = htons(mcc->port);
-	
-	if (bind(serverSocket, (struct sockaddr*) &serverAddress,
-			sizeof(serverAddress)) < 0) {
-		close(serverSocket);
-		printf("MCS_runServer: Error binding to port %d\n", mcc->port);
+	// escape the buffer just in case
+	buffer[len] = '\0';
+	MCS_log(MCS_LOG_INFO, "%s (%d)\n", buffer, len);
+
+	return len;
+}
+
+void MCS_runServer(struct MCS_Context* mcc) {
+	// a client or a player that goes away while the server writes to it
+	// must not kill the server, the write fails with EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+
+	// every worker accepts on endpoints of its own, the kernel spreads the
+	// connections over them
+	int numWorkers = MCS_getNumWorkers();
+
+	if (MCS_openListeners(mcc, numWorkers > 0) == 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_runServer: No endpoint to listen on\n");
 		return;
 	}
 
-	printf("Listening on port %d\n", mcc->port);
+	// key events can also be sent as datagrams, without the cost of a
+	// connection per key press
+	int udpSocket = -1;
+
+	if (MCS_UDP_PORT > 0) {
+		struct sockaddr_in udpAddress;
+		memset(&udpAddress, 0, sizeof(udpAddress));
+
+		udpAddress.sin_family = AF_INET;
+		udpAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+		udpAddress.sin_port = htons(MCS_UDP_PORT);
+
+		udpSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+		if (udpSocket < 0 || bind(udpSocket,
+				(struct sockaddr*) &udpAddress, sizeof(udpAddress)) < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_runServer: Error binding to UDP port %d\n",
+					MCS_UDP_PORT);
+			exit(1);
+		}
+
+		MCS_log(MCS_LOG_INFO, "Listening on UDP port %d\n", MCS_UDP_PORT);
+	}
+
+#ifdef MCS_MAP_FILE
+	MCS_openMap(mcc, MCS_MAP_FILE);
+#endif
+
+	if (numWorkers > 0) {
+		MCS_publishStatus(mcc);
+
+		if (MCS_startWorkers(mcc, numWorkers) < 0)
+			numWorkers = 0;
+	}
+
 	mcc->state = MCS_STATE_LISTEN;
 
-	while (mcc->state == MCS_STATE_LISTEN) {
-		listen(serverSocket, 5);
-		struct sockaddr_in clientAddress;
+	// wait for clients and child processes at the same time, so that exits
+	// are reaped the moment they happen. sockets that are not open (-1) are
+	// ignored by poll. with workers, the main loop only serves the requests
+	// they pass on and leaves the endpoints to them
+	struct pollfd fds[3 + MCS_MAX_LISTENERS + MCS_MAX_DAEMONS
+			+ 3 * MCS_MAX_NODES + MCS_MAX_SUBSCRIBERS];
+	fds[0].fd = mcc->sigfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = udpSocket;
+	fds[1].events = POLLIN;
+	fds[2].fd = numWorkers > 0 ? mcc->handoff[0] : -1;
+	fds[2].events = POLLIN;
+
+	int numFds = 3 + mcc->numListeners;
 
-		socklen_t clen = sizeof(clientAddress);
-		int clientSocket = accept(serverSocket,
-				(struct sockaddr*) &clientAddress, &clen);
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		fds[3 + i].fd = numWorkers > 0 ? -1 : mcc->listeners[i];
+		fds[3 + i].events = POLLIN;
+	}
 
-		if (clientSocket < 0) {
-			printf("MCS_runServer: Error accepting connection.\n");
+	while (mcc->state == MCS_STATE_LISTEN) {
+		int timeout = MCS_handleKillTimeouts(mcc);
+		int keyTimeout = MCS_handleKeyTimeouts(mcc);
+		int usageTimeout = MCS_handleUsageTimeouts(mcc);
+		int nodeTimeout = MCS_handleNodeTimeouts(mcc);
+		int reclaimTimeout = MCS_reclaimSnapshots(mcc);
+
+		if (keyTimeout >= 0 && (timeout < 0 || keyTimeout < timeout))
+			timeout = keyTimeout;
+
+		if (usageTimeout >= 0 && (timeout < 0 || usageTimeout < timeout))
+			timeout = usageTimeout;
+
+		if (nodeTimeout >= 0 && (timeout < 0 || nodeTimeout < timeout))
+			timeout = nodeTimeout;
+
+		if (reclaimTimeout >= 0 && (timeout < 0 || reclaimTimeout < timeout))
+			timeout = reclaimTimeout;
+
+		// the persistent players, the connections to the nodes and the
+		// subscribers are polled after the server sockets
+		int numDaemons = MCS_pollDaemons(mcc, fds + numFds);
+		int numNodes = MCS_pollNodes(mcc, fds + numFds + numDaemons);
+		int numSubscribers = MCS_pollSubscribers(mcc,
+				fds + numFds + numDaemons + numNodes);
+
+		if (poll(fds, numFds + numDaemons + numNodes + numSubscribers,
+				timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			MCS_log(MCS_LOG_ERROR, "MCS_runServer: Error polling.\n");
 			exit(1);
 		}
 
-		// if the child process has exited and signaled SIGCHLD to the
-		// parent, the signal handler has set invokeKillChild to true
-		if (invokeKillChild) {
-			MCS_handleKillChild(mcc);
-			invokeKillChild = 0;
+		if (fds[0].revents & POLLIN) {
+			MCS_handleChildExit(mcc);
 		}
 
-		printf("Handling client %s\n", inet_ntoa(clientAddress.sin_addr));
+		if (fds[1].revents & POLLIN) {
+			MCS_handleDatagram(mcc, udpSocket);
+		}
 
-		MCS_handleRequest(mcc, clientSocket);
+		if (fds[2].revents & POLLIN) {
+			MCS_handleHandoffs(mcc);
+		}
 
-		// at this point, the forked process has a copy of the file
-		// descriptor and the socket will not be closed with a regular close
-		// call. shutdown will definitely mark the socket as closed.
-		// SOURCE: http://docstore.mik.ua/orelly/perl/cookbook/ch17_10.htm
-		if (shutdown(clientSocket, 2) < 0) {
-			printf("MCS_runServer: Error closing client socket.\n");
-			exit(1);
+		MCS_handleDaemons(mcc, fds + numFds, numDaemons);
+		MCS_handleNodeEvents(mcc, fds + numFds + numDaemons, numNodes);
+		MCS_handleSubscribers(mcc, fds + numFds + numDaemons + numNodes,
+				numSubscribers);
+
+		// all endpoints feed the same dispatcher
+		for (i = 0; i < mcc->numListeners; i++) {
+			if (!(fds[3 + i].revents & POLLIN))
+				continue;
+
+			if (MCS_acceptClient(mcc, mcc->listeners[i]) < 0)
+				exit(1);
 		}
 
 		// the idea is to update the item list without closing the socket
 		// or else we'll have to wait before we can open it again
 		if (mcc->state == MCS_STATE_RESTART) {
-			MCS_handleKillChild(mcc);
+			MCS_stopSessions(mcc);
 			MCS_freeItems(mcc->items, mcc->capacity);
+			MCS_freeDirNodes(mcc->dirNodes, mcc->numDirNodes);
 			MCS_parseDirs(mcc);
 
 			mcc->state = MCS_STATE_LISTEN;
 		}
+
+		// STAT on the workers sees the changes of this iteration
+		if (numWorkers > 0)
+			MCS_publishStatus(mcc);
 	}
 
-	// kill the child process if there is one
-	MCS_handleKillChild(mcc);
+	MCS_stopWorkers(mcc);
 
-	if (close(serverSocket) < 0) {
-		printf("MCS_runServer: Error closing server socket.\n");
-		exit(1);
+	// kill the child processes and wait until all children have exited
+	MCS_stopSessions(mcc);
+	MCS_stopDaemons(mcc);
+
+	while (mcc->numStopping > 0) {
+		int timeout = MCS_handleKillTimeouts(mcc);
+
+		if (poll(&fds[0], 1, timeout) > 0) {
+			MCS_handleChildExit(mcc);
+		}
 	}
 
-	printf("Server stopped\n");
+	MCS_closeNodes(mcc);
+	MCS_freeSubscribers(mcc);
+
+	if (udpSocket >= 0)
+		close(udpSocket);
+
+	MCS_closeListeners(mcc);
+	MCS_closeMap(mcc);
+
+	MCS_log(MCS_LOG_INFO, "Server stopped\n");
 	return;
 }
 
-int MCS_sendInfo(struct MCS_Item* item,	int clientSocket) {
+int MCS_sendInfo(struct MCS_Item* item, struct MCS_Request* req) {
+	struct MCS_Info info;
+	memset(&info, 0, sizeof(info));
+
+	// the native readers only read the headers, other files are left to
+	// TagLib
+	int r = MCS_readMetaInfo(item, &info);
+
 #ifdef MCS_TAGLIB
-	return MCS_sendTagLibInfo(item, clientSocket);
-#else
-	return MCS_ERR_NOT_IMPLEMENTED; 
+	if (r == MCS_ERR_NOT_IMPLEMENTED)
+		r = MCS_readTagLibInfo(item, &info);
 #endif
+
+	if (r != MCS_ERR_OK)
+		return r;
+
+	const int SIZE = 1024;
+	char* buffer = (char*) malloc((SIZE + 1) * sizeof(char));
+
+	char* buffp = buffer;
+	char* buffend = buffer + SIZE;
+
+	int plen;
+
+	if (req->encoding == MCS_ENC_BIN) {
+		plen = MCS_encItem(buffp, buffend - buffp, item);
+	} else {
+		plen = snprintf(buffp, buffend - buffp,
+				"<mediacenter>"
+				"<item id=\"%d\" type=\"%d\" label=\"%s\">",
+				item->id, item->type, item->label);
+	}
+
+	if (plen < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendInfo: Error writing to buffer\n");
+		free(buffer);
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	buffp += plen;
+
+	if (info.hasTag && buffp <= buffend) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encTag(buffp, buffend - buffp, &info);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<tag>"
+					"<title>%s</title>"
+					"<artist>%s</artist>"
+					"<album>%s</album>"
+					"<year>%d</year>"
+					"<comment>%s</comment>"
+					"<track>%d</track>"
+					"<genre>%s</genre>"
+					"</tag>",
+					info.title, info.artist, info.album, info.year,
+					info.comment, info.track, info.genre);
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendInfo: Error writing to buffer (1)\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	if (info.hasProperties && buffp <= buffend) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encProperties(buffp, buffend - buffp, &info);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<properties>"
+					"<bitrate>%d</bitrate>"
+					"<samplerate>%d</samplerate>"
+					"<channels>%d</channels>"
+					"<length>%d</length>"
+					"</properties>",
+					info.bitrate, info.samplerate, info.channels,
+					info.length);
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendInfo: Error writing to buffer (2)\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	// close XML tags
+	if (buffp <= buffend) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encEnd(buffp, buffend - buffp);
+		} else {
+			plen = snprintf(buffp, buffend - buffp, "</item></mediacenter>");
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR, "MCS_sendInfo: Error writing to buffer\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	if (buffp > buffend) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendInfo: Buffer too small\n");
+		free(buffer);
+		return MCS_ERR_TOO_LONG;
+	}
+
+	*buffp = '\0';
+
+	r = MCS_writeResponse(req, buffer, buffp - buffer);
+
+	free(buffer);
+	return r; // 200 OK was sent with buffer
 }
 
-int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
-		int clientSocket) {
-	if (type < 0 || offset < 0 || length < 1 || offset >= mcc->size
+int MCS_sendItems(struct MCS_Snapshot* snapshot, int type, int offset,
+		int length, struct MCS_Request* req) {
+	if (type < 0 || offset < 0 || length < 1 || offset >= snapshot->size
 			|| length > MCS_MAX_ITEMS) {
 		return MCS_ERR_BAD_PARAMS;
 	}
@@ -738,15 +1517,20 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 	char* buffp = buffer;
 	char* buffend = buffer + SIZE;
 
-	int plen = snprintf(buffp, SIZE,
-			"%s %d %s\n\n"
-			"<mediacenter>"
-			"<items version=\"%d\" type=\"%d\" offset=\"%d\" length=\"%d\">",
-			MCP_VERSION, MCS_ERR_OK, MCS_MSG_OK,
-			mcc->version, type, offset, length);
+	int plen;
+
+	if (req->encoding == MCS_ENC_BIN) {
+		plen = MCS_encItems(buffp, SIZE, snapshot->version, type, offset,
+				length);
+	} else {
+		plen = snprintf(buffp, SIZE,
+				"<mediacenter>"
+				"<items version=\"%d\" type=\"%d\" offset=\"%d\" length=\"%d\">",
+				snapshot->version, type, offset, length);
+	}
 	
 	if (plen < 0) {
-		printf("MCS_sendItems: Error writing to buffer\n");
+		MCS_log(MCS_LOG_ERROR, "MCS_sendItems: Error writing to buffer\n");
 		free(buffer);
 		return MCS_ERR_SERVER_ERROR;
 	}
@@ -754,8 +1538,8 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 	buffp += plen;
 
 	int i;
-	for (i = 0; i < mcc->size; i++) {
-		if (length == 0 || (type == 0 && i + offset >= mcc->size))
+	for (i = 0; i < snapshot->size; i++) {
+		if (length == 0 || (type == 0 && i + offset >= snapshot->size))
 			break;
 
 		struct MCS_Item* item;
@@ -763,9 +1547,9 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 		if (type == 0) {
 			// if the type is 0, meaning list all types of items
 			// the offset is real
-			item = mcc->items[i + offset];
+			item = snapshot->items[i + offset];
 		} else {
-			int itemType = mcc->items[i]->type;
+			int itemType = snapshot->items[i]->type;
 			int base = itemType - (itemType % MCS_TYPE_BASE);
 
 			if (type != 0 && type != itemType && type != base)
@@ -776,15 +1560,19 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 				continue;
 			}
 
-			item = mcc->items[i];
+			item = snapshot->items[i];
 		}
 
-		plen = snprintf(buffp, buffend - buffp,
-				"<item id=\"%d\" type=\"%d\" label=\"%s\"/>", item->id,
-				item->type, item->label);
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encItem(buffp, buffend - buffp, item);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<item id=\"%d\" type=\"%d\" label=\"%s\"/>", item->id,
+					item->type, item->label);
+		}
 
 		if (plen < 0) {
-			printf("MCS_sendItems: Error writing to buffer\n");
+			MCS_log(MCS_LOG_ERROR, "MCS_sendItems: Error writing to buffer\n");
 			free(buffer);
 			return MCS_ERR_SERVER_ERROR;
 		}
@@ -792,7 +1580,7 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 		buffp += plen;
 
 		if (buffp > buffend) {
-			printf("MCS_sendItems: Buffer too small\n");
+			MCS_log(MCS_LOG_ERROR, "MCS_sendItems: Buffer too small\n");
 			free(buffer);
 			return MCS_ERR_TOO_LONG;
 		}
@@ -801,12 +1589,16 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 		length--;
 	}
 
-	plen = snprintf(buffp, buffend - buffp, "</items></mediacenter>");
+	if (req->encoding == MCS_ENC_BIN) {
+		plen = MCS_encEnd(buffp, buffend - buffp);
+	} else {
+		plen = snprintf(buffp, buffend - buffp, "</items></mediacenter>");
+	}
 #ifdef MCS_DEBUG
-	printf(">> %d %d\n", plen, buffend - buffp);
+	MCS_log(MCS_LOG_INFO, ">> %d %ld\n", plen, (long) (buffend - buffp));
 #endif	
 	if (plen < 0) {
-		printf("MCS_sendItems: Error writing to buffer\n");
+		MCS_log(MCS_LOG_ERROR, "MCS_sendItems: Error writing to buffer\n");
 		free(buffer);
 		return MCS_ERR_SERVER_ERROR;
 	}
@@ -814,102 +1606,361 @@ int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length,
 	buffp += plen;
 
 	if (buffp > buffend) {
-		printf("MCS_sendItems: Buffer too small\n");
+		MCS_log(MCS_LOG_ERROR, "MCS_sendItems: Buffer too small\n");
 		free(buffer);
 		return MCS_ERR_TOO_LONG;
 	}
 
 	*buffp = '\0';
 
-	if (write(clientSocket, buffer, buffp - buffer) < 0) {
-		printf("MCS_sendItems: Error writing to socket.\n");
-		free(buffer);
-		return -1;
-	}
+	int r = MCS_writeResponse(req, buffer, buffp - buffer);
 
 	free(buffer);
-	return 0; // 200 OK was sent with buffer
+	return r; // 200 OK was sent with buffer
 }
 
-int MCS_sendStatus(struct MCS_Context* mcc, int clientSocket) {
-	const int SIZE = 512;
+int MCS_sendStatus(struct MCS_Context* mcc, struct MCS_Request* req) {
+	const int SIZE = 4096;
 	char* buffer = (char*) malloc((SIZE + 1) * sizeof(char));
 
-	int len = snprintf(buffer, SIZE,
-			"%s %d %s\n\n"
-			"<mediacenter><status>"
-			"<items version=\"%d\" size=\"%d\"/>"
-			"<types>"
-			"<type id=\"%d\" name=\"audio\"/>"
-			"<type id=\"%d\" name=\"rom\"/>"
-			"<type id=\"%d\" name=\"rom/gb\"/>"
-			"<type id=\"%d\" name=\"rom/nes\"/>"
-			"<type id=\"%d\" name=\"video\"/>"
-			"</types>"
-			"</status></mediacenter>",
-			MCP_VERSION, MCS_ERR_OK, MCS_MSG_OK,
-			mcc->version, mcc->size, MCS_TYPE_AUDIO, MCS_TYPE_ROM,
-			MCS_TYPE_ROM_GB, MCS_TYPE_ROM_NES, MCS_TYPE_VIDEO);
+	char* buffp = buffer;
+	char* buffend = buffer + SIZE;
 
-	if (len < 0) {
-		printf("MCS_sendStatus: Failed to write to buffer\n");
+	int plen;
+
+	// the main loop reports its sessions as they are, the workers the last
+	// status it published
+	struct MCS_Status status;
+
+	if (req->worker == NULL)
+		MCS_publishStatus(mcc);
+
+	MCS_readStatus(mcc, req->session, &status);
+
+	// the validator covers the state clients see: the items, the players,
+	// the queues and which nodes are up. the metrics change all the time,
+	// a conditional request gets the body without them
+	unsigned int nodesUp = 0;
+
+	int i;
+	for (i = 0; i < status.numNodes; i++) {
+		nodesUp |= (status.nodes[i].up != 0) << i;
+	}
+
+	snprintf(req->etag, MCS_ETAG_SIZE, "%u-%lx-%x", status.version,
+			status.changes, nodesUp);
+
+	if (!MCS_isModified(req)) {
 		free(buffer);
-		return MCS_ERR_SERVER_ERROR;
+		return MCS_ERR_NOT_MODIFIED;
+	}
+
+	// the player of the requested session
+	struct MCS_SessionStatus* session = &status.sessions[0];
+	struct MCS_Usage* usage = &session->usage;
+
+	// ms the child played, up to now if it still plays
+	long long duration = 0;
+
+	if (usage->started > 0) {
+		duration = ((usage->stopped > 0 ? usage->stopped : MCS_getTime())
+				- usage->started) / 1000;
+	}
+
+	if (req->encoding == MCS_ENC_BIN) {
+		plen = MCS_encStatus(buffp, SIZE, status.version, status.size);
+
+		if (plen <= SIZE) {
+			plen += MCS_encPlayer(buffp + plen, SIZE - plen, session->name,
+					session->playing, session->itemID);
+		}
+
+		if (plen <= SIZE) {
+			plen += MCS_encQueue(buffp + plen, SIZE - plen, session);
+		}
+	} else {
+		plen = snprintf(buffp, SIZE,
+				"<mediacenter><status>"
+				"<items version=\"%d\" size=\"%d\"/>"
+				"<player session=\"%s\" state=\"%s\" item=\"%d\"/>"
+				"<queue size=\"%d\" next=\"%d\"/>"
+				"<types>",
+				status.version, status.size, session->name,
+				session->playing ? "playing" : "stopped", session->itemID,
+				session->queueSize, session->next);
 	}
 
-	if (len > SIZE) {
-		printf("MCS_sendStatus: Buffer size too small %d. Needed %d\n", SIZE, len);
+	if (plen < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendStatus: Failed to write to buffer\n");
 		free(buffer);
-		return MCS_ERR_TOO_LONG;
+		return MCS_ERR_SERVER_ERROR;
 	}
 
-	buffer[len] = '\0';
+	buffp += plen;
+
+	for (i = 0; i < MCS_NUM_TYPES && buffp <= buffend; i++) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encType(buffp, buffend - buffp, MCS_types[i].id,
+					MCS_types[i].name);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<type id=\"%d\" name=\"%s\"/>",
+					MCS_types[i].id, MCS_types[i].name);
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendStatus: Failed to write to buffer\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	unsigned long responses;
+	unsigned long long bytesIn, bytesOut;
+	MCS_sumZipMetrics(mcc, &responses, &bytesIn, &bytesOut);
+
+	if (buffp <= buffend) {
+		if (req->validate) {
+			plen = req->encoding == MCS_ENC_BIN ? 0
+					: snprintf(buffp, buffend - buffp, "</types>");
+		} else if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encCompression(buffp, buffend - buffp, responses,
+					bytesIn, bytesOut);
+
+			if (plen <= buffend - buffp) {
+				plen += MCS_encUsage(buffp + plen, buffend - buffp - plen,
+						usage, duration);
+			}
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"</types>"
+					"<metrics>"
+					"<compression responses=\"%lu\" in=\"%llu\" out=\"%llu\""
+					" ratio=\"%.3f\"/>"
+					"<transitions count=\"%lu\" last=\"%lld\" max=\"%lld\""
+					" avg=\"%lld\"/>"
+					"<usage duration=\"%lld\" cpu=\"%llu\" load=\"%d\""
+					" maxLoad=\"%d\" rss=\"%ld\" maxRss=\"%ld\""
+					" read=\"%llu\" readRate=\"%llu\" maxReadRate=\"%llu\""
+					" switches=\"%lu\" forced=\"%lu\" exec=\"%lld\""
+					" firstRead=\"%lld\"/>"
+					"</metrics>",
+					responses, bytesIn, bytesOut,
+					bytesIn > 0 ? (double) bytesOut / bytesIn : 1.0,
+					session->transitions, session->lastSpawn,
+					session->maxSpawn, session->transitions > 0
+					? session->totalSpawn / (long long) session->transitions
+					: 0,
+					duration, usage->cpuTime / 1000, usage->load,
+					usage->maxLoad, usage->rss, usage->maxRss,
+					usage->readBytes, usage->readRate, usage->maxReadRate,
+					usage->switches, usage->forcedSwitches, usage->execTime,
+					usage->readTime);
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendStatus: Failed to write to buffer\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	// the other servers whose items are listed
+	for (i = 0; i < status.numNodes && buffp <= buffend; i++) {
+		struct MCS_NodeStatus* node = &status.nodes[i];
+
+		if (req->validate) {
+			node->requests = 0;
+			node->lastTime = 0;
+			node->maxTime = 0;
+			node->totalTime = 0;
+		}
+
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encNode(buffp, buffend - buffp, node);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"%s<node name=\"%s\" state=\"%s\" version=\"%u\""
+					" size=\"%d\" requests=\"%lu\" last=\"%lld\""
+					" max=\"%lld\" avg=\"%lld\"/>%s",
+					i == 0 ? "<nodes>" : "", node->name,
+					node->up ? "up" : "down", node->version, node->size,
+					node->requests, node->lastTime, node->maxTime,
+					node->requests > 0
+					? node->totalTime / (long long) node->requests : 0,
+					i == status.numNodes - 1 ? "</nodes>" : "");
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendStatus: Failed to write to buffer\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
 
-	if (write(clientSocket, buffer, len) < 0) {
-		printf("MCS_sendStatus: Failed to write to socket.\n");
+		buffp += plen;
+	}
+
+	if (buffp <= buffend) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encEnd(buffp, buffend - buffp);
+		} else {
+			plen = snprintf(buffp, buffend - buffp, "</status></mediacenter>");
+		}
+
+		if (plen < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_sendStatus: Failed to write to buffer\n");
+			free(buffer);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		buffp += plen;
+	}
+
+	if (buffp > buffend) {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_sendStatus: Buffer size too small %d. Needed %ld\n", SIZE,
+				(long) (buffp - buffer));
 		free(buffer);
-		return -1;
+		return MCS_ERR_TOO_LONG;
 	}
+
+	*buffp = '\0';
+
+	int r = MCS_writeResponse(req, buffer, buffp - buffer);
 	
 	free(buffer);
-	return 0; // 200 OK was sent with buffer
+	return r; // 200 OK was sent with buffer
 }
 
-int main(int argc, char* argv[]) {
-	if (argc <= 1) {
-		printf("Not enough arguments provided\n");
-		return -1;
+// plays the item with a child process of its own, clients were told of the
+// PLAY already
+int MCS_spawnItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Item* item, char* filepath, long long start) {
+	struct MCS_Player* player = MCS_getPlayer(mcc, item->type);
+
+	if (player == NULL) {
+		MCS_log(MCS_LOG_WARN, "Unkown item type %d\n", item->type);
+		return MCS_ERR_NOT_IMPLEMENTED;
 	}
 
-	// register SIGCHLD handler
-	struct sigaction sa;
-	sa.sa_handler = &handle_sigchld;
-	sigemptyset(&sa.sa_mask);
-	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	// create a pipe so that we can pass commands to the child process
+	// see http://tldp.org/LDP/lpg/node11.html
+	// both ends are closed on exec, the read end is duplicated to the
+	// STDIN of the child
+	int fds[2];
+	
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_spawnItem: Error piping\n");
+		return MCS_ERR_SERVER_ERROR;
+	}
 
-	if (sigaction(SIGCHLD, &sa, 0) < 0) {
-		printf("Failed to register SIGCHLD handler\n");
-		exit(1);
+	pid_t pid;
+
+	if (MCS_spawnPlayer(player, filepath, fds[0], -1, session->name,
+			&pid) != 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return MCS_ERR_SERVER_ERROR;
 	}
 
-	struct MCS_Context* mcc = MCS_createContext();
+	// configure parent side of the pipe. a player that does not read its
+	// STDIN must not block the server
+	close(fds[0]); // close read from child 
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
 
-	mcc->port = MCS_PORT;
+	if (MCS_addChild(mcc, pid, session) == NULL) {
+		// can't supervise the child, get rid of it right away
+		kill(-pid, SIGKILL);
+		close(fds[1]);
+		return MCS_ERR_SERVER_ERROR;
+	}
 
-	mcc->numDirs = argc - 1;
-	mcc->dirs = (char**) malloc(mcc->numDirs * sizeof(char*));
-	memcpy(mcc->dirs, &argv[1], mcc->numDirs * sizeof(char*));
+	session->wpipe = fds[1]; // write to child
+	session->child = pid;
+	session->daemon = NULL;
+	session->playingItem = item;
+	mcc->changes++;
 
-	MCS_parseDirs(mcc);
+	MCS_startUsage(&session->usage, session->child, filepath, start);
 
-	printf("Items: %d/%d\n", mcc->size, mcc->capacity);
-#ifdef MCS_DEBUG
-	printf("Unique: %d\n", MCS_checkIDs(mcc->items, mcc->size));
-	printf("Alloc'd %ld bytes\n", MCS_getSize(mcc));
-#endif
-	MCS_runServer(mcc);
+	return MCS_ERR_OK;
+}
+
+void MCS_stopSessions(struct MCS_Context* mcc) {
+	int i;
+	for (i = 0; i < mcc->numSessions; i++) {
+		MCS_handleKillChild(mcc, &mcc->sessions[i]);
+	}
+}
+
+int MCS_writeResponse(struct MCS_Request* req, char* body, int len) {
+	// large bodies are compressed if the client asked for it. the
+	// compressed body is only used if it is actually smaller
+	char* out = body;
+	int outlen = len;
+	int compression = MCS_ZIP_NONE;
+
+	if (req->compression != MCS_ZIP_NONE && req->zip != NULL
+			&& len >= MCS_ZIP_THRESHOLD) {
+		char* zbody;
+		int zlen = MCS_compress(req->zip, req->compression, body, len, &zbody);
+
+		if (zlen > 0) {
+			out = zbody;
+			outlen = zlen;
+			compression = req->compression;
+		}
+	}
 
-	MCS_freeContext(mcc);
+	// the header is the same as for the plain status codes. clients that
+	// did not send any option get the header without any fields, the
+	// validator is only sent to clients that use IF= or another option
+	char header[256];
+	char* hp = header;
+	char* hend = header + sizeof(header);
+
+	hp += snprintf(hp, hend - hp, "%s %d %s\n", MCP_VERSION, MCS_ERR_OK,
+			MCS_MSG_OK);
+
+	if (req->etag[0] != '\0' && (req->validate
+			|| req->encoding != MCS_ENC_XML
+			|| req->compression != MCS_ZIP_NONE)) {
+		hp += snprintf(hp, hend - hp, "ETag: %s\n", req->etag);
+	}
+
+	if (req->encoding == MCS_ENC_BIN) {
+		hp += snprintf(hp, hend - hp, "Encoding: bin\n");
+	}
+
+	if (compression != MCS_ZIP_NONE) {
+		hp += snprintf(hp, hend - hp, "Compression: %s\nSize: %d\n",
+				MCS_getZipName(compression), len);
+	}
+
+	if (req->encoding != MCS_ENC_XML || compression != MCS_ZIP_NONE) {
+		hp += snprintf(hp, hend - hp, "Length: %d\n", outlen);
+	}
+
+	hp += snprintf(hp, hend - hp, "\n");
+
+	struct iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = hp - header;
+	iov[1].iov_base = out;
+	iov[1].iov_len = outlen;
+
+	if (writev(req->clientSocket, iov, 2) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_writeResponse: Error writing to socket.\n");
+		return -1;
+	}
 
 	return 0;
 }
@@ -1,13 +1,22 @@
 #ifndef MCS_H
 #define MCS_H
 
-#include <arpa/inet.h> // inet_ntoa
+#define _GNU_SOURCE // accept4, pipe2
+
+#include <arpa/inet.h> // inet_ntop
+#include <errno.h>
 #include <dirent.h> // opendir
+#include <fcntl.h> // O_CLOEXEC
 #include <signal.h> // SIGTERM, SIGKILL
 #include <stdio.h> // printf
 #include <stdlib.h> // exit
 #include <string.h> // memset, strcpy
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h> // wait4
 #include <sys/socket.h>
+#include <sys/stat.h> // stat
+#include <sys/uio.h> // writev
 #include <time.h>
 #include <sys/wait.h> // waitpid
 #include <unistd.h> // fork, exec
@@ -15,10 +24,103 @@
 // server settings
 #define MCS_ADMIN_KEY "admin"
 #define MCS_PORT 5002
+#define MCS_BACKLOG 64 // pending connections per endpoint
+#define MCS_UNIX_SOCKET "/tmp/mcs.sock" // local clients, undefine to disable
+#define MCS_MAX_LISTENERS 8 // endpoints, see MCS_listeners in mcs_listen.c
+#define MCS_UDP_PORT 5002 // key events without a connection, 0 to disable
+#define MCS_MAP_FILE "/dev/shm/mcs.map" // library map, undefine to disable
+#define MCS_REQUEST_SIZE 128 // longest request, the rest is not read
 #define MCS_MAX_ITEMS 100000
 #define MCS_HASH_SIZE 10000000
+#define MCS_PATH_SIZE 256 // longest file path
+#define MCS_MAX_DEPTH 64 // deepest directory below a configured directory
 #define MCP_VERSION "MCP/0.1"
 
+// worker threads (see mcs_worker.c). every worker accepts clients on sockets
+// of its own (SO_REUSEPORT) and serves the commands that only read (ART,
+// BROWSE-DIR, INFO, LIST, LOG, STAT) from a snapshot of the item list and of
+// the status. the other commands are passed to the main loop, which owns the
+// sessions and the children. 0 starts a worker per CPU, with 1 the main loop
+// serves the clients itself. snapshots that were replaced are freed once no
+// worker reads them, checked every MCS_RECLAIM_INTERVAL ms
+#define MCS_WORKERS 0
+#define MCS_MAX_WORKERS 16
+#define MCS_RECLAIM_INTERVAL 10
+
+// log levels, records above the level are not written (see mcs_log.c).
+// records are queued in a ring of MCS_LOG_RECORDS slots and written in
+// batches by the log thread, which sleeps MCS_LOG_INTERVAL ms when the ring
+// is empty
+#define MCS_LOG_ERROR 0
+#define MCS_LOG_WARN 1
+#define MCS_LOG_INFO 2
+#define MCS_LOG_DEBUG 3
+#define MCS_LOG_LEVEL MCS_LOG_INFO
+#define MCS_LOG_RECORDS 1024 // power of 2
+#define MCS_LOG_RECORD_SIZE 256 // longer records are truncated
+#define MCS_LOG_BATCH 64
+#define MCS_LOG_INTERVAL 20
+
+// compression of response bodies (see mcs_zip.c)
+// bodies smaller than the threshold are always sent uncompressed
+#define MCS_ZIP_THRESHOLD 1024
+#define MCS_ZIP_LEVEL 6
+
+// stopping a child process escalates SIGINT -> SIGTERM -> SIGKILL, the
+// timeouts (ms) are the time to wait for the child to exit before the next
+// signal is sent
+#define MCS_TIMEOUT_SIGINT 3000
+#define MCS_TIMEOUT_SIGTERM 2000
+
+// key sequences of CTRL, keys are written to the child in one operation up
+// to the next delay (ms). if the pipe of the child is full the rest is
+// written every MCS_CTRL_RETRY ms, for up to MCS_CTRL_MAX_DELAY ms
+#define MCS_CTRL_MAX_KEYS 256
+#define MCS_CTRL_MAX_DELAY 10000
+#define MCS_CTRL_RETRY 20
+
+// playback sessions, one per output zone. each session has its own child
+// process, control pipe and queue. the default session always exists
+#define MCS_SESSION_DEFAULT "main"
+#define MCS_SESSION_NAME 32
+#define MCS_MAX_SESSIONS 16
+#define MCS_SESSION_BUCKETS 32
+
+// children are playing or stopping, the hash table is kept half empty
+#define MCS_CHILD_BUCKETS 64
+#define MCS_CHILD_EMPTY 0
+#define MCS_CHILD_DELETED -1
+
+// subscribers of SUBSCRIBE, events that were not sent yet are queued per
+// subscriber up to MCS_SUBSCRIBER_QUEUE bytes, slower subscribers are dropped
+#define MCS_MAX_SUBSCRIBERS 32
+#define MCS_SUBSCRIBER_QUEUE 4096
+#define MCS_SCAN_PROGRESS 1000 // items between SCAN events
+
+// cover art, embedded images are extracted once into the cache directory
+#define MCS_ART_CACHE "/tmp/mcs-art"
+#define MCS_ART_MAX_SIZE (16 * 1024 * 1024)
+#define MCS_ETAG_SIZE 33
+
+// content IDs (MCS_CONTENT_ID), the ID of an item is a hash of a few blocks
+// of the file and survives renames and moves. the IDs of unchanged files are
+// kept in the index, so only new or changed files are read on a rescan
+#define MCS_INDEX_FILE "/tmp/mcs-index"
+#define MCS_ID_THREADS 4
+#define MCS_ID_SAMPLES 3 // blocks at the start, middle and end
+#define MCS_ID_BLOCK_SIZE 4096
+
+// resources of the playing children are sampled from /proc every
+// MCS_USAGE_INTERVAL ms (0 to disable). until the child has read its file
+// the sampling is faster, for the start latency
+#define MCS_USAGE_INTERVAL 1000
+#define MCS_USAGE_START_INTERVAL 10
+#define MCS_USAGE_START_TIMEOUT 5000
+
+// play queue, the head of the next file is read ahead while an item plays
+#define MCS_QUEUE_SIZE 1024
+#define MCS_READAHEAD_SIZE (2 * 1024 * 1024)
+
 // extensions, types and binaries
 #define MCS_TYPE_BASE 100
 #define MCS_TYPE_AUDIO 100
@@ -38,6 +140,46 @@
 #define MCS_BIN_VIDEO "/usr/bin/omxplayer -b %s"
 #define MCS_BIN_UNKOWN "./handleUnkownType.sh %s"
 
+// persistent players, optional (see mcs_daemon.c). the player of a type is
+// started once per session and gets the items through its STDIN instead of a
+// process per item. the protocol is the one of mpg123 -R, other players can
+// be added to MCS_daemonCommands. only the extensions the player decodes are
+// loaded into it, other items, types without a player and types whose player
+// can't be started use the MCS_BIN_* players
+// #define MCS_DAEMON_AUDIO "/usr/bin/mpg123 -R"
+#define MCS_DAEMON_AUDIO_EXT ":mp3:"
+#define MCS_MAX_DAEMONS 16
+#define MCS_DAEMON_LINE 256 // longest line of a player that is parsed
+
+// federation (see mcs_fed.c). arguments of the server that start with
+// MCS_NODE_PREFIX ("mcs://host:port") are other servers. their items are
+// listed in a directory of that name and the commands for them are forwarded.
+// the item list of a node is checked with STAT every MCS_NODE_INTERVAL ms
+// and on its LIST events, and fetched again in pages of MCS_NODE_PAGE items
+// if its version changed. a node that is down is checked less often, the
+// interval doubles up to MCS_NODE_MAX_INTERVAL ms. up to MCS_NODE_COMMANDS
+// STOP and CTRL commands wait for a node that is still busy with the ones
+// before them
+#define MCS_NODE_PREFIX "mcs://"
+#define MCS_MAX_NODES 8
+#define MCS_NODE_INTERVAL 5000
+#define MCS_NODE_MAX_INTERVAL 60000
+#define MCS_NODE_TIMEOUT 1000 // ms a request to a node may take in total
+#define MCS_NODE_PAGE 100
+#define MCS_NODE_MAX_RESPONSE (1024 * 1024)
+#define MCS_NODE_LINE 256 // longest event line of a node that is parsed
+#define MCS_NODE_COMMANDS 16
+#define MCS_NODE_COMMAND_SIZE 128 // a server reads a request with one read
+
+// response encodings
+#define MCS_ENC_XML 0
+#define MCS_ENC_BIN 1
+
+// response compression methods
+#define MCS_ZIP_NONE 0
+#define MCS_ZIP_DEFLATE 1
+#define MCS_ZIP_ZSTD 2
+
 // server states
 #define MCS_STATE_LISTEN 1
 #define MCS_STATE_RESTART 2
@@ -45,6 +187,7 @@
 
 // status codes
 #define MCS_ERR_OK 200
+#define MCS_ERR_NOT_MODIFIED 304
 #define MCS_ERR_BAD_REQUEST 401
 #define MCS_ERR_BAD_PARAMS 402
 #define MCS_ERR_UNAUTHORIZED 403
@@ -55,6 +198,7 @@
 #define MCS_ERR_NOT_IMPLEMENTED 504
 
 #define MCS_MSG_OK              "OK"
+#define MCS_MSG_NOT_MODIFIED    "Not Modified"
 #define MCS_MSG_BAD_REQUEST     "Bad Request"
 #define MCS_MSG_BAD_PARAMS      "Bad Parameters"
 #define MCS_MSG_UNAUTHORIZED    "Unauthorized"
@@ -64,17 +208,285 @@
 #define MCS_MSG_TOO_LONG        "Message Too Long"
 #define MCS_MSG_NOT_IMPLEMENTED "Not Implemented"
 
+// size of the string fields in MCS_Info
+#define MCS_INFO_STR 256
+
+// native tag readers (see mcs_meta.c). larger tags are read up to
+// MCS_META_MAX_TAG, the first MPEG frame is looked for in the first
+// MCS_META_FRAME_SIZE bytes of the stream and the last page of an Ogg stream
+// in the last MCS_META_TAIL_SIZE bytes of the file
+#define MCS_META_MAX_TAG 1048576
+#define MCS_META_FRAME_SIZE 4096
+#define MCS_META_TAIL_SIZE 65536
+
+// a directory of the item tree. node 0 is the root, its children are the
+// configured directories. the children of a node are contiguous, in
+// dirNodes and in items
+struct MCS_Dir {
+	unsigned int id; // index in dirNodes
+	char* name; // the path of configured directories
+	struct MCS_Dir* parent; // NULL for the root
+	int firstDir;
+	int numDirs;
+	int firstItem;
+	int numItems;
+};
+
+// the path of an item is the path of its directory and the label, see
+// MCS_getItemPath
 struct MCS_Item {
 	unsigned int id;
-	char* filepath;
-	char* label;
+	struct MCS_Dir* dir;
+	char* label; // file name
 	int type;
 };
 
+// tag data and properties of an item, see MCS_sendInfo
+struct MCS_Info {
+	int hasTag;
+	char title[MCS_INFO_STR];
+	char artist[MCS_INFO_STR];
+	char album[MCS_INFO_STR];
+	int year;
+	char comment[MCS_INFO_STR];
+	int track;
+	char genre[MCS_INFO_STR];
+
+	int hasProperties;
+	int bitrate;
+	int samplerate;
+	int channels;
+	int length;
+};
+
+
+// items that are played one after another, referenced by ID
+struct MCS_Queue {
+	unsigned int items[MCS_QUEUE_SIZE]; // ring buffer
+	int head;
+	int size;
+	unsigned int warmedID; // next item that was read ahead
+
+	// time to spawn the next item per transition (us)
+	unsigned long transitions;
+	long long lastSpawn;
+	long long maxSpawn;
+	long long totalSpawn;
+};
+
+// resources of the child of a session, current values are of the last
+// sample, see mcs_usage.c
+struct MCS_Usage {
+	long long started; // us, when the item was played
+	long long stopped; // us, 0 while the child plays
+	long long execTime; // us from PLAY to exec
+	long long readTime; // us from PLAY to the first read, 0 if not seen
+	long long deadline; // us, next sample
+	long long lastSample; // us
+
+	// the played file, to find it among the open files of the child
+	dev_t dev;
+	ino_t ino;
+
+	unsigned long long cpuTime; // us, user and system
+	int load; // % of one CPU since the previous sample
+	int maxLoad;
+	long rss; // kB
+	long maxRss;
+	unsigned long long readBytes;
+	unsigned long long readRate; // bytes per second
+	unsigned long long maxReadRate;
+	unsigned long switches; // voluntary context switches
+	unsigned long forcedSwitches; // involuntary context switches
+};
+
+// keys that are sent to a child process, see MCS_parseKeys
+struct MCS_Keys {
+	char keys[MCS_CTRL_MAX_KEYS];
+	int delays[MCS_CTRL_MAX_KEYS]; // ms to wait after the key
+	int numKeys;
+};
+
+// a persistent player of a session and type, see mcs_daemon.c
+struct MCS_Daemon {
+	int type;
+	const struct MCS_DaemonCommand* command;
+	struct MCS_Session* session;
+
+	pid_t pid; // 0 if the player is not running
+	int wpipe; // commands to the player
+	int rpipe; // lines of the player, -1 if closed
+	char line[MCS_DAEMON_LINE];
+	int lineLen;
+
+	// LOADs the player has neither started nor failed yet, until then the
+	// done lines are of items that were stopped
+	int loading;
+
+	int failed; // the player could not be started, not tried again
+};
+
+// a request to a node that is driven by the poll of the main loop
+struct MCS_NodeRequest {
+	int fd; // -1 if no request is open
+	int connected;
+	char command[MCS_NODE_COMMAND_SIZE];
+	int sent; // bytes of the command
+	char* buffer; // the response, grows up to MCS_NODE_MAX_RESPONSE
+	int len;
+	int size;
+	long long start; // us
+	long long deadline; // us
+};
+
+// another server whose items are merged into the item list, see mcs_fed.c
+struct MCS_Node {
+	char* name; // the argument, i.e. "mcs://host:5002"
+	struct MCS_Dir* dir; // holds the items of the node
+	struct sockaddr_storage address;
+	socklen_t addressLen; // 0 if the address could not be resolved
+
+	int up; // the last request succeeded
+	unsigned int version; // of the fetched items, 0 if none
+	char statTag[MCS_ETAG_SIZE]; // validator of the last STAT
+	long long deadline; // us, of the next STAT
+	int failures; // checks in a row that failed
+
+	// STAT and then the pages of LIST, one request at a time
+	struct MCS_NodeRequest check;
+	struct MCS_Item** fetched; // NULL if the list is not fetched
+	int numFetched;
+	int fetchSize;
+	unsigned int fetchVersion;
+	int page; // items per page of LIST
+
+	// STOP and CTRL are sent in order, commands[0] is the open one
+	struct MCS_NodeRequest command;
+	char commands[MCS_NODE_COMMANDS][MCS_NODE_COMMAND_SIZE];
+	int numCommands;
+
+	struct MCS_NodeRequest subscribe; // until SUBSCRIBE was sent
+	int events; // SUBSCRIBE connection, -1 if closed
+	char line[MCS_NODE_LINE];
+	int lineLen;
+
+	// round trips of the requests to the node (us)
+	unsigned long requests;
+	long long lastTime;
+	long long maxTime;
+	long long totalTime;
+};
+
+// a playback session (zone)
+struct MCS_Session {
+	char name[MCS_SESSION_NAME];
+
+	// only one child process should run at a time per session
+	pid_t child;
+	int wpipe; // write to child pipe
+	struct MCS_Item* playingItem; // ref to item that is currenty playing
+	struct MCS_Daemon* daemon; // plays the item, NULL for a child per item
+	struct MCS_Node* node; // plays the item, NULL if it is played here
+	unsigned int remoteID; // of the item on the node
+	struct MCS_Queue queue;
+	struct MCS_Usage usage; // of the current or last child
+
+	// keys of the last CTRL that wait for their delay
+	struct MCS_Keys keys;
+	int keyPos; // next key to send
+	long long keyDeadline; // us
+	long long keyStalled; // us, since when the pipe is full, 0 if it is not
+};
+
+// a child process that plays an item of a session or that was told to stop
+// and has not exited yet
+struct MCS_Child {
+	pid_t pid; // MCS_CHILD_EMPTY or MCS_CHILD_DELETED if the slot is free
+	struct MCS_Session* session; // NULL if the child is stopping
+	int signal; // index of the last signal sent, see MCS_signalChild
+	long long deadline; // us, when to send the next signal
+};
+
+// a connection that receives events, see MCS_notify
+struct MCS_Subscriber {
+	int socket; // -1 if the slot is free
+	char* buffer; // queued events
+	int start; // first byte not sent yet
+	int end;
+};
+
+// the item list and the directory tree as the clients see them, copied into
+// one block by MCS_publishSnapshot after every change and never modified, so
+// that the workers read it without locks (see mcs_snap.c)
+struct MCS_Snapshot {
+	unsigned int version;
+	struct MCS_Item** items;
+	int size;
+	struct MCS_Dir** dirNodes;
+	int numDirNodes;
+
+	struct MCS_Snapshot* retired; // next older snapshot that waits to be freed
+};
+
+// the part of a session that STAT reports
+struct MCS_SessionStatus {
+	char name[MCS_SESSION_NAME];
+	int playing;
+	unsigned int itemID;
+	int queueSize;
+	unsigned int next; // item at the head of the queue, 0 if empty
+	unsigned long transitions;
+	long long lastSpawn;
+	long long maxSpawn;
+	long long totalSpawn;
+	struct MCS_Usage usage;
+};
+
+// the part of a node that STAT reports
+struct MCS_NodeStatus {
+	char name[MCS_PATH_SIZE]; // a copy, the node may be freed by RESTART
+	int up;
+	unsigned int version;
+	int size;
+	unsigned long requests;
+	long long lastTime;
+	long long maxTime;
+	long long totalTime;
+};
+
+// what STAT reports, copied from the sessions and nodes by the main loop
+// (MCS_publishStatus) and read by the workers under a seqlock
+struct MCS_Status {
+	unsigned int seq; // odd while the main loop writes
+	unsigned int version;
+	int size;
+	unsigned long changes;
+	struct MCS_SessionStatus sessions[MCS_MAX_SESSIONS];
+	int numSessions;
+	struct MCS_NodeStatus nodes[MCS_MAX_NODES];
+	int numNodes;
+};
+
+// options of a single request, i.e. "LIST 0 0 10 ENC=BIN"
+struct MCS_Request {
+	int clientSocket;
+	struct MCS_Worker* worker; // serves the request, NULL for the main loop
+	struct MCS_Snapshot* snapshot; // the items the request is served from
+	int encoding; // MCS_ENC_XML or MCS_ENC_BIN
+	int compression; // MCS_ZIP_*
+	struct MCS_Zip* zip; // reused compression contexts
+	char session[MCS_SESSION_NAME]; // empty for the default session
+	char ifTag[MCS_ETAG_SIZE]; // validator the client has, empty if none
+	int validate; // the client sent IF= (maybe empty) and gets the ETag
+	char etag[MCS_ETAG_SIZE]; // validator of the response, sent as ETag
+};
+
 struct MCS_Context {
 	// server data
 	int port;	
 	int state;
+	int listeners[MCS_MAX_LISTENERS]; // -1 if the endpoint is not open
+	int numListeners;
 	char** dirs;
 	int numDirs;
 
@@ -84,25 +496,107 @@ struct MCS_Context {
 	int capacity;
 	unsigned int version;
 
-	// only one child process should run at a time
-	pid_t child;
-	int wpipe; // write to child pipe
-	struct MCS_Item* playingItem; // ref to item that is currenty playing
+	// directory tree of the items
+	struct MCS_Dir** dirNodes;
+	int numDirNodes;
+	int dirNodeCapacity;
+
+	// response compression contexts and metrics
+	struct MCS_Zip* zip;
+
+	// player argv templates, parsed once from the MCS_BIN_* strings
+	struct MCS_Player* players;
+	int numPlayers;
+
+	// playback sessions, looked up by name through sessionTable
+	struct MCS_Session sessions[MCS_MAX_SESSIONS];
+	int numSessions;
+	int sessionTable[MCS_SESSION_BUCKETS]; // session index, -1 if empty
+
+	// child supervision, children are looked up by pid
+	int sigfd; // SIGCHLD is received through a signalfd
+	int timeoutSigint; // ms
+	int timeoutSigterm; // ms
+	struct MCS_Child children[MCS_CHILD_BUCKETS];
+	int numStopping;
+
+	// persistent players
+	struct MCS_Daemon daemons[MCS_MAX_DAEMONS];
+	int numDaemons;
+
+	// other servers whose items are listed
+	struct MCS_Node nodes[MCS_MAX_NODES];
+	int numNodes;
+
+	// bumped whenever the players or queues reported by STAT change
+	unsigned long changes;
+
+	// connections of SUBSCRIBE
+	struct MCS_Subscriber subscribers[MCS_MAX_SUBSCRIBERS];
+	int numSubscribers;
+
+	// threads that serve the clients, none if the main loop does
+	struct MCS_Worker* workers;
+	int numWorkers;
+	int handoff[2]; // requests the workers pass to the main loop
+	int wake[2]; // the write end is closed to stop the workers
+
+	// what the workers read
+	struct MCS_Snapshot* snapshot; // the latest one
+	struct MCS_Snapshot* retired;
+	struct MCS_Status status;
+
+	// the library map for local clients, see mcs_map.c
+	int mapfd;
+	char* map; // NULL if there is none
+	size_t mapSize;
+	char* mapPath;
 };
 
+unsigned int sax_hash(char* msg, int len, int modn);
+
+#ifdef MCS_DEBUG
+int MCS_checkIDs(struct MCS_Item** items, int numItems);
+long MCS_getSize(struct MCS_Context* mcc);
+#endif
+
 struct MCS_Context* MCS_createContext();
 void MCS_freeContext(struct MCS_Context* mcc);
+int MCS_formatStatus(char* buffer, int statusCode);
 void MCS_freeItems(struct MCS_Item** items, int numItems);
+int MCS_getItemTag(struct MCS_Item* item, char* etag);
 int MCS_getItemType(char* filename);
-int MCS_handleKillChild(struct MCS_Context* mcc);
-int MCS_handlePlayItem(struct MCS_Context* mcc, struct MCS_Item* item);
-void MCS_handleRequest(struct MCS_Context* mcc, int clientSocket);
+long long MCS_getTime();
+struct MCS_Player* MCS_getPlayer(struct MCS_Context* mcc, int type);
+void MCS_handleChildExit(struct MCS_Context* mcc);
+int MCS_handleCommand(struct MCS_Context* mcc, int clientSocket, char* buffer,
+		int len);
+void MCS_handleItemEnd(struct MCS_Context* mcc, struct MCS_Session* session,
+		int status);
+int MCS_handleKillChild(struct MCS_Context* mcc, struct MCS_Session* session);
+int MCS_handleKillTimeouts(struct MCS_Context* mcc);
+int MCS_handlePlayItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Item* item);
+int MCS_handleQuery(struct MCS_Context* mcc, struct MCS_Request* req,
+		char* buffer, int len, int* statusCode);
+int MCS_handleRequest(struct MCS_Context* mcc, int clientSocket);
+int MCS_isModified(struct MCS_Request* req);
 struct MCS_Item* MCS_lookupItem(struct MCS_Item** items, int numItems, unsigned int itemID);
 void MCS_parseDirs(struct MCS_Context* mcc);
-void MCS_populateList(struct MCS_Context* mcc, int* i, char* dirpath, int dryrun);
+void MCS_parseOptions(struct MCS_Request* req, char* buffer);
+void MCS_parsePlayers(struct MCS_Context* mcc);
+void MCS_populateList(struct MCS_Context* mcc, struct MCS_Dir* node,
+		char* dirpath);
+int MCS_readRequest(int clientSocket, char* buffer);
 void MCS_runServer(struct MCS_Context* mcc);
-int MCS_sendInfo(struct MCS_Item* item, int clientSocket);
-int MCS_sendItems(struct MCS_Context* mcc, int type, int offset, int length, int clientSocket);
-int MCS_sendStatus(struct MCS_Context* mcc, int clientSocket);
+int MCS_signalChild(struct MCS_Context* mcc, struct MCS_Child* child);
+int MCS_spawnItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Item* item, char* filepath, long long start);
+void MCS_stopSessions(struct MCS_Context* mcc);
+int MCS_sendInfo(struct MCS_Item* item, struct MCS_Request* req);
+int MCS_sendItems(struct MCS_Snapshot* snapshot, int type, int offset,
+		int length, struct MCS_Request* req);
+int MCS_sendStatus(struct MCS_Context* mcc, struct MCS_Request* req);
+int MCS_writeResponse(struct MCS_Request* req, char* body, int len);
 
 #endif
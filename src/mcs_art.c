@@ -0,0 +1,414 @@
+#include "mcs_art.h"
+#include "mcs_log.h"
+#include "mcs_meta.h"
+#include "mcs_tree.h"
+
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+// image files next to an item, in the order they are looked up
+static char* MCS_artFiles[] = {
+	"folder.jpg", "folder.png", "cover.jpg", "cover.png",
+	"Folder.jpg", "Cover.jpg"
+};
+
+#define MCS_NUM_ART_FILES (sizeof(MCS_artFiles) / sizeof(MCS_artFiles[0]))
+
+static char* MCS_getArtType(char* path) {
+	char* p = strrchr(path, '.');
+
+	if (p != NULL && strcmp(p, ".png") == 0)
+		return "image/png";
+
+	return "image/jpeg";
+}
+
+// FNV-1a, names the files in the art cache
+static unsigned long long MCS_hashArt(char* data, long len) {
+	unsigned long long h = 0xCBF29CE484222325ULL;
+
+	long i;
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) data[i];
+		h *= 0x100000001B3ULL;
+	}
+
+	return h;
+}
+
+// skips a string of the text encoding of an ID3v2 frame, returns NULL if the
+// string is not terminated
+static unsigned char* MCS_skipID3String(unsigned char* p, unsigned char* end,
+		int encoding) {
+	if (encoding == 1 || encoding == 2) {
+		// UTF-16, terminated by two zero bytes
+		for (; p + 1 < end; p += 2) {
+			if (p[0] == 0 && p[1] == 0)
+				return p + 2;
+		}
+
+		return NULL;
+	}
+
+	for (; p < end; p++) {
+		if (*p == 0)
+			return p + 1;
+	}
+
+	return NULL;
+}
+
+// returns the picture of an APIC (PIC in v2.2) frame, the front cover is
+// preferred
+static int MCS_readID3Picture(int fd, char** data, long* len) {
+	unsigned char header[10];
+
+	if (read(fd, header, 10) != 10 || memcmp(header, "ID3", 3) != 0)
+		return -1;
+
+	int version = header[3];
+	int flags = header[5];
+	long size = MCS_SYNCSAFE(header + 6);
+
+	// unsynchronised tags are rare and not supported
+	if (version < 2 || version > 4 || (flags & 0x80) || size > MCS_ART_MAX_SIZE)
+		return -1;
+
+	unsigned char* tag = (unsigned char*) malloc(size);
+
+	if (read(fd, tag, size) != size) {
+		free(tag);
+		return -1;
+	}
+
+	unsigned char* p = tag;
+	unsigned char* end = tag + size;
+
+	// skip the extended header
+	if (version > 2 && (flags & 0x40) && end - p >= 4) {
+		unsigned long extlen = version == 3 ? MCS_U32(p) + 4 : MCS_SYNCSAFE(p);
+		p = extlen < (unsigned long) (end - p) ? p + extlen : end;
+	}
+
+	int headerlen = version == 2 ? 6 : 10;
+	unsigned char* best = NULL;
+	long bestlen = 0;
+
+	while (p + headerlen <= end && p[0] != 0) {
+		long framelen;
+		int skip = 0;
+
+		if (version == 2) {
+			framelen = (p[3] << 16) | (p[4] << 8) | p[5];
+		} else if (version == 3) {
+			framelen = MCS_U32(p + 4);
+			skip = p[9] & 0xC0; // compressed or encrypted
+		} else {
+			framelen = MCS_SYNCSAFE(p + 4);
+			skip = p[9] & 0x0E; // compressed, encrypted or unsynchronised
+		}
+
+		unsigned char* frame = p + headerlen;
+		unsigned char* frameend = frame + framelen;
+
+		if (framelen <= 0 || frameend > end)
+			break;
+
+		int isPicture = version == 2 ? memcmp(p, "PIC", 3) == 0
+				: memcmp(p, "APIC", 4) == 0;
+
+		p = frameend;
+
+		if (!isPicture || skip)
+			continue;
+
+		if (version == 4 && (frame[-1] & 0x01)) {
+			frame += 4; // data length indicator
+		}
+
+		if (frame >= frameend)
+			continue;
+
+		int encoding = frame[0];
+		unsigned char* q;
+
+		if (version == 2) {
+			q = frame + 4; // 3 byte image format
+		} else {
+			q = MCS_skipID3String(frame + 1, frameend, 0); // MIME type
+		}
+
+		if (q == NULL || q >= frameend)
+			continue;
+
+		int type = *q;
+		q = MCS_skipID3String(q + 1, frameend, encoding); // description
+
+		if (q == NULL || q >= frameend)
+			continue;
+
+		if (best == NULL || type == 3) {
+			best = q;
+			bestlen = frameend - q;
+		}
+
+		if (type == 3)
+			break;
+	}
+
+	if (best == NULL) {
+		free(tag);
+		return -1;
+	}
+
+	*data = (char*) malloc(bestlen);
+	memcpy(*data, best, bestlen);
+	*len = bestlen;
+
+	free(tag);
+	return 0;
+}
+
+// returns the picture of a PICTURE metadata block, the front cover is
+// preferred
+static int MCS_readFLACPicture(int fd, char** data, long* len) {
+	unsigned char header[4];
+
+	if (read(fd, header, 4) != 4 || memcmp(header, "fLaC", 4) != 0)
+		return -1;
+
+	*data = NULL;
+
+	int last = 0;
+
+	while (!last) {
+		if (read(fd, header, 4) != 4)
+			break;
+
+		last = header[0] & 0x80;
+		long blocklen = (header[1] << 16) | (header[2] << 8) | header[3];
+
+		if ((header[0] & 0x7F) != 6 || blocklen > MCS_ART_MAX_SIZE) {
+			lseek(fd, blocklen, SEEK_CUR);
+			continue;
+		}
+
+		unsigned char* block = (unsigned char*) malloc(blocklen);
+
+		if (read(fd, block, blocklen) != blocklen) {
+			free(block);
+			break;
+		}
+
+		// type, MIME type, description, 4 * 4 bytes of image properties
+		unsigned char* p = block;
+		unsigned char* end = block + blocklen;
+		unsigned long type = 0;
+		unsigned long datalen = 0;
+		unsigned long n;
+
+		if (end - p >= 8
+				&& (n = MCS_U32(p + 4)) <= (unsigned long) (end - p - 8)) {
+			type = MCS_U32(p);
+			p += 8 + n;
+
+			if (end - p >= 4
+					&& (n = MCS_U32(p)) <= (unsigned long) (end - p - 4)) {
+				p += 4 + n;
+
+				if (end - p >= 20) {
+					datalen = MCS_U32(p + 16);
+					p += 20;
+				}
+			}
+		}
+
+		if (datalen > 0 && datalen <= (unsigned long) (end - p)
+				&& (*data == NULL || type == 3)) {
+			free(*data);
+			*data = (char*) malloc(datalen);
+			memcpy(*data, p, datalen);
+			*len = datalen;
+		}
+
+		free(block);
+
+		if (*data != NULL && type == 3)
+			break;
+	}
+
+	return *data != NULL ? 0 : -1;
+}
+
+int MCS_extractArt(char* filepath, char** data, long* len) {
+	int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	int r = MCS_readID3Picture(fd, data, len);
+
+	if (r < 0) {
+		lseek(fd, 0, SEEK_SET);
+		r = MCS_readFLACPicture(fd, data, len);
+	}
+
+	close(fd);
+	return r;
+}
+
+int MCS_findArt(struct MCS_Item* item, char* path, int size, char* etag) {
+	struct stat st;
+	char filepath[MCS_PATH_SIZE];
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0)
+		return MCS_ERR_TOO_LONG;
+
+	// an image next to the item is used as is, the validator changes with
+	// the image file
+	int dirlen = strrchr(filepath, '/') - filepath + 1;
+
+	int i;
+	for (i = 0; i < MCS_NUM_ART_FILES; i++) {
+		if (snprintf(path, size, "%.*s%s", dirlen, filepath,
+				MCS_artFiles[i]) >= size)
+			return MCS_ERR_TOO_LONG;
+
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+			snprintf(etag, MCS_ETAG_SIZE, "%lx-%lx",
+					(unsigned long) st.st_mtime, (unsigned long) st.st_size);
+			return MCS_ERR_OK;
+		}
+	}
+
+	// embedded images are extracted once into the cache. the cache holds
+	// one file per distinct image, named by the hash of its content, and a
+	// link per item file that points to it ("-" if there is no image)
+	if (stat(filepath, &st) < 0)
+		return MCS_ERR_NOT_FOUND;
+
+	char link[256];
+	snprintf(link, sizeof(link), "%s/%lx-%lx-%lx-%lx", MCS_ART_CACHE,
+			(unsigned long) st.st_dev, (unsigned long) st.st_ino,
+			(unsigned long) st.st_mtime, (unsigned long) st.st_size);
+
+	char target[64];
+	int len = readlink(link, target, sizeof(target) - 1);
+
+	if (len < 0) {
+		char* data;
+		long datalen;
+
+		if (mkdir(MCS_ART_CACHE, 0755) < 0 && errno != EEXIST) {
+			MCS_log(MCS_LOG_ERROR, "MCS_findArt: Can't create %s\n",
+					MCS_ART_CACHE);
+			return MCS_ERR_SERVER_ERROR;
+		}
+
+		if (MCS_extractArt(filepath, &data, &datalen) < 0) {
+			symlink("-", link);
+			return MCS_ERR_NOT_FOUND;
+		}
+
+		len = snprintf(target, sizeof(target), "%016llx%s",
+				MCS_hashArt(data, datalen),
+				(unsigned char) data[0] == 0x89 ? ".png" : ".jpg");
+
+		snprintf(path, size, "%s/%s", MCS_ART_CACHE, target);
+
+		// another item may have the same image already. the workers may
+		// extract the same image at the same time, each into a file of its
+		// own, the last rename wins
+		if (access(path, F_OK) < 0) {
+			char tmppath[256];
+			snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+
+			int fd = mkostemp(tmppath, O_CLOEXEC);
+
+			if (fd < 0 || fchmod(fd, 0644) < 0
+					|| write(fd, data, datalen) != datalen
+					|| rename(tmppath, path) < 0) {
+				MCS_log(MCS_LOG_ERROR, "MCS_findArt: Error writing %s\n", path);
+
+				if (fd >= 0) {
+					close(fd);
+					unlink(tmppath);
+				}
+
+				free(data);
+				return MCS_ERR_SERVER_ERROR;
+			}
+
+			close(fd);
+		}
+
+		free(data);
+		symlink(target, link);
+	}
+
+	target[len] = '\0';
+
+	if (strcmp(target, "-") == 0)
+		return MCS_ERR_NOT_FOUND;
+
+	if (snprintf(path, size, "%s/%s", MCS_ART_CACHE, target) >= size)
+		return MCS_ERR_TOO_LONG;
+
+	// the content hash
+	snprintf(etag, MCS_ETAG_SIZE, "%.16s", target);
+
+	return MCS_ERR_OK;
+}
+
+int MCS_sendArt(struct MCS_Item* item, struct MCS_Request* req) {
+	char path[512];
+	char etag[MCS_ETAG_SIZE];
+
+	int r = MCS_findArt(item, path, sizeof(path), etag);
+
+	if (r != MCS_ERR_OK)
+		return r;
+
+	// the client has the image already
+	if (strcmp(etag, req->ifTag) == 0)
+		return MCS_ERR_NOT_MODIFIED;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendArt: Error opening %s\n", path);
+
+		if (fd >= 0)
+			close(fd);
+
+		return MCS_ERR_NOT_FOUND;
+	}
+
+	char header[256];
+	int len = snprintf(header, sizeof(header),
+			"%s %d %s\nType: %s\nETag: %s\nLength: %ld\n\n",
+			MCP_VERSION, MCS_ERR_OK, MCS_MSG_OK, MCS_getArtType(path), etag,
+			(long) st.st_size);
+
+	if (write(req->clientSocket, header, len) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendArt: Error writing to socket.\n");
+		close(fd);
+		return -1;
+	}
+
+	// the image is copied from the page cache to the socket by the kernel
+	off_t offset = 0;
+
+	while (offset < st.st_size) {
+		if (sendfile(req->clientSocket, fd, &offset,
+				st.st_size - offset) <= 0) {
+			MCS_log(MCS_LOG_ERROR, "MCS_sendArt: Error sending %s\n", path);
+			close(fd);
+			return -1;
+		}
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef MCS_ART_H
+#define MCS_ART_H
+
+#include "mcs.h"
+
+int MCS_extractArt(char* filepath, char** data, long* len);
+int MCS_findArt(struct MCS_Item* item, char* path, int size, char* etag);
+int MCS_sendArt(struct MCS_Item* item, struct MCS_Request* req);
+
+#endif
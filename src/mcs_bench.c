@@ -0,0 +1,901 @@
+#include "mcs.h"
+#include "mcs_fed.h"
+#include "mcs_listen.h"
+#include "mcs_log.h"
+#include "mcs_map.h"
+#include "mcs_session.h"
+#include "mcs_snap.h"
+#include "mcs_spawn.h"
+#include "mcs_tree.h"
+#include "mcs_worker.h"
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// microbenchmarks of the hot functions of the server, see "make bench".
+// the server code is linked as a library, allocations are counted by
+// wrapping malloc (-Wl,--wrap=malloc), allocations inside of the C library
+// (i.e. opendir) are not counted
+
+#define MCS_BENCH_DIRS 50
+#define MCS_BENCH_FILES 200 // per directory
+#define MCS_BENCH_STUB "/bin/true %s"
+#define MCS_BENCH_CLIENTS 4 // threads that send requests to the workers
+
+// the MP3 files of the fixture are an ID3v2 tag with a title and the
+// header of a 128 kbit/s frame, so that INFO has a body
+static const char MCS_benchTag[] = "ID3\x03\x00\x00\x00\x00\x00\x10"
+		"TIT2\x00\x00\x00\x06\x00\x00\x00Title"
+		"\xFF\xFB\x90\x64";
+
+// the requests of a client thread, see MCS_benchWorkers
+struct MCS_BenchClient {
+	struct sockaddr_storage* storage;
+	socklen_t len;
+	char* request;
+	long iterations;
+	pthread_t thread;
+};
+
+// a server that handles the requests of the benchmarks in a thread, for
+// the round trips through another server
+struct MCS_BenchServer {
+	struct MCS_Context* mcc;
+	int listenSocket;
+	volatile int stop;
+	pthread_t thread;
+};
+
+struct MCS_Bench {
+	char* name;
+	long iterations;
+
+	long long time; // ns
+	unsigned long allocs;
+	long long cycles; // -1 if there is no cycle counter
+
+	struct timespec start;
+	unsigned long startAllocs;
+};
+
+static unsigned long MCS_allocs = 0;
+static int MCS_cycleCounter = -1;
+static volatile unsigned long MCS_sink; // results of the benchmarked calls
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+// the workers allocate in threads of their own
+void* __wrap_malloc(size_t size) {
+	__atomic_fetch_add(&MCS_allocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+	__atomic_fetch_add(&MCS_allocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+	__atomic_fetch_add(&MCS_allocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+static void MCS_openCycleCounter() {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+	attr.exclude_hv = 1;
+
+	// count the kernel too (spawn, readdir) if we are allowed to
+	MCS_cycleCounter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+	if (MCS_cycleCounter < 0) {
+		attr.exclude_kernel = 1;
+		MCS_cycleCounter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+}
+
+static void MCS_initBench(struct MCS_Bench* bench, char* name) {
+	memset(bench, 0, sizeof(struct MCS_Bench));
+	bench->name = name;
+	bench->cycles = MCS_cycleCounter < 0 ? -1 : 0;
+}
+
+// start and stop may be called several times per benchmark, only the time
+// in between is measured
+static void MCS_startBench(struct MCS_Bench* bench) {
+	if (MCS_cycleCounter >= 0) {
+		ioctl(MCS_cycleCounter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(MCS_cycleCounter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	bench->startAllocs = __atomic_load_n(&MCS_allocs, __ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &bench->start);
+}
+
+static void MCS_stopBench(struct MCS_Bench* bench, long iterations) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	bench->allocs += __atomic_load_n(&MCS_allocs, __ATOMIC_RELAXED)
+			- bench->startAllocs;
+
+	if (MCS_cycleCounter >= 0) {
+		long long cycles = 0;
+
+		ioctl(MCS_cycleCounter, PERF_EVENT_IOC_DISABLE, 0);
+
+		if (read(MCS_cycleCounter, &cycles, sizeof(cycles)) == sizeof(cycles))
+			bench->cycles += cycles;
+	}
+
+	bench->time += (end.tv_sec - bench->start.tv_sec) * 1000000000LL
+			+ (end.tv_nsec - bench->start.tv_nsec);
+	bench->iterations += iterations;
+}
+
+static void MCS_printBench(FILE* out, struct MCS_Bench* bench, int json,
+		int first) {
+	double n = bench->iterations > 0 ? bench->iterations : 1;
+
+	if (json) {
+		fprintf(out, "%s\n\t\t{\"name\": \"%s\", \"iterations\": %ld, "
+				"\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+				"\"cycles_per_op\": ", first ? "" : ",", bench->name,
+				bench->iterations, bench->time / n, bench->allocs / n);
+
+		if (bench->cycles < 0) {
+			fprintf(out, "null}");
+		} else {
+			fprintf(out, "%.1f}", bench->cycles / n);
+		}
+	} else {
+		fprintf(out, "%-20s %10ld %12.1f %10.2f ", bench->name,
+				bench->iterations, bench->time / n, bench->allocs / n);
+
+		if (bench->cycles < 0) {
+			fprintf(out, "%12s\n", "-");
+		} else {
+			fprintf(out, "%12.1f\n", bench->cycles / n);
+		}
+	}
+}
+
+// the fixture is a directory per artist with the tracks of an album
+static void MCS_getFixturePath(char* path, int size, int dir, int file) {
+	if (file < 0) {
+		snprintf(path, size, "artist_%02d", dir);
+	} else {
+		// every tenth file is not a playable item
+		snprintf(path, size, "artist_%02d/album_title_track_%03d.%s", dir,
+				file, file % 10 == 0 ? "txt" : "mp3");
+	}
+}
+
+static int MCS_createFixture(int dirfd) {
+	char path[64];
+
+	int i, j;
+	for (i = 0; i < MCS_BENCH_DIRS; i++) {
+		MCS_getFixturePath(path, sizeof(path), i, -1);
+
+		if (mkdirat(dirfd, path, 0755) < 0)
+			return -1;
+
+		for (j = 0; j < MCS_BENCH_FILES; j++) {
+			MCS_getFixturePath(path, sizeof(path), i, j);
+
+			int fd = openat(dirfd, path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+			if (fd < 0)
+				return -1;
+
+			if (j % 10 != 0 && write(fd, MCS_benchTag,
+					sizeof(MCS_benchTag) - 1) < 0) {
+				close(fd);
+				return -1;
+			}
+
+			close(fd);
+		}
+	}
+
+	return 0;
+}
+
+static void MCS_removeFixture(int dirfd) {
+	char path[64];
+
+	int i, j;
+	for (i = 0; i < MCS_BENCH_DIRS; i++) {
+		for (j = 0; j < MCS_BENCH_FILES; j++) {
+			MCS_getFixturePath(path, sizeof(path), i, j);
+			unlinkat(dirfd, path, 0);
+		}
+
+		MCS_getFixturePath(path, sizeof(path), i, -1);
+		unlinkat(dirfd, path, AT_REMOVEDIR);
+	}
+}
+
+static void* MCS_runBenchServer(void* arg) {
+	struct MCS_BenchServer* server = (struct MCS_BenchServer*) arg;
+
+	while (!server->stop) {
+		struct pollfd fd = { server->listenSocket, POLLIN, 0 };
+
+		if (poll(&fd, 1, 100) > 0)
+			MCS_acceptClient(server->mcc, server->listenSocket);
+	}
+
+	return NULL;
+}
+
+// connects to the address, sends the request and reads the response
+static int MCS_requestBench(struct sockaddr_storage* storage, socklen_t len,
+		char* request) {
+	char response[4096];
+	int clientSocket = socket(storage->ss_family, SOCK_STREAM, 0);
+	int n = strlen(request);
+
+	if (connect(clientSocket, (struct sockaddr*) storage, len) < 0
+			|| write(clientSocket, request, n) != n) {
+		close(clientSocket);
+		return -1;
+	}
+
+	while (read(clientSocket, response, sizeof(response)) > 0);
+
+	close(clientSocket);
+	return 0;
+}
+
+static void* MCS_runBenchClient(void* arg) {
+	struct MCS_BenchClient* client = (struct MCS_BenchClient*) arg;
+
+	long i;
+	for (i = 0; i < client->iterations; i++) {
+		if (MCS_requestBench(client->storage, client->len,
+				client->request) < 0)
+			break;
+	}
+
+	client->iterations = i;
+	return NULL;
+}
+
+// federation: the list of a node is fetched by an aggregator (fed_refresh,
+// per list), and INFO of an item is sent to the node directly (fed_direct)
+// and through the aggregator (fed_proxy), the difference is the cost of the
+// hop. the node serves the fixture in a thread
+static void MCS_benchFederation(struct MCS_Bench* benches,
+		struct MCS_Context* mcc) {
+	struct MCS_BenchServer server;
+	memset(&server, 0, sizeof(server));
+	server.mcc = mcc;
+	server.listenSocket = MCS_openListener("127.0.0.1", 0, MCS_BACKLOG, 0);
+
+	if (server.listenSocket < 0)
+		return;
+
+	struct sockaddr_storage storage;
+	socklen_t len = sizeof(storage);
+	getsockname(server.listenSocket, (struct sockaddr*) &storage, &len);
+
+	if (pthread_create(&server.thread, NULL, MCS_runBenchServer,
+			&server) != 0) {
+		close(server.listenSocket);
+		return;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s127.0.0.1:%d", MCS_NODE_PREFIX,
+			ntohs(((struct sockaddr_in*) &storage)->sin_port));
+
+	char* dirs[] = { name };
+	struct MCS_Context* agg = MCS_createContext();
+	agg->dirs = dirs;
+	agg->numDirs = 1;
+
+	MCS_parseDirs(agg);
+
+	struct MCS_Node* node = &agg->nodes[0];
+
+	const long N = 20;
+
+	long i;
+	for (i = 0; i < N; i++) {
+		node->version = 0;
+		node->statTag[0] = '\0';
+
+		// the check and the pages of the list are driven like in the main
+		// loop
+		MCS_startBench(&benches[0]);
+		int r = MCS_refreshNode(agg, node);
+
+		while (r == 0 && node->check.fd >= 0) {
+			struct pollfd fds[3];
+			int numFds = MCS_pollNodes(agg, fds);
+
+			poll(fds, numFds, MCS_handleNodeTimeouts(agg));
+			MCS_handleNodeEvents(agg, fds, numFds);
+		}
+
+		MCS_stopBench(&benches[0], 1);
+
+		if (r < 0 || node->version == 0 || agg->size == 0)
+			break;
+	}
+
+	int aggSocket = MCS_openListener("127.0.0.1", 0, MCS_BACKLOG, 0);
+	struct sockaddr_storage aggStorage;
+	socklen_t aggLen = sizeof(aggStorage);
+	getsockname(aggSocket, (struct sockaddr*) &aggStorage, &aggLen);
+
+	const long M = 2000;
+
+	for (i = 0; i < M && aggSocket >= 0 && agg->size > 0; i++) {
+		// the same item, one of the tagged MP3 files
+		struct MCS_Item* item = agg->items[1];
+		char request[64];
+
+		snprintf(request, sizeof(request), "INFO %u",
+				((struct MCS_NodeItem*) item)->remoteID);
+
+		MCS_startBench(&benches[1]);
+
+		if (MCS_requestBench(&storage, len, request) < 0)
+			break;
+
+		MCS_stopBench(&benches[1], 1);
+
+		snprintf(request, sizeof(request), "INFO %u", item->id);
+
+		// the aggregator runs in this thread, the connection is queued by
+		// the backlog until it is accepted
+		MCS_startBench(&benches[2]);
+
+		int clientSocket = socket(aggStorage.ss_family, SOCK_STREAM, 0);
+		int n = strlen(request);
+		char response[4096];
+
+		if (connect(clientSocket, (struct sockaddr*) &aggStorage, aggLen) < 0
+				|| write(clientSocket, request, n) != n
+				|| MCS_acceptClient(agg, aggSocket) < 0) {
+			close(clientSocket);
+			break;
+		}
+
+		while (read(clientSocket, response, sizeof(response)) > 0);
+
+		close(clientSocket);
+		MCS_stopBench(&benches[2], 1);
+	}
+
+	if (aggSocket >= 0)
+		close(aggSocket);
+
+	server.stop = 1;
+	pthread_join(server.thread, NULL);
+	close(server.listenSocket);
+
+	// the dirs are not owned by the context
+	MCS_closeNodes(agg);
+	agg->dirs = NULL;
+	MCS_freeContext(agg);
+}
+
+static void MCS_benchHash(struct MCS_Bench* bench) {
+	char* msg = "1234567/artist_name_album_title_track_12.mp3";
+	int len = strlen(msg);
+	const long N = 1000000;
+
+	MCS_startBench(bench);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_sink += sax_hash(msg, len, MCS_HASH_SIZE);
+	}
+
+	MCS_stopBench(bench, N);
+}
+
+static void MCS_benchItemType(struct MCS_Bench* bench) {
+	char* filenames[] = { "track.mp3", "track.flac", "movie.mkv",
+			"game.nes", "notes.txt", "README" };
+	const long N = 1000000;
+
+	MCS_startBench(bench);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_sink += MCS_getItemType(filenames[i % 6]);
+	}
+
+	MCS_stopBench(bench, N);
+}
+
+static void MCS_benchLog(struct MCS_Bench* bench) {
+	// bursts that fit into the ring, the log thread drains it in between
+	const long N = MCS_LOG_RECORDS / 2;
+	char* request = "LIST 100 0 50 ENC=BIN";
+
+	int round;
+	for (round = 0; round < 100; round++) {
+		MCS_startBench(bench);
+
+		long i;
+		for (i = 0; i < N; i++) {
+			MCS_log(MCS_LOG_INFO, "%s (%d)\n", request, 21);
+		}
+
+		MCS_stopBench(bench, N);
+
+		struct timespec delay = { 0, 2 * MCS_LOG_INTERVAL * 1000000L };
+		nanosleep(&delay, NULL);
+	}
+}
+
+static void MCS_benchLookup(struct MCS_Bench* bench,
+		struct MCS_Context* mcc) {
+	const long N = 10000;
+
+	MCS_startBench(bench);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		// spread over the whole list
+		unsigned int itemID = mcc->items[(i * 7919) % mcc->size]->id;
+		MCS_sink += (unsigned long) MCS_lookupItem(mcc->items, mcc->size,
+				itemID);
+	}
+
+	MCS_stopBench(bench, N);
+}
+
+// the whole library as a local client reads it, from the library map (per
+// read of all items, validated by the seqlock) and with LIST in pages of
+// 100 items over the Unix domain socket (per page). publishMap is the cost
+// of the server per change of the list
+static void MCS_benchMap(struct MCS_Bench* benches, struct MCS_Context* mcc,
+		char* path, char* address) {
+	if (MCS_openMap(mcc, path) < 0)
+		return;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		MCS_closeMap(mcc);
+		return;
+	}
+
+	char* map = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		MCS_closeMap(mcc);
+		return;
+	}
+
+	struct MCS_MapHeader* header = (struct MCS_MapHeader*) map;
+	const long N = 1000;
+
+	MCS_startBench(&benches[0]);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		unsigned int seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+
+		struct MCS_MapItem* items = (struct MCS_MapItem*) (map
+				+ header->itemsOffset);
+		char* labels = map + header->labelsOffset;
+
+		unsigned int j;
+		for (j = 0; j < header->numItems; j++) {
+			MCS_sink += items[j].id + labels[items[j].label];
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&header->seq, __ATOMIC_RELAXED) != seq)
+			break;
+	}
+
+	MCS_stopBench(&benches[0], i);
+
+	const long P = 200;
+
+	MCS_startBench(&benches[2]);
+
+	for (i = 0; i < P; i++) {
+		MCS_publishMap(mcc);
+	}
+
+	MCS_stopBench(&benches[2], P);
+
+	munmap(map, st.st_size);
+	MCS_closeMap(mcc);
+
+	int listenSocket = MCS_openListener(address, 0, MCS_BACKLOG, 0);
+
+	if (listenSocket < 0)
+		return;
+
+	struct sockaddr_storage storage;
+	socklen_t len = sizeof(storage);
+	getsockname(listenSocket, (struct sockaddr*) &storage, &len);
+
+	const long M = 5;
+	char response[4096];
+
+	for (i = 0; i < M; i++) {
+		int offset;
+		for (offset = 0; offset < mcc->size; offset += 100) {
+			char request[64];
+			snprintf(request, sizeof(request), "LIST 0 %d 100", offset);
+
+			int clientSocket = socket(storage.ss_family, SOCK_STREAM, 0);
+			int n = strlen(request);
+
+			MCS_startBench(&benches[1]);
+
+			if (connect(clientSocket, (struct sockaddr*) &storage, len) < 0
+					|| write(clientSocket, request, n) != n
+					|| MCS_acceptClient(mcc, listenSocket) < 0) {
+				close(clientSocket);
+				break;
+			}
+
+			while (read(clientSocket, response, sizeof(response)) > 0);
+
+			MCS_stopBench(&benches[1], 1);
+			close(clientSocket);
+		}
+	}
+
+	close(listenSocket);
+	unlink(address + 5);
+}
+
+static void MCS_benchParseDirs(struct MCS_Bench* bench,
+		struct MCS_Context* mcc) {
+	const long N = 20;
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_freeItems(mcc->items, mcc->capacity);
+		MCS_freeDirNodes(mcc->dirNodes, mcc->numDirNodes);
+
+		MCS_startBench(bench);
+		MCS_parseDirs(mcc);
+		MCS_stopBench(bench, 1);
+	}
+}
+
+static void MCS_benchPlayItem(struct MCS_Bench* bench,
+		struct MCS_Context* mcc) {
+	const long N = 200;
+
+	// replace the players with a stub that exits right away
+	struct MCS_Player* players = mcc->players;
+	int numPlayers = mcc->numPlayers;
+
+	struct MCS_Player stub;
+
+	if (MCS_parsePlayer(&stub, 0, MCS_BENCH_STUB) < 0)
+		return;
+
+	mcc->players = &stub;
+	mcc->numPlayers = 1;
+
+	struct MCS_Session* session = MCS_getSession(mcc, MCS_SESSION_DEFAULT, 0);
+	struct pollfd fd = { mcc->sigfd, POLLIN, 0 };
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_startBench(bench);
+		int r = MCS_handlePlayItem(mcc, session, mcc->items[i % mcc->size]);
+		MCS_stopBench(bench, 1);
+
+		if (r != MCS_ERR_OK)
+			break;
+
+		// reap the child before the next item is played
+		while (session->child != 0 && poll(&fd, 1, 1000) > 0) {
+			MCS_handleChildExit(mcc);
+		}
+	}
+
+	mcc->players = players;
+	mcc->numPlayers = numPlayers;
+	MCS_freePlayer(&stub);
+}
+
+// the copy of the item list that the workers read, per change of the list
+static void MCS_benchPublishSnapshot(struct MCS_Bench* bench,
+		struct MCS_Context* mcc) {
+	const long N = 200;
+
+	MCS_startBench(bench);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_publishSnapshot(mcc);
+	}
+
+	MCS_stopBench(bench, N);
+}
+
+// a round trip of STAT through an endpoint: connect, request, accept and
+// dispatch, read the response. client and server run in the same thread,
+// the connection is queued by the backlog until it is accepted
+static void MCS_benchRequest(struct MCS_Bench* bench, struct MCS_Context* mcc,
+		char* address) {
+	const long N = 2000;
+
+	int listenSocket = MCS_openListener(address, 0, MCS_BACKLOG, 0);
+
+	if (listenSocket < 0)
+		return;
+
+	struct sockaddr_storage storage;
+	socklen_t len = sizeof(storage);
+	getsockname(listenSocket, (struct sockaddr*) &storage, &len);
+
+	char response[4096];
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_startBench(bench);
+
+		int clientSocket = socket(storage.ss_family, SOCK_STREAM, 0);
+
+		if (connect(clientSocket, (struct sockaddr*) &storage, len) < 0
+				|| write(clientSocket, "STAT", 4) != 4
+				|| MCS_acceptClient(mcc, listenSocket) < 0) {
+			close(clientSocket);
+			break;
+		}
+
+		while (read(clientSocket, response, sizeof(response)) > 0);
+
+		close(clientSocket);
+		MCS_stopBench(bench, 1);
+	}
+
+	close(listenSocket);
+
+	if (strncmp(address, "unix:", 5) == 0) {
+		unlink(address + 5);
+	}
+}
+
+static void MCS_benchSendItems(struct MCS_Bench* bench,
+		struct MCS_Context* mcc, int encoding) {
+	const long N = 10000;
+
+	struct MCS_Request req;
+	memset(&req, 0, sizeof(req));
+	req.clientSocket = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	req.encoding = encoding;
+	req.compression = MCS_ZIP_NONE;
+	req.zip = mcc->zip;
+
+	MCS_startBench(bench);
+
+	long i;
+	for (i = 0; i < N; i++) {
+		MCS_sink += MCS_sendItems(mcc->snapshot, 0,
+				(i * 100) % (mcc->size - 100), 100, &req);
+	}
+
+	MCS_stopBench(bench, N);
+
+	close(req.clientSocket);
+}
+
+// the throughput of the workers: MCS_BENCH_CLIENTS threads send the request
+// over TCP at the same time, the time is per request. the workers accept on
+// the endpoints of the server (MCS_openListeners) on a port chosen by the
+// kernel. the cycles of the other threads are not counted
+static void MCS_benchWorkers(struct MCS_Bench* bench, struct MCS_Context* mcc,
+		int numWorkers, char* request) {
+	const long N = 4000;
+
+	int port = mcc->port;
+	mcc->port = 0;
+
+	int numOpen = MCS_openListeners(mcc, 1);
+	mcc->port = port;
+
+	if (numOpen == 0 || mcc->listeners[0] < 0) {
+		MCS_closeListeners(mcc);
+		return;
+	}
+
+	struct sockaddr_storage storage;
+	socklen_t len = sizeof(storage);
+	getsockname(mcc->listeners[0], (struct sockaddr*) &storage, &len);
+	((struct sockaddr_in*) &storage)->sin_addr.s_addr = htonl(
+			INADDR_LOOPBACK);
+
+	MCS_publishStatus(mcc);
+
+	if (MCS_startWorkers(mcc, numWorkers) < 0) {
+		MCS_closeListeners(mcc);
+		return;
+	}
+
+	struct MCS_BenchClient clients[MCS_BENCH_CLIENTS];
+
+	MCS_startBench(bench);
+
+	int numStarted;
+	for (numStarted = 0; numStarted < MCS_BENCH_CLIENTS; numStarted++) {
+		struct MCS_BenchClient* client = &clients[numStarted];
+
+		client->storage = &storage;
+		client->len = len;
+		client->request = request;
+		client->iterations = N / MCS_BENCH_CLIENTS;
+
+		if (pthread_create(&client->thread, NULL, MCS_runBenchClient,
+				client) != 0)
+			break;
+	}
+
+	long iterations = 0;
+
+	int i;
+	for (i = 0; i < numStarted; i++) {
+		pthread_join(clients[i].thread, NULL);
+		iterations += clients[i].iterations;
+	}
+
+	MCS_stopBench(bench, iterations);
+	bench->cycles = -1;
+
+	MCS_stopWorkers(mcc);
+	MCS_closeListeners(mcc);
+}
+
+int main(int argc, char* argv[]) {
+	int json = 0;
+	char* fixture = NULL;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = 1;
+		} else if (argv[i][0] != '-') {
+			fixture = argv[i];
+		} else {
+			printf("usage: %s [--json] [fixture directory]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// the fixture is created on tmpfs so that the scan measures the server
+	// and not the drive
+	char dirpath[MCS_PATH_SIZE];
+	snprintf(dirpath, sizeof(dirpath), "%s/mcs-bench.XXXXXX",
+			fixture != NULL ? fixture : "/dev/shm");
+
+	int dirfd = -1;
+
+	if (mkdtemp(dirpath) != NULL) {
+		dirfd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	}
+
+	if (dirfd < 0 || MCS_createFixture(dirfd) < 0) {
+		printf("Can't create the fixture in %s\n", dirpath);
+		return 1;
+	}
+
+	// the server reports through its log, keep the results apart from that
+	FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+	freopen("/dev/null", "w", stdout);
+	MCS_startLog();
+
+	struct MCS_Context* mcc = MCS_createContext();
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	mcc->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	char* dirs[] = { dirpath };
+	mcc->dirs = dirs;
+	mcc->numDirs = 1;
+
+	MCS_parseDirs(mcc);
+	MCS_openCycleCounter();
+
+	char unixAddress[MCS_PATH_SIZE + 16];
+	snprintf(unixAddress, sizeof(unixAddress), "unix:%s.sock", dirpath);
+
+	char mapPath[MCS_PATH_SIZE + 16];
+	snprintf(mapPath, sizeof(mapPath), "%s.map", dirpath);
+
+	struct MCS_Bench benches[21];
+	MCS_initBench(&benches[0], "sax_hash");
+	MCS_initBench(&benches[1], "getItemType");
+	MCS_initBench(&benches[2], "lookupItem");
+	MCS_initBench(&benches[3], "sendItems_xml");
+	MCS_initBench(&benches[4], "sendItems_bin");
+	MCS_initBench(&benches[5], "parseDirs");
+	MCS_initBench(&benches[6], "handlePlayItem");
+	MCS_initBench(&benches[7], "request_tcp");
+	MCS_initBench(&benches[8], "request_unix");
+	MCS_initBench(&benches[9], "log");
+	MCS_initBench(&benches[10], "fed_refresh");
+	MCS_initBench(&benches[11], "fed_direct");
+	MCS_initBench(&benches[12], "fed_proxy");
+	MCS_initBench(&benches[13], "publishSnapshot");
+	MCS_initBench(&benches[14], "list_workers_1");
+	MCS_initBench(&benches[15], "list_workers_4");
+	MCS_initBench(&benches[16], "stat_workers_1");
+	MCS_initBench(&benches[17], "stat_workers_4");
+	MCS_initBench(&benches[18], "map_read");
+	MCS_initBench(&benches[19], "list_page_unix");
+	MCS_initBench(&benches[20], "publishMap");
+
+	MCS_benchHash(&benches[0]);
+	MCS_benchItemType(&benches[1]);
+	MCS_benchLookup(&benches[2], mcc);
+	MCS_benchSendItems(&benches[3], mcc, MCS_ENC_XML);
+	MCS_benchSendItems(&benches[4], mcc, MCS_ENC_BIN);
+	MCS_benchParseDirs(&benches[5], mcc);
+	MCS_benchPlayItem(&benches[6], mcc);
+	MCS_benchRequest(&benches[7], mcc, "127.0.0.1");
+	MCS_benchRequest(&benches[8], mcc, unixAddress);
+	MCS_benchLog(&benches[9]);
+	MCS_benchFederation(&benches[10], mcc);
+	MCS_benchPublishSnapshot(&benches[13], mcc);
+	MCS_benchWorkers(&benches[14], mcc, 1, "LIST 0 0 100");
+	MCS_benchWorkers(&benches[15], mcc, 4, "LIST 0 0 100");
+	MCS_benchWorkers(&benches[16], mcc, 1, "STAT");
+	MCS_benchWorkers(&benches[17], mcc, 4, "STAT");
+	MCS_benchMap(&benches[18], mcc, mapPath, unixAddress);
+
+	if (json) {
+		fprintf(out, "{\n\t\"items\": %d,\n\t\"benchmarks\": [", mcc->size);
+	} else {
+		fprintf(out, "%d items in %s\n", mcc->size, dirpath);
+		fprintf(out, "%-20s %10s %12s %10s %12s\n", "benchmark",
+				"iterations", "ns/op", "allocs/op", "cycles/op");
+	}
+
+	for (i = 0; i < 21; i++) {
+		MCS_printBench(out, &benches[i], json, i == 0);
+	}
+
+	if (json) {
+		fprintf(out, "\n\t]\n}\n");
+	}
+
+	fclose(out);
+
+	// the dirs are not owned by the context
+	mcc->dirs = NULL;
+	MCS_stopSessions(mcc);
+	close(mcc->sigfd);
+	MCS_freeContext(mcc);
+
+	MCS_removeFixture(dirfd);
+	close(dirfd);
+	rmdir(dirpath);
+
+	return 0;
+}
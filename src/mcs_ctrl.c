@@ -0,0 +1,314 @@
+#include "mcs_ctrl.h"
+#include "mcs_daemon.h"
+#include "mcs_fed.h"
+#include "mcs_log.h"
+#include "mcs_session.h"
+
+// keys that can be used by name in a key sequence
+static const struct {
+	char* name;
+	char* key;
+} MCS_keyNames[] = {
+	{ "space", " " },
+	{ "enter", "\n" },
+	{ "tab", "\t" },
+	{ "esc", "\x1b" },
+	{ "up", "\x1b[A" },
+	{ "down", "\x1b[B" },
+	{ "right", "\x1b[C" },
+	{ "left", "\x1b[D" }
+};
+
+#define MCS_NUM_KEY_NAMES (sizeof(MCS_keyNames) / sizeof(MCS_keyNames[0]))
+
+// returns 1 if the string only consists of options (KEY=VALUE)
+static int MCS_isOptions(char* p) {
+	while (*p != '\0') {
+		while (*p == ' ')
+			p++;
+
+		if (*p == '\0')
+			break;
+
+		int len = strcspn(p, " ");
+		char* eq = memchr(p, '=', len);
+
+		if (eq == NULL || eq == p)
+			return 0;
+
+		p += len;
+	}
+
+	return 1;
+}
+
+int MCS_handleCtrl(struct MCS_Context* mcc, struct MCS_Request* req,
+		char* buffer, int len) {
+	struct MCS_Keys keys;
+	memset(&keys, 0, sizeof(keys));
+
+	// "CTRL c" with a single character, which may also be a ' ', is sent as
+	// it is. everything else is a key sequence
+	if (len == 6 || (buffer[6] == ' ' && MCS_isOptions(buffer + 7))) {
+		keys.keys[0] = buffer[5];
+		keys.numKeys = 1;
+
+		MCS_parseOptions(req, buffer + 6);
+	} else {
+		if (MCS_parseKeys(&keys, buffer + 5) < 0)
+			return MCS_ERR_BAD_PARAMS;
+
+		MCS_parseOptions(req, buffer + 5);
+	}
+
+	struct MCS_Session* session = MCS_getSession(mcc, req->session, 0);
+
+	if (session == NULL)
+		return MCS_ERR_NOT_FOUND;
+
+	// the item plays on another server, it gets the command as it is. the
+	// key is queued for the node, its answer is not waited for
+	if (session->node != NULL)
+		return MCS_queueNodeCommand(session->node, buffer);
+
+	if (session->wpipe == 0)
+		return MCS_ERR_SERVER_ERROR;
+
+	// a new command replaces the keys that are still waiting for their
+	// delay, i.e. when a remote key is released
+	session->keys = keys;
+	session->keyPos = 0;
+	session->keyStalled = 0;
+
+	if (MCS_sendKeys(session) < 0)
+		return MCS_ERR_SERVER_ERROR;
+
+	return MCS_ERR_OK;
+}
+
+void MCS_handleDatagram(struct MCS_Context* mcc, int udpSocket) {
+	const int SIZE = 128;
+	char buffer[SIZE + 1];
+
+	struct sockaddr_storage clientAddress;
+	socklen_t clen = sizeof(clientAddress);
+
+	int len = recvfrom(udpSocket, buffer, SIZE, 0,
+			(struct sockaddr*) &clientAddress, &clen);
+
+	if (len <= 0)
+		return;
+
+	buffer[len] = '\0';
+
+	struct MCS_Request req;
+	memset(&req, 0, sizeof(req));
+	req.clientSocket = -1;
+
+	// only key events are accepted without a connection, they need no
+	// authentication, like CTRL over TCP
+	int statusCode;
+
+	if (strncmp("CTRL ", buffer, 5) == 0 && len > 5) {
+		statusCode = MCS_handleCtrl(mcc, &req, buffer, len);
+	} else {
+		statusCode = MCS_ERR_BAD_REQUEST;
+	}
+
+	// the reply is optional for the client, a lost datagram is not an error
+	if (MCS_formatStatus(buffer, statusCode)) {
+		sendto(udpSocket, buffer, strlen(buffer), MSG_DONTWAIT,
+				(struct sockaddr*) &clientAddress, clen);
+	}
+}
+
+int MCS_handleKeyTimeouts(struct MCS_Context* mcc) {
+	long long now = MCS_getTime();
+	long long next = -1;
+
+	int i;
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+
+		if (session->keyPos >= session->keys.numKeys)
+			continue;
+
+		if (session->keyDeadline <= now && MCS_sendKeys(session) < 0)
+			continue;
+
+		if (session->keyPos < session->keys.numKeys
+				&& (next < 0 || session->keyDeadline < next))
+			next = session->keyDeadline;
+	}
+
+	// poll timeout in ms until the next keys are due
+	if (next < 0)
+		return -1;
+
+	return next <= now ? 0 : (int) ((next - now + 999) / 1000);
+}
+
+// a key sequence consists of space separated keys:
+//     key[*count][@delay]
+// key is a single character, a name (see MCS_keyNames) or a hex value
+// (0x1b). the key is repeated count times and delay ms are waited after
+// every repetition. tokens with a '=' are options and skipped
+int MCS_parseKeys(struct MCS_Keys* keys, char* seq) {
+	keys->numKeys = 0;
+
+	char* p = seq;
+
+	while (*p != '\0') {
+		while (*p == ' ')
+			p++;
+
+		if (*p == '\0')
+			break;
+
+		int tlen = strcspn(p, " ");
+		char* tend = p + tlen;
+
+		char* eq = memchr(p, '=', tlen);
+
+		if (eq != NULL && eq != p) {
+			p = tend;
+			continue;
+		}
+
+		// the key ends at the first modifier, the first character is always
+		// part of the key
+		int klen = 1 + strcspn(p + 1, "*@ ");
+
+		if (klen > tlen)
+			klen = tlen;
+
+		char key[8];
+		int keylen = 0;
+
+		if (klen == 1) {
+			key[0] = *p;
+			keylen = 1;
+		} else if (klen > 2 && p[0] == '0' && p[1] == 'x') {
+			key[0] = strtol(p + 2, NULL, 16);
+			keylen = 1;
+		} else {
+			int i;
+			for (i = 0; i < MCS_NUM_KEY_NAMES; i++) {
+				if (strlen(MCS_keyNames[i].name) == klen
+						&& strncmp(MCS_keyNames[i].name, p, klen) == 0) {
+					keylen = strlen(MCS_keyNames[i].key);
+					memcpy(key, MCS_keyNames[i].key, keylen);
+					break;
+				}
+			}
+
+			if (keylen == 0)
+				return -1;
+		}
+
+		int count = 1;
+		int delay = 0;
+		char* m = p + klen;
+
+		while (m < tend) {
+			char* end;
+			long v = strtol(m + 1, &end, 10);
+
+			if (end == m + 1 || end > tend)
+				return -1;
+
+			if (*m == '*') {
+				count = v;
+			} else if (*m == '@') {
+				delay = v;
+			} else {
+				return -1;
+			}
+
+			m = end;
+		}
+
+		if (count < 1 || delay < 0 || delay > MCS_CTRL_MAX_DELAY)
+			return -1;
+
+		int i;
+		for (i = 0; i < count; i++) {
+			if (keys->numKeys + keylen > MCS_CTRL_MAX_KEYS)
+				return -1;
+
+			memcpy(keys->keys + keys->numKeys, key, keylen);
+			memset(keys->delays + keys->numKeys, 0, keylen * sizeof(int));
+			keys->numKeys += keylen;
+			keys->delays[keys->numKeys - 1] = delay;
+		}
+
+		p = tend;
+	}
+
+	return keys->numKeys > 0 ? 0 : -1;
+}
+
+int MCS_sendKeys(struct MCS_Session* session) {
+	struct MCS_Keys* keys = &session->keys;
+
+	if (session->wpipe == 0) {
+		keys->numKeys = 0;
+		return -1;
+	}
+
+	// all keys up to the next delay are written in one operation
+	int start = session->keyPos;
+	int end = start;
+
+	while (end < keys->numKeys && keys->delays[end] == 0)
+		end++;
+
+	if (end < keys->numKeys)
+		end++; // the key with the delay
+
+	// a persistent player gets the commands of the keys. the pipe is
+	// non-blocking, r is the number of keys written
+	int r;
+
+	if (session->daemon != NULL) {
+		r = MCS_sendDaemonKeys(session->daemon, keys->keys + start,
+				end - start);
+	} else {
+		r = write(session->wpipe, keys->keys + start, end - start);
+
+		if (r < 0 && errno == EAGAIN)
+			r = 0;
+	}
+
+	if (r < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendKeys: Could not write to child pipe\n");
+		keys->numKeys = 0;
+		return -1;
+	}
+
+	long long now = MCS_getTime();
+	session->keyPos = start + r;
+
+	// the pipe is full, the rest is written once the child has read
+	if (session->keyPos < end) {
+		if (session->keyStalled == 0) {
+			session->keyStalled = now;
+		} else if (now - session->keyStalled
+				> MCS_CTRL_MAX_DELAY * 1000LL) {
+			MCS_log(MCS_LOG_ERROR, "MCS_sendKeys: Child does not read its "
+					"pipe, %d keys dropped\n", keys->numKeys - session->keyPos);
+			keys->numKeys = 0;
+			return -1;
+		}
+
+		session->keyDeadline = now + MCS_CTRL_RETRY * 1000LL;
+		return 0;
+	}
+
+	session->keyStalled = 0;
+
+	if (end < keys->numKeys)
+		session->keyDeadline = now + keys->delays[end - 1] * 1000LL;
+
+	return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef MCS_CTRL_H
+#define MCS_CTRL_H
+
+#include "mcs.h"
+
+int MCS_handleCtrl(struct MCS_Context* mcc, struct MCS_Request* req,
+		char* buffer, int len);
+void MCS_handleDatagram(struct MCS_Context* mcc, int udpSocket);
+int MCS_handleKeyTimeouts(struct MCS_Context* mcc);
+int MCS_parseKeys(struct MCS_Keys* keys, char* seq);
+int MCS_sendKeys(struct MCS_Session* session);
+
+#endif
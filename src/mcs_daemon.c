@@ -0,0 +1,433 @@
+#include "mcs_daemon.h"
+#include "mcs_log.h"
+#include "mcs_session.h"
+#include "mcs_spawn.h"
+#include "mcs_tree.h"
+
+#include <pthread.h> // pthread_sigmask
+
+// persistent players. a player is started by the first item of its type in
+// a session and keeps running, the items are loaded with a command on its
+// STDIN. STOP and CTRL are commands as well. the end of an item is a line
+// on STDOUT, if the player exits the item ends too and the next item of
+// the type starts a new player
+
+#ifdef MCS_DAEMON_AUDIO
+// mpg123 -R, keys that have no command are ignored
+static const struct MCS_DaemonKey MCS_mpg123Keys[] = {
+	{ ' ', "PAUSE\n" },
+	{ 'p', "PAUSE\n" },
+	{ 'q', "STOP\n" },
+	{ 0, NULL }
+};
+#endif
+
+// terminated by type 0
+static const struct MCS_DaemonCommand MCS_daemonCommands[] = {
+#ifdef MCS_DAEMON_AUDIO
+	{ MCS_TYPE_AUDIO, MCS_DAEMON_AUDIO_EXT, MCS_DAEMON_AUDIO, "LOAD %s\n",
+			"@P 2", "@E", "STOP\n", "@P 0", MCS_mpg123Keys },
+#endif
+	{ 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+// returns 1 if the extension of the file is one of exts (":mp3:ogg:")
+static int MCS_hasExtension(const char* exts, char* filepath) {
+	char* p = strrchr(filepath, '.');
+
+	if (p == NULL || strchr(p, '/') != NULL)
+		return 0;
+
+	int extlen = strlen(p + 1);
+	char ext[extlen + 3];
+	snprintf(ext, sizeof(ext), ":%s:", p + 1);
+
+	return strstr(exts, ext) != NULL;
+}
+
+static int MCS_writeDaemon(struct MCS_Daemon* daemon, const char* command,
+		int len) {
+	// the player may have exited without being reaped yet, a write must
+	// not kill the server with SIGPIPE
+	sigset_t pipeMask;
+	sigset_t oldMask;
+	sigemptyset(&pipeMask);
+	sigaddset(&pipeMask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeMask, &oldMask);
+
+	int r = write(daemon->wpipe, command, len);
+	int error = errno;
+
+	if (r < 0 && errno == EPIPE) {
+		struct timespec zero = { 0, 0 };
+		sigtimedwait(&pipeMask, NULL, &zero);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+	// commands are shorter than PIPE_BUF, they are written whole or not at
+	// all. errno is EAGAIN if the pipe is full, the caller may retry
+	if (r != len) {
+		if (error != EAGAIN) {
+			MCS_log(MCS_LOG_ERROR, "MCS_writeDaemon: Could not write to "
+					"player %d\n", daemon->pid);
+		}
+
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+// the player could not load the item of the session, it is played with a
+// process of its own
+static void MCS_handleDaemonError(struct MCS_Context* mcc,
+		struct MCS_Daemon* daemon) {
+	struct MCS_Session* session = daemon->session;
+	struct MCS_Item* item = session->playingItem;
+	char filepath[MCS_PATH_SIZE];
+
+	MCS_log(MCS_LOG_WARN, "Player %d could not load item %u\n", daemon->pid,
+			item->id);
+
+	session->wpipe = 0;
+	session->child = 0;
+	session->daemon = NULL;
+	session->playingItem = NULL;
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) >= 0
+			&& MCS_spawnItem(mcc, session, item, filepath,
+					session->usage.started) == MCS_ERR_OK)
+		return;
+
+	// the item ends like an item the player failed to play
+	session->child = daemon->pid;
+	session->daemon = daemon;
+	session->playingItem = item;
+	MCS_handleItemEnd(mcc, session, 1);
+}
+
+static void MCS_handleDaemonLine(struct MCS_Context* mcc,
+		struct MCS_Daemon* daemon, char* line) {
+	const struct MCS_DaemonCommand* command = daemon->command;
+	struct MCS_Session* session = daemon->session;
+
+	// the lines before the answer to the last LOAD are of earlier items,
+	// i.e. the done line of an item that ended just before a STOP
+	if (daemon->loading > 0) {
+		int started = strncmp(line, command->started,
+				strlen(command->started)) == 0;
+		int error = strncmp(line, command->error,
+				strlen(command->error)) == 0;
+
+		if (!started && !error)
+			return;
+
+		daemon->loading--;
+
+		if (error && daemon->loading == 0 && session->daemon == daemon)
+			MCS_handleDaemonError(mcc, daemon);
+
+		return;
+	}
+
+	if (strncmp(line, command->done, strlen(command->done)) != 0)
+		return;
+
+	// items that were stopped by the server are not playing anymore
+	if (session->daemon == daemon)
+		MCS_handleItemEnd(mcc, session, 0);
+}
+
+struct MCS_Daemon* MCS_getDaemon(struct MCS_Context* mcc,
+		struct MCS_Session* session, int type, char* filepath) {
+	const struct MCS_DaemonCommand* command = MCS_daemonCommands;
+
+	while (command->type != 0 && (command->type != type
+			|| !MCS_hasExtension(command->ext, filepath))) {
+		command++;
+	}
+
+	if (command->type == 0)
+		return NULL;
+
+	struct MCS_Daemon* daemon = NULL;
+
+	int j;
+	for (j = 0; j < mcc->numDaemons; j++) {
+		if (mcc->daemons[j].session == session
+				&& mcc->daemons[j].type == type) {
+			daemon = &mcc->daemons[j];
+			break;
+		}
+	}
+
+	if (daemon == NULL) {
+		if (mcc->numDaemons == MCS_MAX_DAEMONS) {
+			MCS_log(MCS_LOG_ERROR, "MCS_getDaemon: Too many players\n");
+			return NULL;
+		}
+
+		daemon = &mcc->daemons[mcc->numDaemons++];
+		memset(daemon, 0, sizeof(struct MCS_Daemon));
+		daemon->type = type;
+		daemon->command = command;
+		daemon->session = session;
+		daemon->rpipe = -1;
+	}
+
+	// (re)start the player if it is not running. a player that is not
+	// installed would fail on every item
+	if (daemon->failed)
+		return NULL;
+
+	if (daemon->pid == 0 && MCS_startDaemon(mcc, daemon) < 0) {
+		MCS_log(MCS_LOG_WARN, "Persistent player of type %d disabled\n",
+				type);
+		daemon->failed = 1;
+		return NULL;
+	}
+
+	return daemon;
+}
+
+void MCS_handleDaemonExit(struct MCS_Context* mcc, struct MCS_Daemon* daemon,
+		int status) {
+	MCS_log(MCS_LOG_INFO, "Player %d exited. (status: %d exited: %s)\n",
+			daemon->pid, WEXITSTATUS(status),
+			WIFEXITED(status) ? "true" : "false");
+
+	close(daemon->wpipe);
+
+	if (daemon->rpipe >= 0)
+		close(daemon->rpipe);
+
+	daemon->pid = 0;
+	daemon->wpipe = 0;
+	daemon->rpipe = -1;
+	daemon->lineLen = 0;
+	daemon->loading = 0;
+
+	struct MCS_Session* session = daemon->session;
+
+	if (session->daemon == daemon)
+		MCS_handleItemEnd(mcc, session, WEXITSTATUS(status));
+}
+
+void MCS_handleDaemons(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds) {
+	int i, j;
+	for (i = 0; i < numFds; i++) {
+		if (fds[i].revents == 0)
+			continue;
+
+		struct MCS_Daemon* daemon = NULL;
+
+		for (j = 0; j < mcc->numDaemons; j++) {
+			if (mcc->daemons[j].pid != 0
+					&& mcc->daemons[j].rpipe == fds[i].fd) {
+				daemon = &mcc->daemons[j];
+				break;
+			}
+		}
+
+		if (daemon == NULL)
+			continue;
+
+		int len = read(daemon->rpipe, daemon->line + daemon->lineLen,
+				MCS_DAEMON_LINE - 1 - daemon->lineLen);
+
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+
+		// the player closed its STDOUT, the exit is reaped through SIGCHLD
+		if (len <= 0) {
+			close(daemon->rpipe);
+			daemon->rpipe = -1;
+			continue;
+		}
+
+		daemon->lineLen += len;
+		daemon->line[daemon->lineLen] = '\0';
+
+		char* line = daemon->line;
+		char* end;
+
+		while ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			MCS_handleDaemonLine(mcc, daemon, line);
+			line = end + 1;
+		}
+
+		// keep the incomplete line, a line that is too long is skipped
+		daemon->lineLen = daemon->line + daemon->lineLen - line;
+
+		if (daemon->lineLen == MCS_DAEMON_LINE - 1) {
+			daemon->lineLen = 0;
+		} else {
+			memmove(daemon->line, line, daemon->lineLen);
+		}
+	}
+}
+
+int MCS_loadDaemonItem(struct MCS_Daemon* daemon, char* filepath) {
+	char command[MCS_PATH_SIZE + 64];
+
+	// a line break would end the command early
+	if (strchr(filepath, '\n') != NULL)
+		return -1;
+
+	int len = snprintf(command, sizeof(command), daemon->command->load,
+			filepath);
+
+	if (len < 0 || len >= (int) sizeof(command))
+		return -1;
+
+	if (MCS_writeDaemon(daemon, command, len) < 0)
+		return -1;
+
+	daemon->loading++;
+	return 0;
+}
+
+struct MCS_Daemon* MCS_lookupDaemon(struct MCS_Context* mcc, pid_t pid) {
+	int i;
+	for (i = 0; i < mcc->numDaemons; i++) {
+		if (mcc->daemons[i].pid == pid)
+			return &mcc->daemons[i];
+	}
+
+	return NULL;
+}
+
+int MCS_pollDaemons(struct MCS_Context* mcc, struct pollfd* fds) {
+	int numFds = 0;
+
+	int i;
+	for (i = 0; i < mcc->numDaemons; i++) {
+		struct MCS_Daemon* daemon = &mcc->daemons[i];
+
+		if (daemon->pid == 0 || daemon->rpipe < 0)
+			continue;
+
+		fds[numFds].fd = daemon->rpipe;
+		fds[numFds].events = POLLIN;
+		fds[numFds].revents = 0;
+		numFds++;
+	}
+
+	return numFds;
+}
+
+// returns the number of keys sent, less if the pipe is full
+int MCS_sendDaemonKeys(struct MCS_Daemon* daemon, char* keys, int numKeys) {
+	int i;
+	for (i = 0; i < numKeys; i++) {
+		const struct MCS_DaemonKey* key = daemon->command->keys;
+
+		while (key->key != 0 && key->key != keys[i])
+			key++;
+
+		if (key->key == 0)
+			continue;
+
+		if (MCS_writeDaemon(daemon, key->command, strlen(key->command)) < 0)
+			return errno == EAGAIN ? i : -1;
+	}
+
+	return numKeys;
+}
+
+int MCS_startDaemon(struct MCS_Context* mcc, struct MCS_Daemon* daemon) {
+	struct MCS_Player player;
+
+	if (MCS_parsePlayer(&player, daemon->type,
+			daemon->command->command) < 0)
+		return -1;
+
+	// commands go to the STDIN of the player, its STDOUT comes back. the
+	// server side is non-blocking
+	int in[2];
+	int out[2];
+
+	if (pipe2(in, O_CLOEXEC) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_startDaemon: Error piping\n");
+		MCS_freePlayer(&player);
+		return -1;
+	}
+
+	if (pipe2(out, O_CLOEXEC) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_startDaemon: Error piping\n");
+		close(in[0]);
+		close(in[1]);
+		MCS_freePlayer(&player);
+		return -1;
+	}
+
+	pid_t pid;
+	int r = MCS_spawnPlayer(&player, "", in[0], out[1],
+			daemon->session->name, &pid);
+
+	MCS_freePlayer(&player);
+	close(in[0]);
+	close(out[1]);
+
+	if (r != 0) {
+		close(in[1]);
+		close(out[0]);
+		return -1;
+	}
+
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+	daemon->pid = pid;
+	daemon->wpipe = in[1];
+	daemon->rpipe = out[0];
+	daemon->lineLen = 0;
+	daemon->loading = 0;
+	mcc->changes++;
+
+	MCS_log(MCS_LOG_INFO, "Started player %d for type %d in session %s\n",
+			pid, daemon->type, daemon->session->name);
+
+	return 0;
+}
+
+void MCS_stopDaemonItem(struct MCS_Daemon* daemon) {
+	const char* stop = daemon->command->stop;
+
+	// the done line is ignored, the session does not play the item anymore
+	MCS_writeDaemon(daemon, stop, strlen(stop));
+}
+
+void MCS_stopDaemons(struct MCS_Context* mcc) {
+	// the players are stopped like the children of stopped items
+	int i;
+	for (i = 0; i < mcc->numDaemons; i++) {
+		struct MCS_Daemon* daemon = &mcc->daemons[i];
+
+		if (daemon->pid == 0)
+			continue;
+
+		close(daemon->wpipe);
+
+		if (daemon->rpipe >= 0)
+			close(daemon->rpipe);
+
+		struct MCS_Child* child = MCS_addChild(mcc, daemon->pid, NULL);
+
+		if (child != NULL) {
+			mcc->numStopping++;
+
+			if (MCS_signalChild(mcc, child) < 0) {
+				MCS_removeChild(mcc, child);
+				mcc->numStopping--;
+			}
+		}
+
+		daemon->pid = 0;
+		daemon->rpipe = -1;
+	}
+}
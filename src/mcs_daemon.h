@@ -0,0 +1,41 @@
+#ifndef MCS_DAEMON_H
+#define MCS_DAEMON_H
+
+#include "mcs.h"
+
+// a key of CTRL and the command it is translated to
+struct MCS_DaemonKey {
+	char key;
+	char* command;
+};
+
+// a persistent player and its line protocol. MCS_SPAWN_SLOT in load is
+// replaced with the file path. the player answers a load with a line that
+// starts with started or error, a line that starts with done ends the item
+struct MCS_DaemonCommand {
+	int type;
+	char* ext; // extensions it plays, as in MCS_EXT_*
+	char* command;
+	char* load;
+	char* started;
+	char* error;
+	char* stop;
+	char* done;
+	const struct MCS_DaemonKey* keys; // terminated by key 0
+};
+
+struct MCS_Daemon* MCS_getDaemon(struct MCS_Context* mcc,
+		struct MCS_Session* session, int type, char* filepath);
+void MCS_handleDaemonExit(struct MCS_Context* mcc, struct MCS_Daemon* daemon,
+		int status);
+void MCS_handleDaemons(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds);
+int MCS_loadDaemonItem(struct MCS_Daemon* daemon, char* filepath);
+struct MCS_Daemon* MCS_lookupDaemon(struct MCS_Context* mcc, pid_t pid);
+int MCS_pollDaemons(struct MCS_Context* mcc, struct pollfd* fds);
+int MCS_sendDaemonKeys(struct MCS_Daemon* daemon, char* keys, int numKeys);
+int MCS_startDaemon(struct MCS_Context* mcc, struct MCS_Daemon* daemon);
+void MCS_stopDaemonItem(struct MCS_Daemon* daemon);
+void MCS_stopDaemons(struct MCS_Context* mcc);
+
+#endif
@@ -0,0 +1,281 @@
+#include "mcs_enc.h"
+
+// all integers are written in network byte order (big-endian)
+
+static char* MCS_encU16(char* p, unsigned int v) {
+	p[0] = (v >> 8) & 0xFF;
+	p[1] = v & 0xFF;
+
+	return p + 2;
+}
+
+static char* MCS_encU32(char* p, unsigned int v) {
+	p[0] = (v >> 24) & 0xFF;
+	p[1] = (v >> 16) & 0xFF;
+	p[2] = (v >> 8) & 0xFF;
+	p[3] = v & 0xFF;
+
+	return p + 4;
+}
+
+static char* MCS_encU64(char* p, unsigned long long v) {
+	p = MCS_encU32(p, (v >> 32) & 0xFFFFFFFF);
+
+	return MCS_encU32(p, v & 0xFFFFFFFF);
+}
+
+// strings are stored as u16 length followed by the bytes (no '\0')
+static char* MCS_encStr(char* p, char* s, int len) {
+	p = MCS_encU16(p, len);
+	memcpy(p, s, len);
+
+	return p + len;
+}
+
+// records are limited to 64KB, strings are cut off well below that
+static int MCS_encStrLen(char* s) {
+	int len = strlen(s);
+
+	return len > 0x0FFF ? 0x0FFF : len;
+}
+
+// like snprintf, the record functions return the size of the record even if
+// it does not fit into the buffer, in which case nothing is written.
+// writes the record header if the record fits
+static int MCS_encHeader(char* buffp, int size, int kind, int payload) {
+	if (MCS_REC_HEADER + payload <= size) {
+		char* p = MCS_encU16(buffp, kind);
+		MCS_encU16(p, payload);
+	}
+
+	return MCS_REC_HEADER + payload;
+}
+
+int MCS_encCompression(char* buffp, int size, unsigned long responses,
+		unsigned long long bytesIn, unsigned long long bytesOut) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_COMPRESSION, 4 + 8 * 2);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, responses);
+	p = MCS_encU64(p, bytesIn);
+	MCS_encU64(p, bytesOut);
+
+	return len;
+}
+
+int MCS_encDir(char* buffp, int size, struct MCS_Dir* node) {
+	int nameLen = MCS_encStrLen(node->name);
+	int len = MCS_encHeader(buffp, size, MCS_REC_DIR, 4 * 4 + 2 + nameLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, node->id);
+	p = MCS_encU32(p, node->parent ? node->parent->id : 0);
+	p = MCS_encU32(p, node->numDirs);
+	p = MCS_encU32(p, node->numItems);
+	MCS_encStr(p, node->name, nameLen);
+
+	return len;
+}
+
+int MCS_encEnd(char* buffp, int size) {
+	return MCS_encHeader(buffp, size, MCS_REC_END, 0);
+}
+
+int MCS_encItem(char* buffp, int size, struct MCS_Item* item) {
+	int labelLen = MCS_encStrLen(item->label);
+	int len = MCS_encHeader(buffp, size, MCS_REC_ITEM, 4 + 2 + 2 + labelLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, item->id);
+	p = MCS_encU16(p, item->type);
+	MCS_encStr(p, item->label, labelLen);
+
+	return len;
+}
+
+int MCS_encItems(char* buffp, int size, unsigned int version, int type,
+		int offset, int length) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_ITEMS, 4 * 4);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, version);
+	p = MCS_encU32(p, type);
+	p = MCS_encU32(p, offset);
+	MCS_encU32(p, length);
+
+	return len;
+}
+
+int MCS_encLog(char* buffp, int size, int level, unsigned long records,
+		unsigned long dropped) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_LOG, 4 * 3);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, level);
+	p = MCS_encU32(p, records);
+	MCS_encU32(p, dropped);
+
+	return len;
+}
+
+int MCS_encNode(char* buffp, int size, struct MCS_NodeStatus* node) {
+	int nameLen = MCS_encStrLen(node->name);
+	int len = MCS_encHeader(buffp, size, MCS_REC_NODE, 4 * 7 + 2 + nameLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, node->up);
+	p = MCS_encU32(p, node->version);
+	p = MCS_encU32(p, node->size);
+	p = MCS_encU32(p, node->requests);
+	p = MCS_encU32(p, node->lastTime);
+	p = MCS_encU32(p, node->maxTime);
+	p = MCS_encU32(p, node->requests > 0
+			? node->totalTime / (long long) node->requests : 0);
+	MCS_encStr(p, node->name, nameLen);
+
+	return len;
+}
+
+int MCS_encPlayer(char* buffp, int size, char* session, int playing,
+		unsigned int itemID) {
+	int sessionLen = MCS_encStrLen(session);
+	int len = MCS_encHeader(buffp, size, MCS_REC_PLAYER,
+			4 * 2 + 2 + sessionLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, playing);
+	p = MCS_encU32(p, itemID);
+	MCS_encStr(p, session, sessionLen);
+
+	return len;
+}
+
+int MCS_encProperties(char* buffp, int size, struct MCS_Info* info) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_PROPERTIES, 4 * 4);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, info->bitrate);
+	p = MCS_encU32(p, info->samplerate);
+	p = MCS_encU32(p, info->channels);
+	MCS_encU32(p, info->length);
+
+	return len;
+}
+
+int MCS_encQueue(char* buffp, int size, struct MCS_SessionStatus* session) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_QUEUE, 4 * 5 + 8);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, session->queueSize);
+	p = MCS_encU32(p, session->next);
+	p = MCS_encU32(p, session->transitions);
+	p = MCS_encU32(p, session->lastSpawn);
+	p = MCS_encU32(p, session->maxSpawn);
+	MCS_encU64(p, session->totalSpawn);
+
+	return len;
+}
+
+int MCS_encStatus(char* buffp, int size, unsigned int version, int numItems) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_STATUS, 4 * 2);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, version);
+	MCS_encU32(p, numItems);
+
+	return len;
+}
+
+int MCS_encTag(char* buffp, int size, struct MCS_Info* info) {
+	int titleLen = MCS_encStrLen(info->title);
+	int artistLen = MCS_encStrLen(info->artist);
+	int albumLen = MCS_encStrLen(info->album);
+	int commentLen = MCS_encStrLen(info->comment);
+	int genreLen = MCS_encStrLen(info->genre);
+
+	int len = MCS_encHeader(buffp, size, MCS_REC_TAG, 4 * 2 + 5 * 2
+			+ titleLen + artistLen + albumLen + commentLen + genreLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, info->year);
+	p = MCS_encU32(p, info->track);
+	p = MCS_encStr(p, info->title, titleLen);
+	p = MCS_encStr(p, info->artist, artistLen);
+	p = MCS_encStr(p, info->album, albumLen);
+	p = MCS_encStr(p, info->comment, commentLen);
+	MCS_encStr(p, info->genre, genreLen);
+
+	return len;
+}
+
+int MCS_encType(char* buffp, int size, int id, char* name) {
+	int nameLen = MCS_encStrLen(name);
+	int len = MCS_encHeader(buffp, size, MCS_REC_TYPE, 2 + 2 + nameLen);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU16(p, id);
+	MCS_encStr(p, name, nameLen);
+
+	return len;
+}
+
+int MCS_encUsage(char* buffp, int size, struct MCS_Usage* usage,
+		long long duration) {
+	int len = MCS_encHeader(buffp, size, MCS_REC_USAGE, 4 * 12 + 8);
+
+	if (len > size)
+		return len;
+
+	char* p = buffp + MCS_REC_HEADER;
+	p = MCS_encU32(p, duration);
+	p = MCS_encU32(p, usage->cpuTime / 1000);
+	p = MCS_encU32(p, usage->load);
+	p = MCS_encU32(p, usage->maxLoad);
+	p = MCS_encU32(p, usage->rss);
+	p = MCS_encU32(p, usage->maxRss);
+	p = MCS_encU64(p, usage->readBytes);
+	p = MCS_encU32(p, usage->readRate);
+	p = MCS_encU32(p, usage->maxReadRate);
+	p = MCS_encU32(p, usage->switches);
+	p = MCS_encU32(p, usage->forcedSwitches);
+	p = MCS_encU32(p, usage->execTime);
+	MCS_encU32(p, usage->readTime);
+
+	return len;
+}
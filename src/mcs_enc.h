@@ -0,0 +1,45 @@
+#ifndef MCS_ENC_H
+#define MCS_ENC_H
+
+#include "mcs.h"
+
+// record kinds of the binary encoding (see README, "Binary Encoding")
+#define MCS_REC_ITEMS 1
+#define MCS_REC_ITEM 2
+#define MCS_REC_STATUS 3
+#define MCS_REC_TYPE 4
+#define MCS_REC_TAG 5
+#define MCS_REC_PROPERTIES 6
+#define MCS_REC_COMPRESSION 7
+#define MCS_REC_PLAYER 8
+#define MCS_REC_QUEUE 9
+#define MCS_REC_DIR 10
+#define MCS_REC_USAGE 11
+#define MCS_REC_LOG 12
+#define MCS_REC_NODE 13
+#define MCS_REC_END 0xFFFF
+
+// size of the record header (kind and payload size)
+#define MCS_REC_HEADER 4
+
+int MCS_encCompression(char* buffp, int size, unsigned long responses,
+		unsigned long long bytesIn, unsigned long long bytesOut);
+int MCS_encDir(char* buffp, int size, struct MCS_Dir* node);
+int MCS_encEnd(char* buffp, int size);
+int MCS_encItem(char* buffp, int size, struct MCS_Item* item);
+int MCS_encItems(char* buffp, int size, unsigned int version, int type,
+		int offset, int length);
+int MCS_encNode(char* buffp, int size, struct MCS_NodeStatus* node);
+int MCS_encPlayer(char* buffp, int size, char* session, int playing,
+		unsigned int itemID);
+int MCS_encLog(char* buffp, int size, int level, unsigned long records,
+		unsigned long dropped);
+int MCS_encProperties(char* buffp, int size, struct MCS_Info* info);
+int MCS_encQueue(char* buffp, int size, struct MCS_SessionStatus* session);
+int MCS_encStatus(char* buffp, int size, unsigned int version, int numItems);
+int MCS_encTag(char* buffp, int size, struct MCS_Info* info);
+int MCS_encType(char* buffp, int size, int id, char* name);
+int MCS_encUsage(char* buffp, int size, struct MCS_Usage* usage,
+		long long duration);
+
+#endif
@@ -0,0 +1,1355 @@
+#include "mcs_fed.h"
+#include "mcs_enc.h"
+#include "mcs_log.h"
+#include "mcs_notify.h"
+#include "mcs_session.h"
+#include "mcs_snap.h"
+#include "mcs_usage.h"
+
+#include <netdb.h> // getaddrinfo
+
+// federation. every node (another server, "mcs://host:port") has a
+// directory below the root that holds a copy of its item list, after the
+// local items. the copy is checked with STAT and fetched again with LIST if
+// the version of the node changed. the items get IDs of their own, INFO,
+// ART, PLAY, CTRL and STOP of the items are forwarded to their node. the
+// end of an item is an EXIT event of the node, its events are received
+// through SUBSCRIBE.
+// the checks and the pages of the list, STOP, CTRL and the events are
+// driven by the poll of the main loop. INFO, ART and PLAY are answered to
+// the client with the response of the node, the main loop waits for them (up
+// to MCS_NODE_TIMEOUT ms) like the requests of the clients wait for the disk
+
+// a buffered response of a node
+struct MCS_NodeResponse {
+	int status;
+	char etag[MCS_ETAG_SIZE];
+	char* body; // NULL if there is none
+	int len;
+	char* buffer;
+};
+
+static unsigned int MCS_decU16(char* p) {
+	unsigned char* u = (unsigned char*) p;
+
+	return (u[0] << 8) | u[1];
+}
+
+static unsigned int MCS_decU32(char* p) {
+	unsigned char* u = (unsigned char*) p;
+
+	return ((unsigned int) u[0] << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+}
+
+static void MCS_countNodeRequest(struct MCS_Node* node, long long start) {
+	long long time = MCS_getTime() - start;
+
+	node->up = 1;
+	node->requests++;
+	node->lastTime = time;
+	node->totalTime += time;
+
+	if (time > node->maxTime)
+		node->maxTime = time;
+}
+
+// the body of INFO names the item by its ID on the node. returns a copy of
+// the body with the ID of the item here
+static char* MCS_copyNodeInfo(char* body, int len, int encoding,
+		unsigned int itemID, int* outlen) {
+	char* out = (char*) malloc((len + 16) * sizeof(char));
+	char* p = encoding == MCS_ENC_XML ? strstr(body, "id=\"") : NULL;
+
+	if (p == NULL) {
+		memcpy(out, body, len);
+		*outlen = len;
+
+		if (encoding == MCS_ENC_BIN && len >= MCS_REC_HEADER + 4
+				&& MCS_decU16(out) == MCS_REC_ITEM) {
+			char* id = out + MCS_REC_HEADER;
+			id[0] = (itemID >> 24) & 0xFF;
+			id[1] = (itemID >> 16) & 0xFF;
+			id[2] = (itemID >> 8) & 0xFF;
+			id[3] = itemID & 0xFF;
+		}
+
+		return out;
+	}
+
+	p += 4;
+
+	char* end = p + strspn(p, "0123456789");
+	int prefix = p - body;
+
+	memcpy(out, body, prefix);
+	int idlen = sprintf(out + prefix, "%u", itemID);
+	memcpy(out + prefix + idlen, end, body + len - end);
+
+	*outlen = prefix + idlen + (body + len - end);
+
+	return out;
+}
+
+static struct MCS_Item* MCS_createNodeItem(struct MCS_Node* node,
+		unsigned int remoteID, int type, char* label, int labelLen) {
+	struct MCS_NodeItem* nodeItem;
+	nodeItem = (struct MCS_NodeItem*) malloc(sizeof(struct MCS_NodeItem));
+	memset(nodeItem, 0, sizeof(struct MCS_NodeItem));
+
+	// the IDs of the nodes may collide, the ID here is derived from the
+	// node and the ID on the node
+	char hashMessage[MCS_PATH_SIZE];
+	int len = snprintf(hashMessage, sizeof(hashMessage), "%s/%u", node->name,
+			remoteID);
+
+	if (len >= (int) sizeof(hashMessage))
+		len = sizeof(hashMessage) - 1;
+
+	struct MCS_Item* item = &nodeItem->item;
+	item->id = sax_hash(hashMessage, len, MCS_HASH_SIZE);
+	item->dir = node->dir;
+	item->type = type;
+
+	item->label = (char*) malloc((labelLen + 1) * sizeof(char));
+	memcpy(item->label, label, labelLen);
+	item->label[labelLen] = '\0';
+
+	nodeItem->remoteID = remoteID;
+
+	return item;
+}
+
+// waits until the socket is ready, returns -1 if the deadline (us) passed
+static int MCS_waitNode(int fd, int events, long long deadline) {
+	for (;;) {
+		long long now = MCS_getTime();
+
+		if (now >= deadline)
+			return -1;
+
+		struct pollfd pfd = { fd, events, 0 };
+		int r = poll(&pfd, 1, (int) ((deadline - now + 999) / 1000));
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		return r > 0 ? 0 : -1;
+	}
+}
+
+// starts to connect to the node, the command is sent by
+// MCS_advanceNodeRequest once the socket is writable
+static int MCS_openNodeRequest(struct MCS_Node* node,
+		struct MCS_NodeRequest* request, char* command) {
+	int len = snprintf(request->command, MCS_NODE_COMMAND_SIZE, "%s",
+			command);
+
+	request->fd = -1;
+	request->sent = 0;
+	request->len = 0;
+	request->start = MCS_getTime();
+	request->deadline = request->start + MCS_NODE_TIMEOUT * 1000LL;
+
+	// the server reads a request with a single read
+	if (node->addressLen == 0 || len >= MCS_NODE_COMMAND_SIZE)
+		return -1;
+
+	int fd = socket(node->address.ss_family,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+		return -1;
+
+	request->connected = 1;
+
+	if (connect(fd, (struct sockaddr*) &node->address, node->addressLen)
+			< 0) {
+		if (errno != EINPROGRESS) {
+			close(fd);
+			return -1;
+		}
+
+		request->connected = 0;
+	}
+
+	request->fd = fd;
+
+	return 0;
+}
+
+// sends the command and reads the response as far as the socket allows.
+// returns 1 once the node closed the connection after the response, 0 while
+// the request is open and -1 on errors. a socket that is not ready is left
+// alone, so that a stale poll event does no harm
+static int MCS_advanceNodeRequest(struct MCS_Node* node,
+		struct MCS_NodeRequest* request) {
+	if (!request->connected) {
+		if (connect(request->fd, (struct sockaddr*) &node->address,
+				node->addressLen) < 0 && errno != EISCONN) {
+			return errno == EALREADY || errno == EINPROGRESS ? 0 : -1;
+		}
+
+		request->connected = 1;
+	}
+
+	int len = strlen(request->command);
+
+	if (request->sent < len) {
+		int r = send(request->fd, request->command + request->sent,
+				len - request->sent, MSG_NOSIGNAL);
+
+		if (r < 0)
+			return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+		request->sent += r;
+		return 0;
+	}
+
+	// the server closes the connection after the response
+	if (request->len == request->size) {
+		if (request->size == MCS_NODE_MAX_RESPONSE)
+			return 1;
+
+		request->size = request->size == 0 ? 4096 : request->size * 2;
+
+		if (request->size > MCS_NODE_MAX_RESPONSE)
+			request->size = MCS_NODE_MAX_RESPONSE;
+
+		request->buffer = (char*) realloc(request->buffer,
+				(request->size + 1) * sizeof(char));
+	}
+
+	int r = read(request->fd, request->buffer + request->len,
+			request->size - request->len);
+
+	if (r < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+	request->len += r;
+
+	return r == 0 ? 1 : 0;
+}
+
+static void MCS_closeNodeRequest(struct MCS_NodeRequest* request) {
+	if (request->fd >= 0)
+		close(request->fd);
+
+	free(request->buffer);
+
+	request->fd = -1;
+	request->buffer = NULL;
+	request->len = 0;
+	request->size = 0;
+}
+
+static int MCS_getNodeRequestEvents(struct MCS_NodeRequest* request) {
+	if (!request->connected || request->sent < (int) strlen(request->command))
+		return POLLOUT;
+
+	return POLLIN;
+}
+
+// closes the request and parses the response. returns the status code of the
+// node or -1 if the request failed (r < 0) or the response is invalid. the
+// buffer of the response must be freed
+static int MCS_finishNodeRequest(struct MCS_Node* node,
+		struct MCS_NodeRequest* request, int r,
+		struct MCS_NodeResponse* res) {
+	memset(res, 0, sizeof(struct MCS_NodeResponse));
+
+	char* buffer = request->buffer;
+	int len = request->len;
+	int prefix = strlen(MCP_VERSION);
+
+	request->buffer = NULL;
+	MCS_closeNodeRequest(request);
+
+	if (r < 0 || len < prefix + 4 || len == MCS_NODE_MAX_RESPONSE
+			|| strncmp(buffer, MCP_VERSION " ", prefix + 1) != 0) {
+		MCS_log(MCS_LOG_WARN,
+				"MCS_finishNodeRequest: No response from %s to %s\n",
+				node->name, request->command);
+		free(buffer);
+		node->up = 0;
+		return -1;
+	}
+
+	buffer[len] = '\0';
+	MCS_countNodeRequest(node, request->start);
+
+	res->buffer = buffer;
+	res->status = atoi(buffer + prefix + 1);
+
+	// the header fields end with an empty line, the body may be binary
+	char* line = strchr(buffer, '\n');
+
+	while (line != NULL) {
+		line++;
+
+		if (*line == '\n') {
+			res->body = line + 1;
+			res->len = buffer + len - res->body;
+			break;
+		}
+
+		if (strncmp(line, "ETag: ", 6) == 0) {
+			int taglen = strcspn(line + 6, "\n");
+
+			if (taglen >= MCS_ETAG_SIZE)
+				taglen = MCS_ETAG_SIZE - 1;
+
+			memcpy(res->etag, line + 6, taglen);
+			res->etag[taglen] = '\0';
+		}
+
+		line = strchr(line, '\n');
+	}
+
+	return res->status;
+}
+
+static int MCS_pollNodeRequest(struct MCS_NodeRequest* request,
+		struct pollfd* fd) {
+	if (request->fd < 0)
+		return 0;
+
+	fd->fd = request->fd;
+	fd->events = MCS_getNodeRequestEvents(request);
+	fd->revents = 0;
+
+	return 1;
+}
+
+// reads from the node, returns -1 if the deadline (us) of the request
+// passed. a node that sends slowly can't hold the main loop any longer
+static int MCS_readNode(int fd, char* buffer, int size, long long deadline) {
+	for (;;) {
+		if (MCS_waitNode(fd, POLLIN, deadline) < 0)
+			return -1;
+
+		int len = read(fd, buffer, size);
+
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+
+		return len;
+	}
+}
+
+// writes to the client before the deadline (us), a client that does not
+// read can't hold the main loop any longer
+static int MCS_writeClient(int fd, char* buffer, int len,
+		long long deadline) {
+	while (len > 0) {
+		int r = send(fd, buffer, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (r < 0 && errno == EAGAIN) {
+			if (MCS_waitNode(fd, POLLOUT, deadline) < 0)
+				return -1;
+
+			continue;
+		}
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r < 0)
+			return -1;
+
+		buffer += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+// drives a request while the main loop waits for it, returns the result of
+// the last MCS_advanceNodeRequest
+static int MCS_completeNodeRequest(struct MCS_Node* node,
+		struct MCS_NodeRequest* request) {
+	int r = 0;
+
+	while (r == 0) {
+		if (MCS_waitNode(request->fd, MCS_getNodeRequestEvents(request),
+				request->deadline) < 0) {
+			r = -1;
+		} else {
+			r = MCS_advanceNodeRequest(node, request);
+		}
+	}
+
+	return r;
+}
+
+// sends a command to the node and waits for the whole response, only for
+// the requests whose answer the client waits for. returns the status code
+// of the node or -1 if the node could not be reached. the buffer of the
+// response must be freed
+static int MCS_requestNode(struct MCS_Node* node, char* command,
+		struct MCS_NodeResponse* res) {
+	struct MCS_NodeRequest request;
+	memset(&request, 0, sizeof(request));
+
+	int r = MCS_openNodeRequest(node, &request, command);
+
+	if (r == 0)
+		r = MCS_completeNodeRequest(node, &request);
+
+	return MCS_finishNodeRequest(node, &request, r, res);
+}
+
+static void MCS_closeNodeEvents(struct MCS_Context* mcc,
+		struct MCS_Node* node) {
+	close(node->events);
+	node->events = -1;
+	node->lineLen = 0;
+
+	// the node went away, it is checked right away. the end of the items
+	// that play on it can't be seen anymore
+	node->up = 0;
+	node->deadline = 0;
+
+	MCS_log(MCS_LOG_WARN, "Lost the events of node %s\n", node->name);
+
+	int i;
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+
+		if (session->node == node)
+			MCS_handleItemEnd(mcc, session, -1);
+	}
+}
+
+static void MCS_handleNodeLine(struct MCS_Context* mcc,
+		struct MCS_Node* node, char* line) {
+	// the list of the node changed
+	if (strncmp(line, "LIST ", 5) == 0) {
+		node->deadline = 0;
+		return;
+	}
+
+	char name[MCS_SESSION_NAME];
+	unsigned int itemID;
+	int status;
+
+	// the name has at most MCS_SESSION_NAME - 1 characters
+	if (sscanf(line, "EXIT %31s %u %d", name, &itemID, &status) != 3)
+		return;
+
+	struct MCS_Session* session = MCS_getSession(mcc, name, 0);
+
+	if (session != NULL && session->node == node
+			&& session->remoteID == itemID)
+		MCS_handleItemEnd(mcc, session, status);
+}
+
+static struct MCS_Item* MCS_lookupNodeItem(struct MCS_Context* mcc,
+		struct MCS_Node* node, unsigned int remoteID) {
+	struct MCS_Dir* dir = node->dir;
+
+	int i;
+	for (i = 0; i < dir->numItems; i++) {
+		struct MCS_Item* item = mcc->items[dir->firstItem + i];
+
+		if (((struct MCS_NodeItem*) item)->remoteID == remoteID)
+			return item;
+	}
+
+	return NULL;
+}
+
+// starts to subscribe, the connection becomes the events of the node once
+// SUBSCRIBE was sent
+static void MCS_openNodeEvents(struct MCS_Node* node) {
+	if (MCS_openNodeRequest(node, &node->subscribe, "SUBSCRIBE") < 0) {
+		MCS_log(MCS_LOG_WARN, "Could not subscribe to node %s\n", node->name);
+		MCS_closeNodeRequest(&node->subscribe);
+	}
+}
+
+// parses the ITEM records of a page of LIST. returns 1 if the page is of
+// another version of the list, -1 if the body is invalid
+static int MCS_parseNodeItems(struct MCS_Node* node,
+		struct MCS_NodeResponse* res, unsigned int version,
+		struct MCS_Item** items, int* numItems, int maxItems) {
+	char* p = res->body;
+	char* end = res->body + res->len;
+
+	while (p != NULL && p + MCS_REC_HEADER <= end) {
+		unsigned int kind = MCS_decU16(p);
+		int size = MCS_decU16(p + 2);
+		char* payload = p + MCS_REC_HEADER;
+
+		if (payload + size > end)
+			break;
+
+		if (kind == MCS_REC_END)
+			return 0;
+
+		if (kind == MCS_REC_ITEMS && size >= 4
+				&& MCS_decU32(payload) != version)
+			return 1;
+
+		if (kind == MCS_REC_ITEM && size >= 8) {
+			int labelLen = MCS_decU16(payload + 6);
+
+			if (8 + labelLen > size)
+				break;
+
+			if (*numItems < maxItems) {
+				items[(*numItems)++] = MCS_createNodeItem(node,
+						MCS_decU32(payload), MCS_decU16(payload + 4),
+						payload + 8, labelLen);
+			}
+		}
+
+		p = payload + size;
+	}
+
+	MCS_log(MCS_LOG_WARN, "MCS_parseNodeItems: Invalid list from %s\n",
+			node->name);
+	return -1;
+}
+
+static int MCS_parseNodeStatus(struct MCS_NodeResponse* res,
+		unsigned int* version, int* size) {
+	char* p = res->body;
+	char* end = res->body + res->len;
+
+	while (p != NULL && p + MCS_REC_HEADER <= end) {
+		unsigned int kind = MCS_decU16(p);
+		int recsize = MCS_decU16(p + 2);
+		char* payload = p + MCS_REC_HEADER;
+
+		if (payload + recsize > end || kind == MCS_REC_END)
+			break;
+
+		if (kind == MCS_REC_STATUS && recsize >= 8) {
+			*version = MCS_decU32(payload);
+			*size = MCS_decU32(payload + 4);
+			return 0;
+		}
+
+		p = payload + recsize;
+	}
+
+	return -1;
+}
+
+// the node name is "mcs://host[:port]", IPv6 addresses are written as
+// "[::1]:port"
+static int MCS_resolveNode(struct MCS_Node* node) {
+	char host[256];
+	char port[16];
+
+	char* p = node->name + strlen(MCS_NODE_PREFIX);
+	char* end;
+	int hostlen;
+
+	if (*p == '[') {
+		end = strchr(p, ']');
+
+		if (end == NULL)
+			return -1;
+
+		hostlen = end - p - 1;
+		p++;
+		end++;
+	} else {
+		hostlen = strcspn(p, ":/");
+		end = p + hostlen;
+	}
+
+	if (hostlen == 0 || hostlen >= (int) sizeof(host))
+		return -1;
+
+	memcpy(host, p, hostlen);
+	host[hostlen] = '\0';
+
+	if (*end == ':') {
+		int portlen = strcspn(end + 1, "/");
+
+		if (portlen == 0 || portlen >= (int) sizeof(port))
+			return -1;
+
+		memcpy(port, end + 1, portlen);
+		port[portlen] = '\0';
+	} else {
+		snprintf(port, sizeof(port), "%d", MCS_PORT);
+	}
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo* info;
+
+	if (getaddrinfo(host, port, &hints, &info) != 0)
+		return -1;
+
+	memcpy(&node->address, info->ai_addr, info->ai_addrlen);
+	node->addressLen = info->ai_addrlen;
+
+	freeaddrinfo(info);
+
+	return 0;
+}
+
+// the items of the nodes follow the local items, in the order of the nodes
+static void MCS_replaceNodeItems(struct MCS_Context* mcc,
+		struct MCS_Node* node, struct MCS_Item** items, int numItems) {
+	struct MCS_Dir* dir = node->dir;
+	int delta = numItems - dir->numItems;
+
+	int i;
+	for (i = 0; i < dir->numItems; i++) {
+		struct MCS_Item* item = mcc->items[dir->firstItem + i];
+
+		free(item->label);
+		free(item);
+	}
+
+	if (mcc->size + delta > mcc->capacity) {
+		int capacity = mcc->capacity > 0 ? mcc->capacity * 2 : 1024;
+
+		if (capacity < mcc->size + delta)
+			capacity = mcc->size + delta;
+
+		mcc->items = (struct MCS_Item**) realloc(mcc->items,
+				capacity * sizeof(struct MCS_Item*));
+		memset(mcc->items + mcc->capacity, 0, (capacity - mcc->capacity)
+				* sizeof(struct MCS_Item*));
+		mcc->capacity = capacity;
+	}
+
+	int tail = dir->firstItem + dir->numItems;
+
+	memmove(mcc->items + tail + delta, mcc->items + tail,
+			(mcc->size - tail) * sizeof(struct MCS_Item*));
+	memcpy(mcc->items + dir->firstItem, items,
+			numItems * sizeof(struct MCS_Item*));
+
+	// the slots at the end are freed with the list
+	if (delta < 0) {
+		memset(mcc->items + mcc->size + delta, 0,
+				-delta * sizeof(struct MCS_Item*));
+	}
+
+	mcc->size += delta;
+	dir->numItems = numItems;
+
+	for (i = node - mcc->nodes + 1; i < mcc->numNodes; i++) {
+		mcc->nodes[i].dir->firstItem += delta;
+	}
+
+	// the playing items keep their ID
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+
+		if (session->node == node) {
+			session->playingItem = MCS_lookupNodeItem(mcc, node,
+					session->remoteID);
+		}
+	}
+
+	// the version of the whole list changes with the list of any node
+	unsigned int version = time(NULL);
+	mcc->version = version > mcc->version ? version : mcc->version + 1;
+
+	MCS_publishSnapshot(mcc);
+
+	MCS_notify(mcc, "LIST %u %d", mcc->version, mcc->size);
+}
+
+// a node that does not answer is checked less often
+static void MCS_backOffNode(struct MCS_Node* node, int wasUp) {
+	if (wasUp)
+		MCS_log(MCS_LOG_WARN, "Node %s is down\n", node->name);
+
+	long long interval = MCS_NODE_INTERVAL;
+	node->up = 0;
+	node->failures++;
+
+	int i;
+	for (i = 1; i < node->failures && interval < MCS_NODE_MAX_INTERVAL; i++) {
+		interval *= 2;
+	}
+
+	if (interval > MCS_NODE_MAX_INTERVAL)
+		interval = MCS_NODE_MAX_INTERVAL;
+
+	node->deadline = MCS_getTime() + interval * 1000LL;
+}
+
+// drops the pages fetched so far. the list is fetched again with the next
+// check, right away if it changed while it was fetched (r > 0)
+static void MCS_stopNodeFetch(struct MCS_Node* node, int r) {
+	MCS_freeItems(node->fetched, node->numFetched);
+	free(node->fetched);
+
+	node->fetched = NULL;
+	node->numFetched = 0;
+	node->statTag[0] = '\0';
+
+	if (r > 0) {
+		node->deadline = 0;
+	} else {
+		node->deadline = MCS_getTime() + MCS_NODE_INTERVAL * 1000LL;
+	}
+}
+
+// requests the next page of LIST, the items replace the ones of the node
+// once the list is complete
+static void MCS_continueNodeFetch(struct MCS_Context* mcc,
+		struct MCS_Node* node) {
+	if (node->numFetched < node->fetchSize) {
+		char command[64];
+		snprintf(command, sizeof(command), "LIST 0 %d %d ENC=BIN",
+				node->numFetched, node->page);
+
+		if (MCS_openNodeRequest(node, &node->check, command) < 0) {
+			node->up = 0;
+			MCS_stopNodeFetch(node, -1);
+		}
+
+		return;
+	}
+
+	MCS_replaceNodeItems(mcc, node, node->fetched, node->numFetched);
+	free(node->fetched);
+
+	node->fetched = NULL;
+	node->version = node->fetchVersion;
+
+	MCS_log(MCS_LOG_INFO, "Node %s: %d items (version %u)\n", node->name,
+			node->numFetched, node->version);
+}
+
+static void MCS_handleNodePage(struct MCS_Context* mcc, struct MCS_Node* node,
+		int status, struct MCS_NodeResponse* res) {
+	int fetched = node->numFetched;
+	int r = 0;
+
+	if (status == MCS_ERR_OK) {
+		r = MCS_parseNodeItems(node, res, node->fetchVersion, node->fetched,
+				&node->numFetched, node->fetchSize);
+	} else if (status == MCS_ERR_TOO_LONG && node->page > 1) {
+		// the labels are too long for a page of that size
+		node->page /= 2;
+	} else {
+		// the list shrank
+		r = status == MCS_ERR_BAD_PARAMS ? 1 : -1;
+	}
+
+	if (r == 0 && status == MCS_ERR_OK && node->numFetched == fetched)
+		r = -1;
+
+	if (r != 0) {
+		MCS_stopNodeFetch(node, r);
+		return;
+	}
+
+	MCS_continueNodeFetch(mcc, node);
+}
+
+// handles the response to STAT or to a page of LIST, r is the result of
+// MCS_advanceNodeRequest
+static void MCS_handleNodeCheck(struct MCS_Context* mcc,
+		struct MCS_Node* node, int r) {
+	int wasUp = node->up;
+
+	struct MCS_NodeResponse res;
+	int status = MCS_finishNodeRequest(node, &node->check, r, &res);
+
+	if (node->fetched != NULL) {
+		MCS_handleNodePage(mcc, node, status, &res);
+		free(res.buffer);
+		return;
+	}
+
+	unsigned int version = 0;
+	int size = 0;
+
+	if (status == MCS_ERR_OK
+			&& MCS_parseNodeStatus(&res, &version, &size) == 0) {
+		strcpy(node->statTag, res.etag);
+	} else if (status != MCS_ERR_NOT_MODIFIED) {
+		free(res.buffer);
+		MCS_backOffNode(node, wasUp);
+		return;
+	}
+
+	free(res.buffer);
+	node->failures = 0;
+
+	if (!wasUp)
+		MCS_log(MCS_LOG_INFO, "Node %s is up\n", node->name);
+
+	// subscribe before the list is fetched, so that no change is missed
+	if (node->events < 0 && node->subscribe.fd < 0)
+		MCS_openNodeEvents(node);
+
+	if (status == MCS_ERR_NOT_MODIFIED || version == node->version)
+		return;
+
+	// the local items and the other nodes count against MCS_MAX_ITEMS
+	int maxItems = MCS_MAX_ITEMS - (mcc->size - node->dir->numItems);
+
+	if (size > maxItems) {
+		MCS_log(MCS_LOG_WARN, "Items of node %s capped to %d items.\n",
+				node->name, maxItems);
+		size = maxItems;
+	}
+
+	node->fetched = (struct MCS_Item**) malloc((size > 0 ? size : 1)
+			* sizeof(struct MCS_Item*));
+	node->numFetched = 0;
+	node->fetchSize = size;
+	node->fetchVersion = version;
+	node->page = MCS_NODE_PAGE;
+
+	MCS_continueNodeFetch(mcc, node);
+}
+
+static void MCS_dropNodeCommand(struct MCS_Node* node) {
+	node->numCommands--;
+	memmove(node->commands[0], node->commands[1],
+			node->numCommands * MCS_NODE_COMMAND_SIZE);
+}
+
+// opens the first of the queued commands that the node can be reached for
+static void MCS_sendNodeCommands(struct MCS_Node* node) {
+	while (node->command.fd < 0 && node->numCommands > 0) {
+		if (MCS_openNodeRequest(node, &node->command, node->commands[0])
+				== 0) {
+			return;
+		}
+
+		MCS_log(MCS_LOG_WARN, "Could not forward %s to node %s\n",
+				node->commands[0], node->name);
+
+		node->up = 0;
+		MCS_dropNodeCommand(node);
+	}
+}
+
+// the response to STOP or CTRL is only logged, the next command is sent
+static void MCS_handleNodeCommand(struct MCS_Node* node, int r) {
+	struct MCS_NodeResponse res;
+	int status = MCS_finishNodeRequest(node, &node->command, r, &res);
+
+	if (status >= 0 && status != MCS_ERR_OK) {
+		MCS_log(MCS_LOG_WARN, "Node %s answered %s with %d\n", node->name,
+				node->command.command, status);
+	}
+
+	free(res.buffer);
+
+	MCS_dropNodeCommand(node);
+	MCS_sendNodeCommands(node);
+}
+
+// a request that waits for the node is made after the queued commands, i.e.
+// PLAY after the STOP of the item before
+static void MCS_flushNodeCommands(struct MCS_Node* node) {
+	while (node->command.fd >= 0) {
+		MCS_handleNodeCommand(node,
+				MCS_completeNodeRequest(node, &node->command));
+	}
+}
+
+static void MCS_closeNode(struct MCS_Node* node) {
+	MCS_closeNodeRequest(&node->check);
+	MCS_closeNodeRequest(&node->command);
+	MCS_closeNodeRequest(&node->subscribe);
+
+	if (node->fetched != NULL)
+		MCS_stopNodeFetch(node, -1);
+
+	if (node->events >= 0) {
+		close(node->events);
+		node->events = -1;
+	}
+
+	node->numCommands = 0;
+}
+
+void MCS_attachNodes(struct MCS_Context* mcc) {
+	struct MCS_Dir* root = mcc->dirNodes[0];
+	int numNodes = 0;
+
+	int i;
+	for (i = 0; i < root->numDirs; i++) {
+		struct MCS_Dir* dir = mcc->dirNodes[root->firstDir + i];
+
+		if (!MCS_isNodeName(dir->name))
+			continue;
+
+		if (numNodes == MCS_MAX_NODES) {
+			MCS_log(MCS_LOG_ERROR, "MCS_attachNodes: Too many nodes\n");
+			break;
+		}
+
+		// the nodes keep their slot and connection over a RESTART
+		struct MCS_Node* node = &mcc->nodes[numNodes++];
+
+		if (numNodes > mcc->numNodes) {
+			memset(node, 0, sizeof(struct MCS_Node));
+			node->check.fd = -1;
+			node->command.fd = -1;
+			node->subscribe.fd = -1;
+			node->events = -1;
+			node->name = dir->name;
+
+			if (MCS_resolveNode(node) < 0) {
+				MCS_log(MCS_LOG_ERROR, "Could not resolve node %s\n",
+						dir->name);
+			}
+		}
+
+		// the items are fetched again, after the local items. the pages
+		// fetched so far belong to the directory before
+		MCS_closeNodeRequest(&node->check);
+
+		if (node->fetched != NULL)
+			MCS_stopNodeFetch(node, -1);
+
+		node->name = dir->name;
+		node->dir = dir;
+		node->version = 0;
+		node->statTag[0] = '\0';
+		node->deadline = 0;
+
+		dir->firstItem = mcc->size;
+		dir->numItems = 0;
+	}
+
+	for (i = numNodes; i < mcc->numNodes; i++) {
+		MCS_closeNode(&mcc->nodes[i]);
+	}
+
+	mcc->numNodes = numNodes;
+}
+
+void MCS_closeNodes(struct MCS_Context* mcc) {
+	int i;
+	for (i = 0; i < mcc->numNodes; i++) {
+		struct MCS_Node* node = &mcc->nodes[i];
+
+		// the STOP of the items that played on the node
+		MCS_flushNodeCommands(node);
+		MCS_closeNode(node);
+	}
+}
+
+int MCS_forwardArt(struct MCS_Context* mcc, struct MCS_Item* item,
+		struct MCS_Request* req) {
+	struct MCS_Node* node = MCS_getItemNode(mcc, item);
+
+	char command[128];
+	snprintf(command, sizeof(command), "ART %u%s%s",
+			((struct MCS_NodeItem*) item)->remoteID,
+			req->validate ? " IF=" : "", req->ifTag);
+
+	struct MCS_NodeRequest request;
+	memset(&request, 0, sizeof(request));
+
+	int r = MCS_openNodeRequest(node, &request, command);
+
+	while (r == 0 && MCS_getNodeRequestEvents(&request) == POLLOUT) {
+		if (MCS_waitNode(request.fd, POLLOUT, request.deadline) < 0) {
+			r = -1;
+		} else {
+			r = MCS_advanceNodeRequest(node, &request);
+		}
+	}
+
+	if (r != 0) {
+		MCS_closeNodeRequest(&request);
+		node->up = 0;
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	// images are large and don't name the item, the response is relayed
+	// as it is. it is complete with the body of the length in its header
+	char buffer[4096];
+	char header[256];
+	int headerLen = 0;
+	long expected = -1;
+	long relayed = 0;
+	int len = 0;
+
+	while (expected < 0 || relayed < expected) {
+		len = MCS_readNode(request.fd, buffer, sizeof(buffer),
+				request.deadline);
+
+		if (len <= 0)
+			break;
+
+		if (MCS_writeClient(req->clientSocket, buffer, len,
+				request.deadline) < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_forwardArt: Error writing to socket.\n");
+			MCS_closeNodeRequest(&request);
+			return -1;
+		}
+
+		relayed += len;
+
+		if (expected >= 0)
+			continue;
+
+		int n = len < (int) sizeof(header) - 1 - headerLen
+				? len : (int) sizeof(header) - 1 - headerLen;
+
+		memcpy(header + headerLen, buffer, n);
+		headerLen += n;
+		header[headerLen] = '\0';
+
+		char* end = strstr(header, "\n\n");
+
+		if (end != NULL) {
+			char* field = strstr(header, "\nLength: ");
+			expected = end + 2 - header;
+
+			if (field != NULL && field < end)
+				expected += atol(field + 9);
+		}
+	}
+
+	MCS_closeNodeRequest(&request);
+
+	if (relayed == 0) {
+		node->up = 0;
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	// an error is only the status line
+	int prefix = strlen(MCP_VERSION);
+
+	if (expected < 0 && len == 0 && headerLen > prefix
+			&& atoi(header + prefix + 1) != MCS_ERR_OK) {
+		expected = relayed;
+	}
+
+	// the status line was sent, the client has to see that the image is
+	// cut off
+	if (expected < 0 || relayed < expected) {
+		MCS_log(MCS_LOG_WARN,
+				"MCS_forwardArt: %ld of %ld bytes from %s for %s\n", relayed,
+				expected, node->name, request.command);
+		node->up = 0;
+		return -1;
+	}
+
+	MCS_countNodeRequest(node, request.start);
+
+	return 0; // the status line of the node was sent
+}
+
+int MCS_forwardInfo(struct MCS_Context* mcc, struct MCS_Item* item,
+		struct MCS_Request* req) {
+	struct MCS_Node* node = MCS_getItemNode(mcc, item);
+
+	// the body is compressed here, the validator is the one of the node
+	char command[128];
+	snprintf(command, sizeof(command), "INFO %u%s%s%s",
+			((struct MCS_NodeItem*) item)->remoteID,
+			req->encoding == MCS_ENC_BIN ? " ENC=BIN" : "",
+			req->validate ? " IF=" : "", req->ifTag);
+
+	struct MCS_NodeResponse res;
+	int status = MCS_requestNode(node, command, &res);
+
+	if (status != MCS_ERR_OK || res.body == NULL) {
+		free(res.buffer);
+		return status < 0 || status == MCS_ERR_OK
+				? MCS_ERR_SERVER_ERROR : status;
+	}
+
+	int len;
+	char* body = MCS_copyNodeInfo(res.body, res.len, req->encoding, item->id,
+			&len);
+
+	strcpy(req->etag, res.etag);
+	int r = MCS_writeResponse(req, body, len);
+
+	free(body);
+	free(res.buffer);
+	return r; // 200 OK was sent with buffer
+}
+
+int MCS_forwardNodeCommand(struct MCS_Node* node, char* command) {
+	// the commands that are queued for the node are answered before
+	MCS_flushNodeCommands(node);
+
+	struct MCS_NodeResponse res;
+	int status = MCS_requestNode(node, command, &res);
+
+	free(res.buffer);
+
+	return status < 0 ? MCS_ERR_SERVER_ERROR : status;
+}
+
+struct MCS_Node* MCS_getItemNode(struct MCS_Context* mcc,
+		struct MCS_Item* item) {
+	int i;
+	for (i = 0; i < mcc->numNodes; i++) {
+		if (mcc->nodes[i].dir == item->dir)
+			return &mcc->nodes[i];
+	}
+
+	return NULL;
+}
+
+void MCS_handleNodeEvents(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds) {
+	int i, j;
+	for (i = 0; i < numFds; i++) {
+		if (fds[i].revents == 0)
+			continue;
+
+		struct MCS_Node* node = NULL;
+
+		for (j = 0; j < mcc->numNodes; j++) {
+			node = &mcc->nodes[j];
+
+			if (node->events == fds[i].fd || node->check.fd == fds[i].fd
+					|| node->command.fd == fds[i].fd
+					|| node->subscribe.fd == fds[i].fd) {
+				break;
+			}
+		}
+
+		if (j == mcc->numNodes)
+			continue;
+
+		// a request that completes may open the next one with the socket of
+		// an event that follows, the requests ignore sockets that are not
+		// ready
+		if (node->check.fd == fds[i].fd) {
+			int r = MCS_advanceNodeRequest(node, &node->check);
+
+			if (r != 0)
+				MCS_handleNodeCheck(mcc, node, r);
+
+			continue;
+		}
+
+		if (node->command.fd == fds[i].fd) {
+			int r = MCS_advanceNodeRequest(node, &node->command);
+
+			if (r != 0)
+				MCS_handleNodeCommand(node, r);
+
+			continue;
+		}
+
+		if (node->subscribe.fd == fds[i].fd) {
+			struct MCS_NodeRequest* request = &node->subscribe;
+			int r = MCS_advanceNodeRequest(node, request);
+
+			if (r != 0) {
+				MCS_log(MCS_LOG_WARN, "Could not subscribe to node %s\n",
+						node->name);
+				MCS_closeNodeRequest(request);
+			} else if (MCS_getNodeRequestEvents(request) == POLLIN) {
+				node->events = request->fd;
+				node->lineLen = 0;
+				request->fd = -1;
+			}
+
+			continue;
+		}
+
+		int len = read(node->events, node->line + node->lineLen,
+				MCS_NODE_LINE - 1 - node->lineLen);
+
+		if (len < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+
+		if (len <= 0) {
+			MCS_closeNodeEvents(mcc, node);
+			continue;
+		}
+
+		node->lineLen += len;
+		node->line[node->lineLen] = '\0';
+
+		// the status line of SUBSCRIBE is skipped like unknown events
+		char* line = node->line;
+		char* end;
+
+		while ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			MCS_handleNodeLine(mcc, node, line);
+			line = end + 1;
+		}
+
+		// keep the incomplete line, a line that is too long is skipped
+		node->lineLen = node->line + node->lineLen - line;
+
+		if (node->lineLen == MCS_NODE_LINE - 1) {
+			node->lineLen = 0;
+		} else {
+			memmove(node->line, line, node->lineLen);
+		}
+	}
+}
+
+int MCS_handleNodeTimeouts(struct MCS_Context* mcc) {
+	if (mcc->numNodes == 0)
+		return -1;
+
+	long long now = MCS_getTime();
+	long long next = -1;
+
+	int i;
+	for (i = 0; i < mcc->numNodes; i++) {
+		struct MCS_Node* node = &mcc->nodes[i];
+
+		if (node->check.fd >= 0 && node->check.deadline <= now)
+			MCS_handleNodeCheck(mcc, node, -1);
+
+		if (node->command.fd >= 0 && node->command.deadline <= now)
+			MCS_handleNodeCommand(node, -1);
+
+		if (node->subscribe.fd >= 0 && node->subscribe.deadline <= now) {
+			MCS_log(MCS_LOG_WARN, "Could not subscribe to node %s\n",
+					node->name);
+			MCS_closeNodeRequest(&node->subscribe);
+		}
+
+		// the next check starts once the list is fetched
+		if (node->check.fd < 0 && node->deadline <= now)
+			MCS_refreshNode(mcc, node);
+
+		long long deadline = node->check.fd >= 0
+				? node->check.deadline : node->deadline;
+
+		if (node->command.fd >= 0 && node->command.deadline < deadline)
+			deadline = node->command.deadline;
+
+		if (node->subscribe.fd >= 0 && node->subscribe.deadline < deadline)
+			deadline = node->subscribe.deadline;
+
+		if (next < 0 || deadline < next)
+			next = deadline;
+	}
+
+	// poll timeout in ms until the next request of a node is due
+	return next <= now ? 0 : (int) ((next - now + 999) / 1000);
+}
+
+int MCS_isNodeName(char* name) {
+	return strncmp(name, MCS_NODE_PREFIX, strlen(MCS_NODE_PREFIX)) == 0;
+}
+
+int MCS_playNodeItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Node* node, struct MCS_Item* item) {
+	// a queue does not wait for every item of a node that is down
+	if (!node->up)
+		return MCS_ERR_SERVER_ERROR;
+
+	long long start = MCS_getTime();
+	unsigned int remoteID = ((struct MCS_NodeItem*) item)->remoteID;
+
+	char command[128];
+	snprintf(command, sizeof(command), "PLAY %u SESSION=%s", remoteID,
+			session->name);
+
+	int status = MCS_forwardNodeCommand(node, command);
+
+	if (status != MCS_ERR_OK)
+		return status;
+
+	session->node = node;
+	session->remoteID = remoteID;
+	session->playingItem = item;
+	mcc->changes++;
+
+	// there is no child to sample, only the duration is reported
+	memset(&session->usage, 0, sizeof(struct MCS_Usage));
+	session->usage.started = start;
+
+	MCS_notify(mcc, "PLAY %s %u", session->name, item->id);
+
+	return MCS_ERR_OK;
+}
+
+int MCS_pollNodes(struct MCS_Context* mcc, struct pollfd* fds) {
+	int numFds = 0;
+
+	int i;
+	for (i = 0; i < mcc->numNodes; i++) {
+		struct MCS_Node* node = &mcc->nodes[i];
+
+		numFds += MCS_pollNodeRequest(&node->check, fds + numFds);
+		numFds += MCS_pollNodeRequest(&node->command, fds + numFds);
+
+		// a node is subscribed to once
+		if (node->events < 0) {
+			numFds += MCS_pollNodeRequest(&node->subscribe, fds + numFds);
+			continue;
+		}
+
+		fds[numFds].fd = node->events;
+		fds[numFds].events = POLLIN;
+		fds[numFds].revents = 0;
+		numFds++;
+	}
+
+	return numFds;
+}
+
+int MCS_queueNodeCommand(struct MCS_Node* node, char* command) {
+	if (node->numCommands == MCS_NODE_COMMANDS
+			|| strlen(command) >= MCS_NODE_COMMAND_SIZE) {
+		MCS_log(MCS_LOG_WARN, "Could not forward %s to node %s\n", command,
+				node->name);
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	strcpy(node->commands[node->numCommands++], command);
+	MCS_sendNodeCommands(node);
+
+	return MCS_ERR_OK;
+}
+
+int MCS_refreshNode(struct MCS_Context* mcc, struct MCS_Node* node) {
+	node->deadline = MCS_getTime() + MCS_NODE_INTERVAL * 1000LL;
+
+	// the validator of STAT changes with the version of the list
+	char command[64];
+	snprintf(command, sizeof(command), "STAT ENC=BIN%s%s",
+			node->statTag[0] != '\0' ? " IF=" : "", node->statTag);
+
+	if (MCS_openNodeRequest(node, &node->check, command) < 0) {
+		MCS_backOffNode(node, node->up);
+		return -1;
+	}
+
+	return 0;
+}
+
+int MCS_stopNodeItem(struct MCS_Context* mcc, struct MCS_Session* session) {
+	char command[64];
+	snprintf(command, sizeof(command), "STOP SESSION=%s", session->name);
+
+	int status = MCS_queueNodeCommand(session->node, command);
+
+	MCS_notify(mcc, "STOP %s %u", session->name,
+			session->playingItem ? session->playingItem->id : 0);
+
+	// the item is stopped here even if the node can't be reached
+	MCS_stopUsage(&session->usage, MCS_getTime());
+
+	session->node = NULL;
+	session->remoteID = 0;
+	session->playingItem = NULL;
+	session->keys.numKeys = 0;
+	mcc->changes++;
+
+	return status == MCS_ERR_OK ? MCS_ERR_OK : MCS_ERR_SERVER_ERROR;
+}
@@ -0,0 +1,33 @@
+#ifndef MCS_FED_H
+#define MCS_FED_H
+
+#include "mcs.h"
+
+// an item of a node, allocated in one block so that it is freed like the
+// local items
+struct MCS_NodeItem {
+	struct MCS_Item item;
+	unsigned int remoteID; // ID of the item on the node
+};
+
+void MCS_attachNodes(struct MCS_Context* mcc);
+void MCS_closeNodes(struct MCS_Context* mcc);
+int MCS_forwardArt(struct MCS_Context* mcc, struct MCS_Item* item,
+		struct MCS_Request* req);
+int MCS_forwardInfo(struct MCS_Context* mcc, struct MCS_Item* item,
+		struct MCS_Request* req);
+int MCS_forwardNodeCommand(struct MCS_Node* node, char* command);
+struct MCS_Node* MCS_getItemNode(struct MCS_Context* mcc,
+		struct MCS_Item* item);
+void MCS_handleNodeEvents(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds);
+int MCS_handleNodeTimeouts(struct MCS_Context* mcc);
+int MCS_isNodeName(char* name);
+int MCS_playNodeItem(struct MCS_Context* mcc, struct MCS_Session* session,
+		struct MCS_Node* node, struct MCS_Item* item);
+int MCS_pollNodes(struct MCS_Context* mcc, struct pollfd* fds);
+int MCS_queueNodeCommand(struct MCS_Node* node, char* command);
+int MCS_refreshNode(struct MCS_Context* mcc, struct MCS_Node* node);
+int MCS_stopNodeItem(struct MCS_Context* mcc, struct MCS_Session* session);
+
+#endif
@@ -0,0 +1,380 @@
+#include "mcs_index.h"
+#include "mcs_log.h"
+#include "mcs_tree.h"
+
+#ifdef MCS_CONTENT_ID
+// content IDs are above the inode based IDs (see sax_hash), so the two
+// modes never share an ID
+#define MCS_CONTENT_ID_BASE (2U * MCS_HASH_SIZE)
+#define MCS_CONTENT_ID_RANGE (0x7FFFFFFFU - MCS_CONTENT_ID_BASE)
+
+#define MCS_INDEX_MAGIC 0x4D435349 // "MCSI"
+
+// the work of the ID threads, items are taken in order through next
+struct MCS_IDWork {
+	struct MCS_Context* mcc;
+	struct MCS_Index* index;
+	struct MCS_IndexEntry* entries; // one per item
+	int next;
+	int hits;
+};
+
+// an item in the order in which copies of a file get their IDs
+struct MCS_IDOrder {
+	unsigned int id;
+	int item;
+	char* path; // relative to the configured directory, only of copies
+};
+
+static int MCS_compareIDOrder(const void* a, const void* b) {
+	const struct MCS_IDOrder* x = (const struct MCS_IDOrder*) a;
+	const struct MCS_IDOrder* y = (const struct MCS_IDOrder*) b;
+
+	if (x->id != y->id)
+		return x->id < y->id ? -1 : 1;
+
+	if (x->path != NULL && y->path != NULL) {
+		int r = strcmp(x->path, y->path);
+
+		if (r != 0)
+			return r;
+	}
+
+	// the same path in two configured directories, in the order of the
+	// arguments
+	return x->item - y->item;
+}
+
+// returns the path of the item below its configured directory, which
+// stays the same when the library moves to another disk
+static char* MCS_getRelativePath(struct MCS_Item* item) {
+	char filepath[MCS_PATH_SIZE];
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0)
+		return strdup(item->label);
+
+	struct MCS_Dir* top = item->dir;
+
+	while (top->parent != NULL && top->parent->parent != NULL)
+		top = top->parent;
+
+	int len = strlen(top->name);
+
+	if (len > 0 && top->name[len - 1] != '/')
+		len++;
+
+	return strdup(filepath + len);
+}
+
+static unsigned int MCS_hashIndex(unsigned long long dev,
+		unsigned long long ino) {
+	unsigned long long h = (dev * 0x9E3779B97F4A7C15ULL) ^ ino;
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ULL;
+
+	return (unsigned int) (h ^ (h >> 32));
+}
+
+static void* MCS_runIDThread(void* arg) {
+	struct MCS_IDWork* work = (struct MCS_IDWork*) arg;
+	struct MCS_Context* mcc = work->mcc;
+
+	char filepath[MCS_PATH_SIZE];
+	struct stat st;
+
+	int i;
+	while ((i = __sync_fetch_and_add(&work->next, 1)) < mcc->size) {
+		struct MCS_Item* item = mcc->items[i];
+		struct MCS_IndexEntry* entry = &work->entries[i];
+
+		// the inode based ID is kept if the file can't be read
+		entry->id = item->id;
+
+		if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0
+				|| stat(filepath, &st) < 0)
+			continue;
+
+		entry->dev = st.st_dev;
+		entry->ino = st.st_ino;
+		entry->mtime = st.st_mtime;
+		entry->size = st.st_size;
+
+		// unchanged files are not read again
+		struct MCS_IndexEntry* cached = MCS_lookupIndex(work->index, &st);
+
+		if (cached != NULL) {
+			entry->id = cached->id;
+			__sync_fetch_and_add(&work->hits, 1);
+			continue;
+		}
+
+		int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0)
+			continue;
+
+		entry->id = MCS_getContentID(fd, st.st_size);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+void MCS_assignContentIDs(struct MCS_Context* mcc) {
+	if (mcc->size == 0)
+		return;
+
+	long long start = MCS_getTime();
+
+	struct MCS_Index index;
+	MCS_loadIndex(&index, MCS_INDEX_FILE);
+
+	struct MCS_IDWork work;
+	memset(&work, 0, sizeof(work));
+	work.mcc = mcc;
+	work.index = &index;
+	work.entries = (struct MCS_IndexEntry*) malloc(mcc->size
+			* sizeof(struct MCS_IndexEntry));
+	memset(work.entries, 0, mcc->size * sizeof(struct MCS_IndexEntry));
+
+	// the files are read in parallel, most of the time is spent waiting
+	// for the drive
+	pthread_t threads[MCS_ID_THREADS];
+	int numThreads = 0;
+
+	int i;
+	for (i = 0; i < MCS_ID_THREADS; i++) {
+		if (pthread_create(&threads[numThreads], NULL, MCS_runIDThread,
+				&work) == 0) {
+			numThreads++;
+		}
+	}
+
+	// without threads the IDs are computed here
+	if (numThreads == 0)
+		MCS_runIDThread(&work);
+
+	for (i = 0; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// copies of a file have the same content. the copies get the next free
+	// IDs in the order of their relative paths, not in the order of the
+	// scan, which changes with the directory entries of a new disk. the
+	// index keeps the IDs stable afterwards
+	struct MCS_IDOrder* order = (struct MCS_IDOrder*) malloc(mcc->size
+			* sizeof(struct MCS_IDOrder));
+
+	for (i = 0; i < mcc->size; i++) {
+		order[i].id = work.entries[i].id;
+		order[i].item = i;
+		order[i].path = NULL;
+	}
+
+	qsort(order, mcc->size, sizeof(struct MCS_IDOrder), MCS_compareIDOrder);
+
+	int first, last;
+	for (first = 0; first < mcc->size; first = last) {
+		for (last = first + 1; last < mcc->size
+				&& order[last].id == order[first].id; last++);
+
+		if (last - first == 1)
+			continue;
+
+		int j;
+		for (j = first; j < last; j++) {
+			order[j].path = MCS_getRelativePath(mcc->items[order[j].item]);
+		}
+
+		qsort(order + first, last - first, sizeof(struct MCS_IDOrder),
+				MCS_compareIDOrder);
+	}
+
+	int tableSize = 1;
+
+	while (tableSize < 2 * mcc->size)
+		tableSize <<= 1;
+
+	unsigned int* ids = (unsigned int*) malloc(tableSize
+			* sizeof(unsigned int));
+	memset(ids, 0, tableSize * sizeof(unsigned int));
+
+	for (i = 0; i < mcc->size; i++) {
+		int item = order[i].item;
+		unsigned int id = order[i].id;
+		unsigned int h = id & (tableSize - 1);
+
+		while (ids[h] != 0) {
+			if (ids[h] == id) {
+				id = id + 1 < MCS_CONTENT_ID_BASE + MCS_CONTENT_ID_RANGE
+						? id + 1 : MCS_CONTENT_ID_BASE;
+				h = id & (tableSize - 1);
+				continue;
+			}
+
+			h = (h + 1) & (tableSize - 1);
+		}
+
+		ids[h] = id;
+		work.entries[item].id = id;
+		mcc->items[item]->id = id;
+
+		free(order[i].path);
+	}
+
+	free(ids);
+	free(order);
+
+	// the index only holds the files of this scan
+	MCS_saveIndex(work.entries, mcc->size, MCS_INDEX_FILE);
+
+	MCS_log(MCS_LOG_INFO, "Content IDs: %d of %d from the index (%lld us)\n",
+			work.hits, mcc->size, MCS_getTime() - start);
+
+	free(work.entries);
+	MCS_freeIndex(&index);
+}
+
+void MCS_freeIndex(struct MCS_Index* index) {
+	free(index->entries);
+	free(index->table);
+}
+
+unsigned int MCS_getContentID(int fd, long long size) {
+	// FNV-1a over the size and a few blocks spread over the file
+	unsigned long long h = 0xCBF29CE484222325ULL;
+
+	int i;
+	for (i = 0; i < 8; i++) {
+		h ^= (size >> (i * 8)) & 0xFF;
+		h *= 0x100000001B3ULL;
+	}
+
+	char block[MCS_ID_BLOCK_SIZE];
+
+	for (i = 0; i < MCS_ID_SAMPLES; i++) {
+		long long offset = 0;
+
+		if (MCS_ID_SAMPLES > 1 && size > MCS_ID_BLOCK_SIZE) {
+			offset = (size - MCS_ID_BLOCK_SIZE) * i / (MCS_ID_SAMPLES - 1);
+		}
+
+		int len = pread(fd, block, MCS_ID_BLOCK_SIZE, offset);
+
+		int j;
+		for (j = 0; j < len; j++) {
+			h ^= (unsigned char) block[j];
+			h *= 0x100000001B3ULL;
+		}
+
+		if (size <= MCS_ID_BLOCK_SIZE)
+			break;
+	}
+
+	return MCS_CONTENT_ID_BASE + (unsigned int) (h % MCS_CONTENT_ID_RANGE);
+}
+
+int MCS_loadIndex(struct MCS_Index* index, char* path) {
+	memset(index, 0, sizeof(struct MCS_Index));
+
+	FILE* file = fopen(path, "rb");
+
+	if (file == NULL)
+		return -1;
+
+	unsigned int header[2];
+
+	if (fread(header, sizeof(header), 1, file) != 1
+			|| header[0] != MCS_INDEX_MAGIC || header[1] > MCS_MAX_ITEMS) {
+		MCS_log(MCS_LOG_ERROR, "MCS_loadIndex: Invalid index %s\n", path);
+		fclose(file);
+		return -1;
+	}
+
+	index->entries = (struct MCS_IndexEntry*) malloc(header[1]
+			* sizeof(struct MCS_IndexEntry));
+	index->size = fread(index->entries, sizeof(struct MCS_IndexEntry),
+			header[1], file);
+
+	fclose(file);
+
+	index->tableSize = 1;
+
+	while (index->tableSize < 2 * index->size)
+		index->tableSize <<= 1;
+
+	index->table = (int*) malloc(index->tableSize * sizeof(int));
+	memset(index->table, -1, index->tableSize * sizeof(int));
+
+	int i;
+	for (i = 0; i < index->size; i++) {
+		struct MCS_IndexEntry* entry = &index->entries[i];
+		unsigned int h = MCS_hashIndex(entry->dev, entry->ino)
+				& (index->tableSize - 1);
+
+		while (index->table[h] >= 0)
+			h = (h + 1) & (index->tableSize - 1);
+
+		index->table[h] = i;
+	}
+
+	return 0;
+}
+
+struct MCS_IndexEntry* MCS_lookupIndex(struct MCS_Index* index,
+		struct stat* st) {
+	if (index->size == 0)
+		return NULL;
+
+	unsigned int h = MCS_hashIndex(st->st_dev, st->st_ino)
+			& (index->tableSize - 1);
+
+	while (index->table[h] >= 0) {
+		struct MCS_IndexEntry* entry = &index->entries[index->table[h]];
+
+		if (entry->dev == st->st_dev && entry->ino == st->st_ino) {
+			if (entry->mtime == st->st_mtime && entry->size == st->st_size)
+				return entry;
+
+			return NULL; // the file has changed
+		}
+
+		h = (h + 1) & (index->tableSize - 1);
+	}
+
+	return NULL;
+}
+
+int MCS_saveIndex(struct MCS_IndexEntry* entries, int numEntries,
+		char* path) {
+	// the index is replaced at once, a crash leaves the old index
+	char tmppath[MCS_PATH_SIZE];
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+	FILE* file = fopen(tmppath, "wb");
+
+	if (file == NULL) {
+		MCS_log(MCS_LOG_ERROR, "MCS_saveIndex: Can't write %s\n", tmppath);
+		return -1;
+	}
+
+	unsigned int header[2] = { MCS_INDEX_MAGIC, numEntries };
+
+	if (fwrite(header, sizeof(header), 1, file) != 1
+			|| fwrite(entries, sizeof(struct MCS_IndexEntry), numEntries,
+			file) != (size_t) numEntries) {
+		MCS_log(MCS_LOG_ERROR, "MCS_saveIndex: Error writing %s\n", tmppath);
+		fclose(file);
+		unlink(tmppath);
+		return -1;
+	}
+
+	if (fclose(file) != 0 || rename(tmppath, path) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_saveIndex: Error writing %s\n", path);
+		unlink(tmppath);
+		return -1;
+	}
+
+	return 0;
+}
+#endif
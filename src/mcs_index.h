@@ -0,0 +1,38 @@
+#ifndef MCS_INDEX_H
+#define MCS_INDEX_H
+
+#include "mcs.h"
+
+#ifdef MCS_CONTENT_ID
+#include <pthread.h>
+
+// the ID of an item file, the file is identified by (dev, ino) and is
+// unchanged as long as mtime and size are the same
+struct MCS_IndexEntry {
+	unsigned long long dev;
+	unsigned long long ino;
+	long long mtime;
+	long long size;
+	unsigned int id;
+};
+
+// persistent index, the entries are looked up through an open addressing
+// hash table
+struct MCS_Index {
+	struct MCS_IndexEntry* entries;
+	int size;
+	int* table; // entry index, -1 if empty
+	int tableSize; // power of 2
+};
+
+void MCS_assignContentIDs(struct MCS_Context* mcc);
+void MCS_freeIndex(struct MCS_Index* index);
+unsigned int MCS_getContentID(int fd, long long size);
+int MCS_loadIndex(struct MCS_Index* index, char* path);
+struct MCS_IndexEntry* MCS_lookupIndex(struct MCS_Index* index,
+		struct stat* st);
+int MCS_saveIndex(struct MCS_IndexEntry* entries, int numEntries,
+		char* path);
+#endif
+
+#endif
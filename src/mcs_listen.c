@@ -0,0 +1,276 @@
+#include "mcs_listen.h"
+#include "mcs_log.h"
+
+// endpoints the server accepts clients on. the address is "unix:path" for a
+// Unix domain socket, otherwise an IPv4 or IPv6 address. port 0 is the
+// port of the server (MCS_PORT)
+static const struct {
+	char* address;
+	int port;
+	int backlog;
+} MCS_listeners[] = {
+	{ "0.0.0.0", 0, MCS_BACKLOG },
+	{ "::", 0, MCS_BACKLOG },
+#ifdef MCS_UNIX_SOCKET
+	{ "unix:" MCS_UNIX_SOCKET, 0, MCS_BACKLOG }
+#endif
+};
+
+#define MCS_NUM_LISTENERS (sizeof(MCS_listeners) / sizeof(MCS_listeners[0]))
+
+int MCS_acceptClient(struct MCS_Context* mcc, int listenSocket) {
+	int clientSocket = MCS_acceptSocket(listenSocket);
+
+	if (clientSocket < 0)
+		return -1;
+
+	if (!MCS_handleRequest(mcc, clientSocket))
+		return MCS_closeClient(clientSocket);
+
+	return 0;
+}
+
+// returns the socket of the next client of the endpoint, -1 if there is none
+int MCS_acceptSocket(int listenSocket) {
+	struct sockaddr_storage clientAddress;
+
+	socklen_t clen = sizeof(clientAddress);
+	int clientSocket = accept4(listenSocket,
+			(struct sockaddr*) &clientAddress, &clen, SOCK_CLOEXEC);
+
+	if (clientSocket < 0) {
+		// the Unix domain socket is shared by the workers, another worker
+		// accepted the client
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_acceptSocket: Error accepting connection.\n");
+		}
+
+		return -1;
+	}
+
+	char name[INET6_ADDRSTRLEN] = "local";
+
+	if (clientAddress.ss_family == AF_INET) {
+		inet_ntop(AF_INET, &((struct sockaddr_in*) &clientAddress)->sin_addr,
+				name, sizeof(name));
+	} else if (clientAddress.ss_family == AF_INET6) {
+		inet_ntop(AF_INET6,
+				&((struct sockaddr_in6*) &clientAddress)->sin6_addr, name,
+				sizeof(name));
+	}
+
+	MCS_log(MCS_LOG_INFO, "Handling client %s\n", name);
+
+	return clientSocket;
+}
+
+// opens the TCP endpoints of the main loop again for a worker, the kernel
+// spreads the clients over the sockets of an endpoint (SO_REUSEPORT). Unix
+// domain sockets can't be spread, the workers share the one of the main loop
+void MCS_cloneListeners(struct MCS_Context* mcc, int* listeners) {
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		listeners[i] = mcc->listeners[i];
+
+		if (listeners[i] < 0
+				|| strncmp(MCS_listeners[i].address, "unix:", 5) == 0)
+			continue;
+
+		// the port of the main loop, in case it was chosen by the kernel
+		struct sockaddr_storage storage;
+		socklen_t len = sizeof(storage);
+
+		if (getsockname(mcc->listeners[i], (struct sockaddr*) &storage,
+				&len) < 0) {
+			listeners[i] = -1;
+			continue;
+		}
+
+		int port = ntohs(storage.ss_family == AF_INET6
+				? ((struct sockaddr_in6*) &storage)->sin6_port
+				: ((struct sockaddr_in*) &storage)->sin_port);
+
+		listeners[i] = MCS_openListener(MCS_listeners[i].address, port,
+				MCS_listeners[i].backlog, 1);
+	}
+}
+
+int MCS_closeClient(int clientSocket) {
+	// the sockets are closed on exec, so the player does not hold a
+	// copy of the file descriptor. shutdown will definitely mark the
+	// socket as closed anyway.
+	// SOURCE: http://docstore.mik.ua/orelly/perl/cookbook/ch17_10.htm
+	// a client that reset the connection (i.e. in the middle of ART) is
+	// gone already
+	if (shutdown(clientSocket, 2) < 0 && errno != ENOTCONN) {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_closeClient: Error closing client socket.\n");
+		close(clientSocket);
+		return -1;
+	}
+
+	close(clientSocket);
+	return 0;
+}
+
+// closes the sockets of MCS_cloneListeners
+void MCS_closeClones(struct MCS_Context* mcc, int* listeners) {
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		if (listeners[i] >= 0 && listeners[i] != mcc->listeners[i])
+			close(listeners[i]);
+
+		listeners[i] = -1;
+	}
+}
+
+void MCS_closeListeners(struct MCS_Context* mcc) {
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		if (mcc->listeners[i] < 0)
+			continue;
+
+		close(mcc->listeners[i]);
+		mcc->listeners[i] = -1;
+
+		if (strncmp(MCS_listeners[i].address, "unix:", 5) == 0) {
+			unlink(MCS_listeners[i].address + 5);
+		}
+	}
+}
+
+// with reusePort other sockets can be opened on the same endpoint, see
+// MCS_cloneListeners
+int MCS_openListener(char* address, int port, int backlog, int reusePort) {
+	struct sockaddr_storage storage;
+	memset(&storage, 0, sizeof(storage));
+
+	socklen_t len;
+
+	if (strncmp(address, "unix:", 5) == 0) {
+		struct sockaddr_un* sun = (struct sockaddr_un*) &storage;
+		char* path = address + 5;
+
+		if (strlen(path) >= sizeof(sun->sun_path)) {
+			MCS_log(MCS_LOG_ERROR, "MCS_openListener: Path too long. %s\n",
+					path);
+			return -1;
+		}
+
+		sun->sun_family = AF_UNIX;
+		strcpy(sun->sun_path, path);
+		len = sizeof(struct sockaddr_un);
+
+		// remove the socket of a previous run, but nothing else
+		struct stat st;
+
+		if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+			unlink(path);
+		}
+	} else if (strchr(address, ':') != NULL) {
+		struct sockaddr_in6* sin6 = (struct sockaddr_in6*) &storage;
+
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		len = sizeof(struct sockaddr_in6);
+
+		if (inet_pton(AF_INET6, address, &sin6->sin6_addr) != 1) {
+			MCS_log(MCS_LOG_ERROR, "MCS_openListener: Invalid address. %s\n",
+					address);
+			return -1;
+		}
+	} else {
+		struct sockaddr_in* sin = (struct sockaddr_in*) &storage;
+
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		len = sizeof(struct sockaddr_in);
+
+		if (inet_pton(AF_INET, address, &sin->sin_addr) != 1) {
+			MCS_log(MCS_LOG_ERROR, "MCS_openListener: Invalid address. %s\n",
+					address);
+			return -1;
+		}
+	}
+
+	int listenSocket = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC,
+			0);
+
+	if (listenSocket < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_openListener: Error opening socket. %s\n",
+				address);
+		return -1;
+	}
+
+	int on = 1;
+
+	// a restarted server can bind right away, even while connections of
+	// the previous one are in TIME_WAIT
+	if (storage.ss_family != AF_UNIX) {
+		setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	}
+
+	if (storage.ss_family != AF_UNIX && reusePort) {
+		setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	}
+
+	// a shared socket is polled by several threads, the ones that don't get
+	// the client must not block in accept
+	if (storage.ss_family == AF_UNIX && reusePort) {
+		fcntl(listenSocket, F_SETFL, O_NONBLOCK);
+	}
+
+	// IPv4 clients are accepted by the IPv4 endpoints
+	if (storage.ss_family == AF_INET6) {
+		setsockopt(listenSocket, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+	}
+
+	if (bind(listenSocket, (struct sockaddr*) &storage, len) < 0
+			|| listen(listenSocket, backlog) < 0) {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_openListener: Error binding to %s port %d\n", address,
+				port);
+		close(listenSocket);
+		return -1;
+	}
+
+	return listenSocket;
+}
+
+// reusePort if the endpoints are shared with workers
+int MCS_openListeners(struct MCS_Context* mcc, int reusePort) {
+	int numOpen = 0;
+
+	mcc->numListeners = MCS_NUM_LISTENERS;
+
+	if (mcc->numListeners > MCS_MAX_LISTENERS) {
+		MCS_log(MCS_LOG_ERROR, "MCS_openListeners: Too many endpoints\n");
+		mcc->numListeners = MCS_MAX_LISTENERS;
+	}
+
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		int port = MCS_listeners[i].port > 0 ? MCS_listeners[i].port
+				: mcc->port;
+
+		// an endpoint that can't be opened (i.e. no IPv6) is skipped
+		mcc->listeners[i] = MCS_openListener(MCS_listeners[i].address, port,
+				MCS_listeners[i].backlog, reusePort);
+
+		if (mcc->listeners[i] < 0)
+			continue;
+
+		if (strncmp(MCS_listeners[i].address, "unix:", 5) == 0) {
+			MCS_log(MCS_LOG_INFO, "Listening on %s\n",
+					MCS_listeners[i].address);
+		} else {
+			MCS_log(MCS_LOG_INFO, "Listening on %s port %d\n",
+					MCS_listeners[i].address, port);
+		}
+
+		numOpen++;
+	}
+
+	return numOpen;
+}
@@ -0,0 +1,18 @@
+#ifndef MCS_LISTEN_H
+#define MCS_LISTEN_H
+
+#include "mcs.h"
+
+#include <netinet/in.h>
+#include <sys/un.h>
+
+int MCS_acceptClient(struct MCS_Context* mcc, int listenSocket);
+int MCS_acceptSocket(int listenSocket);
+void MCS_cloneListeners(struct MCS_Context* mcc, int* listeners);
+int MCS_closeClient(int clientSocket);
+void MCS_closeClones(struct MCS_Context* mcc, int* listeners);
+void MCS_closeListeners(struct MCS_Context* mcc);
+int MCS_openListener(char* address, int port, int backlog, int reusePort);
+int MCS_openListeners(struct MCS_Context* mcc, int reusePort);
+
+#endif
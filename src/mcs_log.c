@@ -0,0 +1,255 @@
+#include "mcs_log.h"
+#include "mcs_enc.h"
+
+#include <stdarg.h>
+
+// log records are formatted by the thread that logs into a slot of a ring
+// buffer and written to stdout by the log thread, so a slow stdout (a pipe
+// or a file on an SD card) does not delay requests. a slot is free when its
+// sequence number is the position of the next record that may use it and
+// full when it is the position + 1. if the ring is full the record is
+// dropped
+
+struct MCS_LogRecord {
+	unsigned int seq;
+	int level;
+	int len;
+	char text[MCS_LOG_RECORD_SIZE];
+};
+
+static struct MCS_LogRecord MCS_logRing[MCS_LOG_RECORDS];
+static unsigned int MCS_logHead; // next position to fill
+static unsigned int MCS_logTail; // next position to write, log thread only
+
+static int MCS_logLevel = MCS_LOG_LEVEL;
+static unsigned long MCS_logRecords;
+static unsigned long MCS_logDropped;
+
+static pthread_t MCS_logThread;
+static int MCS_logRunning; // records are written by the log thread
+static int MCS_logStopping;
+
+static const char* MCS_logLevels[] = { "error", "warn", "info", "debug" };
+
+static void* MCS_runLogThread(void* arg) {
+	(void) arg;
+	unsigned long reported = 0;
+
+	while (1) {
+		// the records that are full are written in one call
+		struct iovec iov[MCS_LOG_BATCH];
+		int n = 0;
+
+		while (n < MCS_LOG_BATCH) {
+			unsigned int pos = MCS_logTail + n;
+			struct MCS_LogRecord* record =
+					&MCS_logRing[pos & (MCS_LOG_RECORDS - 1)];
+
+			if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != pos + 1)
+				break;
+
+			iov[n].iov_base = record->text;
+			iov[n].iov_len = record->len;
+			n++;
+		}
+
+		if (n > 0) {
+			// nobody to tell if stdout fails
+			if (writev(STDOUT_FILENO, iov, n) < 0) {}
+
+			int i;
+			for (i = 0; i < n; i++) {
+				unsigned int pos = MCS_logTail + i;
+
+				__atomic_store_n(&MCS_logRing[pos & (MCS_LOG_RECORDS - 1)].seq,
+						pos + MCS_LOG_RECORDS, __ATOMIC_RELEASE);
+			}
+
+			MCS_logTail += n;
+		}
+
+		unsigned long dropped = __atomic_load_n(&MCS_logDropped,
+				__ATOMIC_RELAXED);
+
+		if (dropped != reported) {
+			dprintf(STDOUT_FILENO, "MCS_log: Dropped %lu records\n",
+					dropped - reported);
+			reported = dropped;
+		}
+
+		if (n > 0)
+			continue;
+
+		if (__atomic_load_n(&MCS_logStopping, __ATOMIC_ACQUIRE))
+			break;
+
+		struct timespec delay = { 0, MCS_LOG_INTERVAL * 1000000L };
+		nanosleep(&delay, NULL);
+	}
+
+	return NULL;
+}
+
+unsigned long MCS_getLogDropped() {
+	return __atomic_load_n(&MCS_logDropped, __ATOMIC_RELAXED);
+}
+
+int MCS_getLogLevel() {
+	return __atomic_load_n(&MCS_logLevel, __ATOMIC_RELAXED);
+}
+
+unsigned long MCS_getLogRecords() {
+	return __atomic_load_n(&MCS_logRecords, __ATOMIC_RELAXED);
+}
+
+void MCS_log(int level, const char* format, ...) {
+	if (level > __atomic_load_n(&MCS_logLevel, __ATOMIC_RELAXED))
+		return;
+
+	va_list args;
+	va_start(args, format);
+
+	// without the log thread the record is written right away
+	if (!__atomic_load_n(&MCS_logRunning, __ATOMIC_ACQUIRE)) {
+		vdprintf(STDOUT_FILENO, format, args);
+		va_end(args);
+		return;
+	}
+
+	// claim the slot at the head
+	unsigned int pos = __atomic_load_n(&MCS_logHead, __ATOMIC_RELAXED);
+	struct MCS_LogRecord* record;
+
+	while (1) {
+		record = &MCS_logRing[pos & (MCS_LOG_RECORDS - 1)];
+		unsigned int seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+		int diff = (int) (seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&MCS_logHead, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_fetch_add(&MCS_logDropped, 1, __ATOMIC_RELAXED);
+			va_end(args);
+			return;
+		} else {
+			pos = __atomic_load_n(&MCS_logHead, __ATOMIC_RELAXED);
+		}
+	}
+
+	int len = vsnprintf(record->text, MCS_LOG_RECORD_SIZE, format, args);
+	va_end(args);
+
+	if (len < 0) {
+		len = 0;
+	} else if (len >= MCS_LOG_RECORD_SIZE) {
+		// mark the record as truncated
+		len = MCS_LOG_RECORD_SIZE - 1;
+		memcpy(record->text + len - 4, "...\n", 4);
+	}
+
+	record->level = level;
+	record->len = len;
+
+	__atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&MCS_logRecords, 1, __ATOMIC_RELAXED);
+}
+
+// returns the level of a name or number, -1 if there is no such level
+int MCS_parseLogLevel(char* name) {
+	int i;
+	for (i = 0; i <= MCS_LOG_DEBUG; i++) {
+		if (strcmp(name, MCS_logLevels[i]) == 0)
+			return i;
+	}
+
+	char* end;
+	long level = strtol(name, &end, 10);
+
+	if (end == name || *end != '\0' || level < MCS_LOG_ERROR
+			|| level > MCS_LOG_DEBUG)
+		return -1;
+
+	return level;
+}
+
+int MCS_sendLog(struct MCS_Request* req) {
+	char buffer[256];
+	int level = MCS_getLogLevel();
+	int len;
+
+	if (req->encoding == MCS_ENC_BIN) {
+		len = MCS_encLog(buffer, sizeof(buffer), level, MCS_getLogRecords(),
+				MCS_getLogDropped());
+		len += MCS_encEnd(buffer + len, sizeof(buffer) - len);
+	} else {
+		len = snprintf(buffer, sizeof(buffer),
+				"<mediacenter><log level=\"%s\" records=\"%lu\""
+				" dropped=\"%lu\"/></mediacenter>", MCS_logLevels[level],
+				MCS_getLogRecords(), MCS_getLogDropped());
+	}
+
+	if (len < 0 || len >= (int) sizeof(buffer)) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendLog: Failed to write to buffer\n");
+		return MCS_ERR_SERVER_ERROR;
+	}
+
+	return MCS_writeResponse(req, buffer, len); // 200 OK was sent
+}
+
+void MCS_setLogLevel(int level) {
+	__atomic_store_n(&MCS_logLevel, level, __ATOMIC_RELAXED);
+}
+
+int MCS_startLog() {
+	if (MCS_logRunning)
+		return 0;
+
+	unsigned int i;
+	for (i = 0; i < MCS_LOG_RECORDS; i++) {
+		MCS_logRing[i].seq = MCS_logHead + i;
+	}
+
+	MCS_logTail = MCS_logHead;
+	MCS_logStopping = 0;
+
+	// the thread inherits the signal mask. it blocks all signals, so that
+	// SIGCHLD is only received through the signalfd of the main loop
+	sigset_t mask;
+	sigset_t oldMask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &oldMask);
+
+	int r = pthread_create(&MCS_logThread, NULL, MCS_runLogThread, NULL);
+
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+	if (r != 0) {
+		MCS_log(MCS_LOG_WARN, "MCS_startLog: Failed to start the log thread\n");
+		return -1;
+	}
+
+	__atomic_store_n(&MCS_logRunning, 1, __ATOMIC_RELEASE);
+
+	// the records are also written if the server exits
+	static int registered = 0;
+
+	if (!registered) {
+		atexit(MCS_stopLog);
+		registered = 1;
+	}
+
+	return 0;
+}
+
+void MCS_stopLog() {
+	if (!MCS_logRunning)
+		return;
+
+	// the log thread writes the remaining records before it exits
+	__atomic_store_n(&MCS_logStopping, 1, __ATOMIC_RELEASE);
+	pthread_join(MCS_logThread, NULL);
+
+	__atomic_store_n(&MCS_logRunning, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,19 @@
+#ifndef MCS_LOG_H
+#define MCS_LOG_H
+
+#include "mcs.h"
+
+#include <pthread.h>
+
+unsigned long MCS_getLogDropped();
+int MCS_getLogLevel();
+unsigned long MCS_getLogRecords();
+void MCS_log(int level, const char* format, ...)
+		__attribute__((format(printf, 2, 3)));
+int MCS_parseLogLevel(char* name);
+int MCS_sendLog(struct MCS_Request* req);
+void MCS_setLogLevel(int level);
+int MCS_startLog();
+void MCS_stopLog();
+
+#endif
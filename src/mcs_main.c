@@ -0,0 +1,51 @@
+#include "mcs.h"
+#include "mcs_log.h"
+
+int main(int argc, char* argv[]) {
+	if (argc <= 1) {
+		MCS_log(MCS_LOG_ERROR, "Not enough arguments provided\n");
+		return -1;
+	}
+
+	// from now on the records are written by the log thread
+	MCS_startLog();
+
+	struct MCS_Context* mcc = MCS_createContext();
+
+	// SIGCHLD is blocked and received through a signalfd in the main loop
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+		MCS_log(MCS_LOG_ERROR, "Failed to block SIGCHLD\n");
+		exit(1);
+	}
+
+	mcc->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	if (mcc->sigfd < 0) {
+		MCS_log(MCS_LOG_ERROR, "Failed to create signalfd for SIGCHLD\n");
+		exit(1);
+	}
+
+	mcc->port = MCS_PORT;
+
+	mcc->numDirs = argc - 1;
+	mcc->dirs = (char**) malloc(mcc->numDirs * sizeof(char*));
+	memcpy(mcc->dirs, &argv[1], mcc->numDirs * sizeof(char*));
+
+	MCS_parseDirs(mcc);
+
+	MCS_log(MCS_LOG_INFO, "Items: %d/%d\n", mcc->size, mcc->capacity);
+#ifdef MCS_DEBUG
+	MCS_log(MCS_LOG_INFO, "Unique: %d\n", MCS_checkIDs(mcc->items, mcc->size));
+	MCS_log(MCS_LOG_INFO, "Alloc'd %ld bytes\n", MCS_getSize(mcc));
+#endif
+	MCS_runServer(mcc);
+
+	close(mcc->sigfd);
+	MCS_freeContext(mcc);
+
+	return 0;
+}
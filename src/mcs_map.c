@@ -0,0 +1,260 @@
+#include "mcs_map.h"
+#include "mcs_log.h"
+
+// the item list as a file that local clients map, so that they read the
+// library without a request and without parsing (see README, "Library
+// Map"). the server rewrites the file in place under a seqlock: seq is odd
+// while it writes, a reader that saw the same even seq before and after
+// reading has a consistent copy. the file only grows, so that the pages a
+// reader mapped stay valid
+
+// adds the type to the sorted types, returns the number of types or -1 if
+// there are too many. type 0 (all items) is the list of items itself
+static int MCS_addMapType(unsigned int* types, int numTypes,
+		unsigned int type) {
+	if (type == 0)
+		return numTypes;
+
+	int i;
+	for (i = 0; i < numTypes && types[i] < type; i++);
+
+	if (i < numTypes && types[i] == type)
+		return numTypes;
+
+	if (numTypes == MCS_MAP_MAX_TYPES)
+		return -1;
+
+	memmove(types + i + 1, types + i, (numTypes - i) * sizeof(unsigned int));
+	types[i] = type;
+
+	return numTypes + 1;
+}
+
+static void MCS_beginMapWrite(struct MCS_MapHeader* header) {
+	__atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void MCS_endMapWrite(struct MCS_MapHeader* header) {
+	header->generation++;
+	__atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELEASE);
+}
+
+// returns the position of the type, -1 if it is not in the map
+static int MCS_findMapType(unsigned int* types, int numTypes,
+		unsigned int type) {
+	int i;
+	for (i = 0; i < numTypes; i++) {
+		if (types[i] == type)
+			return i;
+	}
+
+	return -1;
+}
+
+static int MCS_growMap(struct MCS_Context* mcc, size_t size) {
+	if (size <= mcc->mapSize)
+		return 0;
+
+	// room for a few more items before the file grows again
+	long page = sysconf(_SC_PAGESIZE);
+	size_t newSize = (size + size / 4 + page - 1) / page * page;
+
+	if (ftruncate(mcc->mapfd, newSize) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_growMap: Error resizing %s\n",
+				mcc->mapPath);
+		return -1;
+	}
+
+	char* map = (char*) mmap(NULL, newSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED, mcc->mapfd, 0);
+
+	if (map == MAP_FAILED) {
+		MCS_log(MCS_LOG_ERROR, "MCS_growMap: Error mapping %s\n",
+				mcc->mapPath);
+		return -1;
+	}
+
+	if (mcc->map != NULL)
+		munmap(mcc->map, mcc->mapSize);
+
+	mcc->map = map;
+	mcc->mapSize = newSize;
+
+	return 0;
+}
+
+// readers that still map the file see that the server stopped
+void MCS_closeMap(struct MCS_Context* mcc) {
+	if (mcc->map == NULL)
+		return;
+
+	struct MCS_MapHeader* header = (struct MCS_MapHeader*) mcc->map;
+
+	MCS_beginMapWrite(header);
+	header->closed = 1;
+	MCS_endMapWrite(header);
+
+	munmap(mcc->map, mcc->mapSize);
+	close(mcc->mapfd);
+	unlink(mcc->mapPath);
+
+	mcc->map = NULL;
+	mcc->mapSize = 0;
+	mcc->mapfd = -1;
+}
+
+int MCS_openMap(struct MCS_Context* mcc, char* path) {
+	// a new file, the readers of a previous server keep theirs
+	unlink(path);
+
+	mcc->mapfd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	mcc->mapPath = path;
+
+	if (mcc->mapfd < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_openMap: Error creating %s\n", path);
+		return -1;
+	}
+
+	if (MCS_growMap(mcc, sizeof(struct MCS_MapHeader)) < 0) {
+		close(mcc->mapfd);
+		unlink(path);
+		mcc->mapfd = -1;
+		return -1;
+	}
+
+	// the file is filled with zeros, seq is even
+	struct MCS_MapHeader* header = (struct MCS_MapHeader*) mcc->map;
+	header->magic = MCS_MAP_MAGIC;
+	header->layout = MCS_MAP_LAYOUT;
+
+	MCS_publishMap(mcc);
+
+	MCS_log(MCS_LOG_INFO, "Publishing the library in %s\n", path);
+
+	return 0;
+}
+
+// writes the items, the index of every type and category, and the labels
+void MCS_publishMap(struct MCS_Context* mcc) {
+	if (mcc->map == NULL)
+		return;
+
+	unsigned int types[MCS_MAP_MAX_TYPES];
+	unsigned int next[MCS_MAP_MAX_TYPES];
+	int numTypes = 0;
+	int numLost = 0;
+	size_t labelsSize = 0;
+
+	// a category lists the items of its sub-categories too, like LIST
+	int i;
+	for (i = 0; i < mcc->size; i++) {
+		struct MCS_Item* item = mcc->items[i];
+		unsigned int base = item->type - (item->type % MCS_TYPE_BASE);
+
+		labelsSize += strlen(item->label) + 1;
+
+		int n = MCS_addMapType(types, numTypes, item->type);
+		numTypes = n < 0 ? numTypes : n;
+		numLost += n < 0;
+
+		n = MCS_addMapType(types, numTypes, base);
+		numTypes = n < 0 ? numTypes : n;
+		numLost += n < 0;
+	}
+
+	if (numLost > 0) {
+		MCS_log(MCS_LOG_WARN, "MCS_publishMap: Too many types, %d items "
+				"are not indexed\n", numLost);
+	}
+
+	memset(next, 0, sizeof(next));
+
+	for (i = 0; i < mcc->size; i++) {
+		struct MCS_Item* item = mcc->items[i];
+		unsigned int base = item->type - (item->type % MCS_TYPE_BASE);
+
+		int t = MCS_findMapType(types, numTypes, item->type);
+		int b = MCS_findMapType(types, numTypes, base);
+
+		if (t >= 0)
+			next[t]++;
+
+		if (b >= 0 && b != t)
+			next[b]++;
+	}
+
+	// next is the position of the next item of a type in the index
+	size_t numIndex = 0;
+
+	for (i = 0; i < numTypes; i++) {
+		unsigned int count = next[i];
+
+		next[i] = numIndex;
+		numIndex += count;
+	}
+
+	size_t itemsOffset = sizeof(struct MCS_MapHeader);
+	size_t typesOffset = itemsOffset + mcc->size * sizeof(struct MCS_MapItem);
+	size_t indexOffset = typesOffset + numTypes * sizeof(struct MCS_MapType);
+	size_t labelsOffset = indexOffset + numIndex * sizeof(unsigned int);
+	size_t size = labelsOffset + labelsSize;
+
+	if (MCS_growMap(mcc, size) < 0)
+		return;
+
+	struct MCS_MapHeader* header = (struct MCS_MapHeader*) mcc->map;
+	struct MCS_MapItem* items = (struct MCS_MapItem*) (mcc->map + itemsOffset);
+	struct MCS_MapType* mapTypes = (struct MCS_MapType*) (mcc->map
+			+ typesOffset);
+	unsigned int* index = (unsigned int*) (mcc->map + indexOffset);
+	char* labels = mcc->map + labelsOffset;
+
+	MCS_beginMapWrite(header);
+
+	for (i = 0; i < numTypes; i++) {
+		mapTypes[i].type = types[i];
+		mapTypes[i].first = next[i];
+		mapTypes[i].count = 0;
+	}
+
+	size_t label = 0;
+
+	for (i = 0; i < mcc->size; i++) {
+		struct MCS_Item* item = mcc->items[i];
+		unsigned int base = item->type - (item->type % MCS_TYPE_BASE);
+		int len = strlen(item->label) + 1;
+
+		items[i].id = item->id;
+		items[i].type = item->type;
+		items[i].dir = item->dir->id;
+		items[i].label = label;
+
+		memcpy(labels + label, item->label, len);
+		label += len;
+
+		int t = MCS_findMapType(types, numTypes, item->type);
+		int b = MCS_findMapType(types, numTypes, base);
+
+		if (t >= 0)
+			index[next[t]++] = i;
+
+		if (b >= 0 && b != t)
+			index[next[b]++] = i;
+	}
+
+	for (i = 0; i < numTypes; i++) {
+		mapTypes[i].count = next[i] - mapTypes[i].first;
+	}
+
+	header->version = mcc->version;
+	header->size = size;
+	header->numItems = mcc->size;
+	header->numTypes = numTypes;
+	header->itemsOffset = itemsOffset;
+	header->typesOffset = typesOffset;
+	header->indexOffset = indexOffset;
+	header->labelsOffset = labelsOffset;
+
+	MCS_endMapWrite(header);
+}
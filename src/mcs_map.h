@@ -0,0 +1,49 @@
+#ifndef MCS_MAP_H
+#define MCS_MAP_H
+
+#include "mcs.h"
+
+#include <sys/mman.h> // mmap
+
+// the library map, a file that local clients map read-only (see README,
+// "Library Map"). all integers are u32 in the byte order of the host
+#define MCS_MAP_MAGIC 0x4D43534D // "MCSM"
+#define MCS_MAP_LAYOUT 1
+#define MCS_MAP_MAX_TYPES 64
+
+struct MCS_MapHeader {
+	unsigned int magic;
+	unsigned int layout;
+	unsigned int seq; // odd while the server writes
+	unsigned int generation; // incremented by every write
+	unsigned int closed; // 1 once the server stopped
+	unsigned int version; // version of the item list, as in LIST
+	unsigned int size; // bytes in use, the file may be larger
+	unsigned int numItems;
+	unsigned int numTypes;
+	unsigned int itemsOffset;
+	unsigned int typesOffset;
+	unsigned int indexOffset;
+	unsigned int labelsOffset;
+	unsigned int reserved[3];
+};
+
+struct MCS_MapItem {
+	unsigned int id;
+	unsigned int type;
+	unsigned int dir; // ID of the directory, as in BROWSE-DIR
+	unsigned int label; // offset of the label from labelsOffset
+};
+
+// the items LIST would return for the type, as indexes into the items
+struct MCS_MapType {
+	unsigned int type;
+	unsigned int first; // position in the index
+	unsigned int count;
+};
+
+void MCS_closeMap(struct MCS_Context* mcc);
+int MCS_openMap(struct MCS_Context* mcc, char* path);
+void MCS_publishMap(struct MCS_Context* mcc);
+
+#endif
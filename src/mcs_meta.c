@@ -0,0 +1,764 @@
+#include "mcs_meta.h"
+#include "mcs_log.h"
+#include "mcs_tree.h"
+
+#include <ctype.h>
+#include <strings.h> // strncasecmp
+#include <sys/stat.h>
+
+// native readers for the tags and audio properties of MP3 (ID3v2, ID3v1 and
+// the first MPEG frame), FLAC (STREAMINFO and VORBIS_COMMENT) and Ogg Vorbis
+// and Opus (the header packets and the last page). only these regions of a
+// file are read, not the whole container. strings are returned as Latin-1,
+// like the TagLib reader does. files that are not understood are left to
+// TagLib (MCS_ERR_NOT_IMPLEMENTED)
+
+// ID3v1 genres, also referenced by number in ID3v2
+static const char* MCS_genres[] = {
+	"Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+	"Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+	"Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+	"Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient",
+	"Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical",
+	"Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+	"Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative",
+	"Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+	"Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+	"Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap",
+	"Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+	"Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+	"Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll",
+	"Hard Rock"
+};
+
+#define MCS_NUM_GENRES (sizeof(MCS_genres) / sizeof(MCS_genres[0]))
+
+// the frames of ID3v2.2 that are read and their ID3v2.3 names
+static const char* MCS_id3v22Frames[][2] = {
+	{ "COM", "COMM" }, { "TAL", "TALB" }, { "TCO", "TCON" },
+	{ "TP1", "TPE1" }, { "TRK", "TRCK" }, { "TT2", "TIT2" }, { "TYE", "TYER" }
+};
+
+#define MCS_NUM_ID3V22_FRAMES (sizeof(MCS_id3v22Frames) \
+		/ sizeof(MCS_id3v22Frames[0]))
+
+// kbit/s by version (MPEG1, MPEG2 and 2.5), layer and index
+static const short MCS_mpegBitrates[2][3][15] = {
+	{
+		{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416,
+				448 },
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+		{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+	},
+	{
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+	}
+};
+
+static const int MCS_mpegSamplerates[3] = { 44100, 48000, 32000 };
+
+static long MCS_readAt(int fd, void* buffer, long len, off_t offset) {
+	long total = 0;
+
+	while (total < len) {
+		ssize_t r = pread(fd, (char*) buffer + total, len - total,
+				offset + total);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+
+		if (r <= 0)
+			break;
+
+		total += r;
+	}
+
+	return total;
+}
+
+// copies a string in a text encoding of ID3v2 (0 Latin-1, 1 UTF-16 with
+// BOM, 2 UTF-16BE, 3 UTF-8) as Latin-1, other characters become '?'. the
+// string ends with a terminator or at end, the end of it is returned
+static const unsigned char* MCS_copyMetaString(char* dest,
+		const unsigned char* p, const unsigned char* end, int encoding) {
+	int wide = encoding == 1 || encoding == 2;
+	int bigEndian = 1;
+	int len = 0;
+
+	if (encoding == 1 && end - p >= 2 && p[0] == 0xFF && p[1] == 0xFE) {
+		bigEndian = 0;
+		p += 2;
+	} else if (encoding == 1 && end - p >= 2 && p[0] == 0xFE && p[1] == 0xFF) {
+		p += 2;
+	}
+
+	while (p < end) {
+		unsigned long c;
+
+		if (wide) {
+			if (end - p < 2)
+				break;
+
+			c = bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+			p += 2;
+
+			// the low half of a surrogate pair is skipped
+			if (c >= 0xD800 && c < 0xDC00)
+				p += 2;
+		} else {
+			c = *p++;
+
+			if (encoding == 3 && c >= 0xC0) {
+				int n = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+				c &= 0x3F >> n;
+
+				while (n-- > 0 && p < end && (*p & 0xC0) == 0x80)
+					c = (c << 6) | (*p++ & 0x3F);
+			}
+		}
+
+		if (c == 0)
+			break;
+
+		if (len < MCS_INFO_STR - 1)
+			dest[len++] = c <= 0xFF ? (char) c : '?';
+	}
+
+	dest[len] = '\0';
+	return p;
+}
+
+// "(n)", "(n)refinement" and "n" refer to the ID3v1 genres
+static void MCS_copyGenre(char* dest, const char* genre) {
+	const char* p = genre[0] == '(' ? genre + 1 : genre;
+	char* end;
+	long n = isdigit((unsigned char) *p) ? strtol(p, &end, 10) : -1;
+
+	if (n >= 0 && (p == genre ? *end == '\0' : *end == ')')) {
+		genre = p == genre ? end : end + 1;
+
+		if (genre[0] == '\0' && n < (long) MCS_NUM_GENRES)
+			genre = MCS_genres[n];
+	}
+
+	snprintf(dest, MCS_INFO_STR, "%s", genre);
+}
+
+// a comment without a description is preferred, rank is 2 then
+static void MCS_readID3Frame(struct MCS_Info* info, const char* id,
+		const unsigned char* frame, const unsigned char* end,
+		int* commentRank) {
+	char text[MCS_INFO_STR];
+
+	if (frame >= end)
+		return;
+
+	int encoding = frame[0];
+
+	if (memcmp(id, "COMM", 4) == 0) {
+		// encoding, language, description and text
+		if (end - frame < 4 || *commentRank == 2)
+			return;
+
+		const unsigned char* p = MCS_copyMetaString(text, frame + 4, end,
+				encoding);
+		int rank = text[0] == '\0' ? 2 : 1;
+
+		if (rank > *commentRank) {
+			MCS_copyMetaString(info->comment, p, end, encoding);
+			*commentRank = rank;
+		}
+
+		return;
+	}
+
+	if (id[0] != 'T')
+		return;
+
+	// the first value of a text frame
+	MCS_copyMetaString(text, frame + 1, end, encoding);
+
+	if (memcmp(id, "TIT2", 4) == 0) {
+		strcpy(info->title, text);
+	} else if (memcmp(id, "TPE1", 4) == 0) {
+		strcpy(info->artist, text);
+	} else if (memcmp(id, "TALB", 4) == 0) {
+		strcpy(info->album, text);
+	} else if (memcmp(id, "TYER", 4) == 0 || memcmp(id, "TDRC", 4) == 0) {
+		info->year = atoi(text);
+	} else if (memcmp(id, "TRCK", 4) == 0) {
+		info->track = atoi(text);
+	} else if (memcmp(id, "TCON", 4) == 0) {
+		MCS_copyGenre(info->genre, text);
+	}
+}
+
+// reads the frames of an ID3v2 tag at the start of the file. taglen is the
+// length of the tag, 0 if there is none. returns -1 if the tag is not
+// supported
+static int MCS_readID3v2(int fd, struct MCS_Info* info, long* taglen) {
+	unsigned char header[10];
+
+	*taglen = 0;
+
+	if (MCS_readAt(fd, header, 10, 0) != 10 || memcmp(header, "ID3", 3) != 0)
+		return 0;
+
+	int version = header[3];
+	int flags = header[5];
+	long size = MCS_SYNCSAFE(header + 6);
+
+	*taglen = 10 + size + (flags & 0x10 ? 10 : 0); // with footer
+
+	// unsynchronised tags are rare and left to TagLib
+	if (version < 2 || version > 4 || (flags & 0x80))
+		return -1;
+
+	// the frames are usually in front of large pictures, a frame after the
+	// limit is not read
+	if (size > MCS_META_MAX_TAG)
+		size = MCS_META_MAX_TAG;
+
+	unsigned char* tag = (unsigned char*) malloc(size + 1);
+	size = MCS_readAt(fd, tag, size, 10);
+
+	unsigned char* p = tag;
+	unsigned char* end = tag + size;
+
+	// skip the extended header
+	if (version > 2 && (flags & 0x40) && end - p >= 4) {
+		unsigned long extlen = version == 3 ? MCS_U32(p) + 4 : MCS_SYNCSAFE(p);
+		p = extlen < (unsigned long) (end - p) ? p + extlen : end;
+	}
+
+	int headerlen = version == 2 ? 6 : 10;
+	int commentRank = 0;
+
+	while (p + headerlen <= end && p[0] != 0) {
+		long framelen;
+		int skip = 0;
+
+		if (version == 2) {
+			framelen = (p[3] << 16) | (p[4] << 8) | p[5];
+		} else if (version == 3) {
+			framelen = MCS_U32(p + 4);
+			skip = p[9] & 0xC0; // compressed or encrypted
+		} else {
+			framelen = MCS_SYNCSAFE(p + 4);
+			skip = p[9] & 0x0E; // compressed, encrypted or unsynchronised
+		}
+
+		unsigned char* frame = p + headerlen;
+		unsigned char* frameend = frame + framelen;
+
+		if (framelen <= 0 || frameend > end)
+			break;
+
+		const char* id = (const char*) p;
+
+		if (version == 2) {
+			id = "----";
+
+			unsigned int i;
+			for (i = 0; i < MCS_NUM_ID3V22_FRAMES; i++) {
+				if (memcmp(p, MCS_id3v22Frames[i][0], 3) == 0)
+					id = MCS_id3v22Frames[i][1];
+			}
+		}
+
+		if (version == 4 && (p[9] & 0x01)) {
+			frame += 4; // data length indicator
+		}
+
+		p = frameend;
+
+		if (!skip)
+			MCS_readID3Frame(info, id, frame, frameend, &commentRank);
+	}
+
+	free(tag);
+	return 0;
+}
+
+// copies a field of an ID3v1 tag, the fields are padded with spaces or zeros
+static void MCS_copyID3v1Field(char* dest, const unsigned char* field,
+		int len) {
+	if (dest[0] != '\0')
+		return;
+
+	MCS_copyMetaString(dest, field, field + len, 0);
+
+	int i = strlen(dest);
+
+	while (i > 0 && dest[i - 1] == ' ')
+		dest[--i] = '\0';
+}
+
+// fills the fields that are missing in the ID3v2 tag from an ID3v1 tag at
+// the end of the file, returns the length of the tag
+static int MCS_readID3v1(int fd, long filesize, struct MCS_Info* info) {
+	unsigned char tag[128];
+
+	if (filesize < 128 || MCS_readAt(fd, tag, 128, filesize - 128) != 128
+			|| memcmp(tag, "TAG", 3) != 0)
+		return 0;
+
+	MCS_copyID3v1Field(info->title, tag + 3, 30);
+	MCS_copyID3v1Field(info->artist, tag + 33, 30);
+	MCS_copyID3v1Field(info->album, tag + 63, 30);
+	MCS_copyID3v1Field(info->comment, tag + 97, 30);
+
+	if (info->year == 0) {
+		char year[5];
+		memcpy(year, tag + 93, 4);
+		year[4] = '\0';
+		info->year = atoi(year);
+	}
+
+	// ID3v1.1 has the track in the last byte of the comment
+	if (info->track == 0 && tag[125] == 0)
+		info->track = tag[126];
+
+	if (info->genre[0] == '\0' && tag[127] < MCS_NUM_GENRES)
+		strcpy(info->genre, MCS_genres[tag[127]]);
+
+	return 128;
+}
+
+// decodes an MPEG audio frame header, returns the length of the frame or -1
+static int MCS_parseMPEGHeader(const unsigned char* h, int* version,
+		int* bitrate, int* samplerate, int* channels, int* samples) {
+	if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0)
+		return -1;
+
+	*version = (h[1] >> 3) & 3; // 3 MPEG1, 2 MPEG2, 0 MPEG2.5
+	int layer = 4 - ((h[1] >> 1) & 3);
+	int index = h[2] >> 4;
+	int srindex = (h[2] >> 2) & 3;
+
+	if (*version == 1 || layer == 4 || index == 0 || index == 15
+			|| srindex == 3)
+		return -1;
+
+	int v2 = *version != 3;
+	int padding = (h[2] >> 1) & 1;
+
+	*bitrate = MCS_mpegBitrates[v2][layer - 1][index];
+	*samplerate = MCS_mpegSamplerates[srindex] >> (*version == 3 ? 0
+			: *version == 2 ? 1 : 2);
+	*channels = (h[3] >> 6) == 3 ? 1 : 2;
+	*samples = layer == 1 ? 384 : (layer == 3 && v2) ? 576 : 1152;
+
+	if (layer == 1)
+		return (12000 * *bitrate / *samplerate + padding) * 4;
+
+	return *samples / 8 * 1000 * *bitrate / *samplerate + padding;
+}
+
+// reads the properties from the first frame of the stream, the length of a
+// VBR stream from its Xing or VBRI header
+static int MCS_readMPEGProperties(int fd, long start, long streamlen,
+		struct MCS_Info* info) {
+	unsigned char buffer[MCS_META_FRAME_SIZE];
+	long len = MCS_readAt(fd, buffer, MCS_META_FRAME_SIZE, start);
+	unsigned char* end = buffer + len;
+
+	int version, bitrate, samplerate, channels, samples;
+	unsigned char* frame;
+
+	// the first header that is followed by another one, or by the end of
+	// the buffer
+	for (frame = buffer; frame + 4 <= end; frame++) {
+		int framelen = MCS_parseMPEGHeader(frame, &version, &bitrate,
+				&samplerate, &channels, &samples);
+
+		if (framelen < 0)
+			continue;
+
+		int v, b, s, c, n;
+
+		if (frame + framelen + 4 > end
+				|| MCS_parseMPEGHeader(frame + framelen, &v, &b, &s, &c,
+						&n) >= 0)
+			break;
+	}
+
+	if (frame + 4 > end)
+		return -1;
+
+	unsigned long frames = 0;
+	unsigned long bytes = 0;
+
+	unsigned char* xing = frame + 4 + (version == 3 ? (channels == 1 ? 17 : 32)
+			: (channels == 1 ? 9 : 17));
+
+	if (xing + 16 <= end && (memcmp(xing, "Xing", 4) == 0
+			|| memcmp(xing, "Info", 4) == 0)) {
+		unsigned long flags = MCS_U32(xing + 4);
+		unsigned char* p = xing + 8;
+
+		if (flags & 1) {
+			frames = MCS_U32(p);
+			p += 4;
+		}
+
+		if (flags & 2)
+			bytes = MCS_U32(p);
+	} else if (frame + 54 <= end && memcmp(frame + 36, "VBRI", 4) == 0) {
+		bytes = MCS_U32(frame + 46);
+		frames = MCS_U32(frame + 50);
+	}
+
+	long long length; // ms
+
+	if (frames > 0) {
+		length = (long long) frames * samples * 1000 / samplerate;
+
+		if (length > 0)
+			bitrate = (bytes > 0 ? (long long) bytes : streamlen) * 8 / length;
+	} else {
+		length = streamlen * 8LL / bitrate;
+	}
+
+	info->bitrate = bitrate;
+	info->samplerate = samplerate;
+	info->channels = channels;
+	info->length = length / 1000;
+
+	return 0;
+}
+
+// reads the fields of a Vorbis comment (FLAC, Ogg Vorbis and Opus). the
+// first value of a field is used
+static void MCS_readVorbisComment(const unsigned char* p,
+		const unsigned char* end, struct MCS_Info* info) {
+	char text[MCS_INFO_STR];
+	int hasDescription = 0;
+
+	// vendor string
+	if (end - p < 4 || MCS_U32LE(p) > (unsigned long) (end - p - 4))
+		return;
+
+	p += 4 + MCS_U32LE(p);
+
+	if (end - p < 4)
+		return;
+
+	unsigned long count = MCS_U32LE(p);
+	p += 4;
+
+	for (; count > 0 && end - p >= 4; count--) {
+		unsigned long len = MCS_U32LE(p);
+		p += 4;
+
+		if (len > (unsigned long) (end - p))
+			break;
+
+		const unsigned char* field = p;
+		const unsigned char* value = memchr(field, '=', len);
+		p += len;
+
+		if (value == NULL)
+			continue;
+
+		int keylen = value - field;
+		char* key = (char*) field;
+		char* dest = NULL;
+
+		MCS_copyMetaString(text, value + 1, p, 3);
+
+		if (keylen == 5 && strncasecmp(key, "TITLE", 5) == 0) {
+			dest = info->title;
+		} else if (keylen == 6 && strncasecmp(key, "ARTIST", 6) == 0) {
+			dest = info->artist;
+		} else if (keylen == 5 && strncasecmp(key, "ALBUM", 5) == 0) {
+			dest = info->album;
+		} else if (keylen == 5 && strncasecmp(key, "GENRE", 5) == 0) {
+			dest = info->genre;
+		} else if (keylen == 11 && strncasecmp(key, "DESCRIPTION", 11) == 0) {
+			// preferred over COMMENT
+			if (!hasDescription)
+				info->comment[0] = '\0';
+
+			hasDescription = 1;
+			dest = info->comment;
+		} else if (keylen == 7 && strncasecmp(key, "COMMENT", 7) == 0) {
+			dest = hasDescription ? NULL : info->comment;
+		} else if (keylen == 4 && strncasecmp(key, "DATE", 4) == 0) {
+			if (info->year == 0)
+				info->year = atoi(text);
+		} else if (keylen == 11 && strncasecmp(key, "TRACKNUMBER", 11) == 0) {
+			if (info->track == 0)
+				info->track = atoi(text);
+		}
+
+		if (dest != NULL && dest[0] == '\0')
+			strcpy(dest, text);
+	}
+}
+
+// reads STREAMINFO and VORBIS_COMMENT of the metadata blocks, start is the
+// position of "fLaC"
+static int MCS_readFLAC(int fd, long start, long filesize,
+		struct MCS_Info* info) {
+	unsigned char header[4];
+	unsigned char streaminfo[34];
+	int hasStreaminfo = 0;
+	long pos = start + 4;
+	int last = 0;
+
+	while (!last) {
+		if (MCS_readAt(fd, header, 4, pos) != 4)
+			return -1;
+
+		last = header[0] & 0x80;
+		int type = header[0] & 0x7F;
+		long blocklen = (header[1] << 16) | (header[2] << 8) | header[3];
+
+		pos += 4;
+
+		if (type == 0 && blocklen == 34) {
+			hasStreaminfo = MCS_readAt(fd, streaminfo, 34, pos) == 34;
+		} else if (type == 4) {
+			long len = blocklen < MCS_META_MAX_TAG ? blocklen
+					: MCS_META_MAX_TAG;
+			unsigned char* block = (unsigned char*) malloc(len + 1);
+			len = MCS_readAt(fd, block, len, pos);
+
+			MCS_readVorbisComment(block, block + len, info);
+			free(block);
+		}
+
+		pos += blocklen;
+	}
+
+	if (!hasStreaminfo)
+		return -1;
+
+	// 20 bits sample rate, 3 bits channels - 1, 5 bits bits per sample - 1,
+	// 36 bits samples
+	int samplerate = (streaminfo[10] << 12) | (streaminfo[11] << 4)
+			| (streaminfo[12] >> 4);
+	unsigned long long samples = ((unsigned long long) (streaminfo[13] & 0x0F)
+			<< 32) | MCS_U32(streaminfo + 14);
+
+	if (samplerate == 0)
+		return -1;
+
+	long long length = samples * 1000 / samplerate; // ms
+	long streamlen = filesize - pos;
+
+	info->samplerate = samplerate;
+	info->channels = ((streaminfo[12] >> 1) & 7) + 1;
+	info->length = length / 1000;
+	info->bitrate = length > 0 && streamlen > 0 ? streamlen * 8LL / length : 0;
+
+	return 0;
+}
+
+// collects the first two packets of the first logical stream, the
+// identification and the comment header. returns the serial number of the
+// stream or -1
+static long MCS_readOggHeaders(int fd, unsigned char** packets, long* lens) {
+	unsigned char header[27 + 255];
+	unsigned char* page = (unsigned char*) malloc(255 * 255);
+	unsigned long serial = 0;
+	long pos = 0;
+	int k = 0;
+
+	packets[0] = packets[1] = NULL;
+	lens[0] = lens[1] = 0;
+
+	while (k < 2 && MCS_readAt(fd, header, 27, pos) == 27
+			&& memcmp(header, "OggS", 4) == 0) {
+		int numSegments = header[26];
+
+		if (MCS_readAt(fd, header + 27, numSegments, pos + 27) != numSegments)
+			break;
+
+		long pagelen = 0;
+
+		int i;
+		for (i = 0; i < numSegments; i++) {
+			pagelen += header[27 + i];
+		}
+
+		if (pos == 0)
+			serial = MCS_U32LE(header + 14);
+
+		// pages of other streams are skipped
+		if (MCS_U32LE(header + 14) == serial) {
+			if (MCS_readAt(fd, page, pagelen, pos + 27 + numSegments)
+					!= pagelen)
+				break;
+
+			unsigned char* p = page;
+
+			// a packet ends with a segment shorter than 255 bytes. the
+			// comment packet is read up to the limit, like an ID3v2 tag
+			for (i = 0; i < numSegments && k < 2; i++) {
+				int seglen = header[27 + i];
+
+				if (lens[k] + seglen > MCS_META_MAX_TAG) {
+					k++;
+					break;
+				}
+
+				packets[k] = (unsigned char*) realloc(packets[k],
+						lens[k] + seglen + 1);
+				memcpy(packets[k] + lens[k], p, seglen);
+				lens[k] += seglen;
+				p += seglen;
+
+				if (seglen < 255)
+					k++;
+			}
+		}
+
+		pos += 27 + numSegments + pagelen;
+	}
+
+	free(page);
+
+	return k == 2 ? (long) serial : -1;
+}
+
+// the granule position of the last page of the stream, the number of
+// samples
+static long long MCS_readOggGranule(int fd, long filesize,
+		unsigned long serial) {
+	long len = filesize < MCS_META_TAIL_SIZE ? filesize : MCS_META_TAIL_SIZE;
+	unsigned char* tail = (unsigned char*) malloc(len + 1);
+	long long granule = -1;
+
+	len = MCS_readAt(fd, tail, len, filesize - len);
+
+	unsigned char* p;
+	for (p = tail + len - 27; p >= tail; p--) {
+		if (memcmp(p, "OggS", 4) != 0 || MCS_U32LE(p + 14) != serial)
+			continue;
+
+		granule = (long long) ((unsigned long long) MCS_U32LE(p + 10) << 32
+				| MCS_U32LE(p + 6));
+
+		if (granule >= 0)
+			break;
+	}
+
+	free(tail);
+	return granule;
+}
+
+// reads an Ogg Vorbis or Opus stream from its header packets and its length
+static int MCS_readOggStream(int fd, long filesize, unsigned long serial,
+		unsigned char** packets, long* lens, struct MCS_Info* info) {
+	unsigned char* id = packets[0];
+	unsigned char* comment = packets[1];
+	int samplerate; // of the granule positions
+	int preskip = 0;
+	long nominal = 0;
+
+	if (lens[0] >= 30 && memcmp(id, "\x01vorbis", 7) == 0
+			&& lens[1] >= 7 && memcmp(comment, "\x03vorbis", 7) == 0) {
+		info->channels = id[11];
+		info->samplerate = samplerate = MCS_U32LE(id + 12);
+		nominal = (int) MCS_U32LE(id + 20);
+
+		MCS_readVorbisComment(comment + 7, comment + lens[1], info);
+	} else if (lens[0] >= 19 && memcmp(id, "OpusHead", 8) == 0
+			&& lens[1] >= 8 && memcmp(comment, "OpusTags", 8) == 0) {
+		// Opus is always decoded at 48 kHz
+		info->channels = id[9];
+		info->samplerate = samplerate = 48000;
+		preskip = id[10] | (id[11] << 8);
+
+		MCS_readVorbisComment(comment + 8, comment + lens[1], info);
+	} else {
+		return -1;
+	}
+
+	if (samplerate <= 0)
+		return -1;
+
+	long long granule = MCS_readOggGranule(fd, filesize, serial);
+	long long length = granule > preskip
+			? (granule - preskip) * 1000 / samplerate : 0; // ms
+
+	info->length = length / 1000;
+	info->bitrate = length > 0 ? filesize * 8LL / length : nominal / 1000;
+
+	return 0;
+}
+
+static int MCS_readOgg(int fd, long filesize, struct MCS_Info* info) {
+	unsigned char* packets[2];
+	long lens[2];
+
+	long serial = MCS_readOggHeaders(fd, packets, lens);
+	int r = serial < 0 ? -1 : MCS_readOggStream(fd, filesize, serial, packets,
+			lens, info);
+
+	free(packets[0]);
+	free(packets[1]);
+
+	return r;
+}
+
+int MCS_readMetaInfo(struct MCS_Item* item, struct MCS_Info* info) {
+	if (item->type - (item->type % MCS_TYPE_BASE) != MCS_TYPE_AUDIO)
+		return MCS_ERR_NOT_IMPLEMENTED;
+
+	char filepath[MCS_PATH_SIZE];
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0)
+		return MCS_ERR_TOO_LONG;
+
+	int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_readMetaInfo: File not found. %s\n",
+				filepath);
+
+		if (fd >= 0)
+			close(fd);
+
+		return MCS_ERR_NOT_FOUND;
+	}
+
+	// the fields of an ID3v1 tag at the end of an MP3 or FLAC file are used
+	// if the other tags don't have them
+	long taglen;
+	unsigned char magic[4];
+
+	int r = MCS_readID3v2(fd, info, &taglen);
+
+	if (r == 0 && MCS_readAt(fd, magic, 4, taglen) == 4) {
+		if (memcmp(magic, "fLaC", 4) == 0) {
+			r = MCS_readFLAC(fd, taglen, st.st_size, info);
+			MCS_readID3v1(fd, st.st_size, info);
+		} else if (memcmp(magic, "OggS", 4) == 0) {
+			r = MCS_readOgg(fd, st.st_size, info);
+		} else {
+			long tailLen = MCS_readID3v1(fd, st.st_size, info);
+			r = MCS_readMPEGProperties(fd, taglen,
+					st.st_size - taglen - tailLen, info);
+		}
+	} else {
+		r = -1;
+	}
+
+	close(fd);
+
+	if (r < 0) {
+		memset(info, 0, sizeof(struct MCS_Info));
+		return MCS_ERR_NOT_IMPLEMENTED;
+	}
+
+	info->hasTag = 1;
+	info->hasProperties = 1;
+
+	return MCS_ERR_OK;
+}
@@ -0,0 +1,16 @@
+#ifndef MCS_META_H
+#define MCS_META_H
+
+#include "mcs.h"
+
+// big-endian, little-endian and the syncsafe integers of ID3v2
+#define MCS_U32(p) (((unsigned long) (p)[0] << 24) | ((p)[1] << 16) \
+		| ((p)[2] << 8) | (p)[3])
+#define MCS_U32LE(p) (((unsigned long) (p)[3] << 24) | ((p)[2] << 16) \
+		| ((p)[1] << 8) | (p)[0])
+#define MCS_SYNCSAFE(p) (((long) ((p)[0] & 0x7F) << 21) \
+		| (((p)[1] & 0x7F) << 14) | (((p)[2] & 0x7F) << 7) | ((p)[3] & 0x7F))
+
+int MCS_readMetaInfo(struct MCS_Item* item, struct MCS_Info* info);
+
+#endif
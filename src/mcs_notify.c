@@ -0,0 +1,194 @@
+#include "mcs_notify.h"
+#include "mcs_log.h"
+
+// every subscriber has a bounded queue of events that were not sent yet.
+// subscribers that don't read fast enough are dropped when their queue is
+// full, so that they can't stall the server
+
+static int MCS_queueEvent(struct MCS_Subscriber* subscriber, char* event,
+		int len) {
+	if (subscriber->end + len > MCS_SUBSCRIBER_QUEUE) {
+		// move the pending events to the front of the queue
+		memmove(subscriber->buffer, subscriber->buffer + subscriber->start,
+				subscriber->end - subscriber->start);
+		subscriber->end -= subscriber->start;
+		subscriber->start = 0;
+
+		if (subscriber->end + len > MCS_SUBSCRIBER_QUEUE)
+			return -1;
+	}
+
+	memcpy(subscriber->buffer + subscriber->end, event, len);
+	subscriber->end += len;
+
+	return 0;
+}
+
+int MCS_addSubscriber(struct MCS_Context* mcc, int clientSocket) {
+	struct MCS_Subscriber* subscriber = NULL;
+
+	int i;
+	for (i = 0; i < MCS_MAX_SUBSCRIBERS; i++) {
+		if (mcc->subscribers[i].socket < 0) {
+			subscriber = &mcc->subscribers[i];
+			break;
+		}
+	}
+
+	if (subscriber == NULL) {
+		MCS_log(MCS_LOG_ERROR, "MCS_addSubscriber: Too many subscribers\n");
+		return -1;
+	}
+
+	subscriber->buffer = (char*) malloc(MCS_SUBSCRIBER_QUEUE * sizeof(char));
+	subscriber->start = 0;
+	subscriber->end = 0;
+	subscriber->socket = clientSocket;
+
+	fcntl(clientSocket, F_SETFL, O_NONBLOCK);
+	mcc->numSubscribers++;
+
+	// the header is followed by one event per line
+	char header[64];
+	int len = snprintf(header, sizeof(header), "%s %d %s\n\n", MCP_VERSION,
+			MCS_ERR_OK, MCS_MSG_OK);
+
+	MCS_queueEvent(subscriber, header, len);
+	MCS_flushSubscriber(mcc, subscriber);
+
+	return 0;
+}
+
+void MCS_freeSubscribers(struct MCS_Context* mcc) {
+	int i;
+	for (i = 0; i < MCS_MAX_SUBSCRIBERS; i++) {
+		if (mcc->subscribers[i].socket >= 0) {
+			MCS_removeSubscriber(mcc, &mcc->subscribers[i]);
+		}
+	}
+}
+
+int MCS_flushSubscriber(struct MCS_Context* mcc,
+		struct MCS_Subscriber* subscriber) {
+	while (subscriber->start < subscriber->end) {
+		int len = send(subscriber->socket,
+				subscriber->buffer + subscriber->start,
+				subscriber->end - subscriber->start, MSG_NOSIGNAL);
+
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0; // try again when the socket is writable
+
+			MCS_removeSubscriber(mcc, subscriber);
+			return -1;
+		}
+
+		subscriber->start += len;
+	}
+
+	subscriber->start = 0;
+	subscriber->end = 0;
+
+	return 0;
+}
+
+void MCS_handleSubscribers(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds) {
+	int i, j;
+	for (i = 0; i < numFds; i++) {
+		if (fds[i].revents == 0)
+			continue;
+
+		struct MCS_Subscriber* subscriber = NULL;
+
+		for (j = 0; j < MCS_MAX_SUBSCRIBERS; j++) {
+			if (mcc->subscribers[j].socket == fds[i].fd) {
+				subscriber = &mcc->subscribers[j];
+				break;
+			}
+		}
+
+		if (subscriber == NULL)
+			continue;
+
+		// subscribers don't send anything, readable means closed
+		if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+			MCS_removeSubscriber(mcc, subscriber);
+			continue;
+		}
+
+		if (fds[i].revents & POLLOUT) {
+			MCS_flushSubscriber(mcc, subscriber);
+		}
+	}
+}
+
+void MCS_notify(struct MCS_Context* mcc, char* format, ...) {
+	if (mcc->numSubscribers == 0)
+		return;
+
+	char event[256];
+
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(event, sizeof(event) - 1, format, args);
+	va_end(args);
+
+	if (len < 0)
+		return;
+
+	if (len > (int) sizeof(event) - 2)
+		len = (int) sizeof(event) - 2;
+
+	event[len++] = '\n';
+
+	int i;
+	for (i = 0; i < MCS_MAX_SUBSCRIBERS; i++) {
+		struct MCS_Subscriber* subscriber = &mcc->subscribers[i];
+
+		if (subscriber->socket < 0)
+			continue;
+
+		if (MCS_queueEvent(subscriber, event, len) < 0) {
+			MCS_log(MCS_LOG_WARN, "MCS_notify: Dropping slow subscriber %d\n",
+					subscriber->socket);
+			MCS_removeSubscriber(mcc, subscriber);
+			continue;
+		}
+
+		MCS_flushSubscriber(mcc, subscriber);
+	}
+}
+
+int MCS_pollSubscribers(struct MCS_Context* mcc, struct pollfd* fds) {
+	int numFds = 0;
+
+	int i;
+	for (i = 0; i < MCS_MAX_SUBSCRIBERS; i++) {
+		struct MCS_Subscriber* subscriber = &mcc->subscribers[i];
+
+		if (subscriber->socket < 0)
+			continue;
+
+		fds[numFds].fd = subscriber->socket;
+		fds[numFds].events = POLLIN;
+		fds[numFds].revents = 0;
+
+		if (subscriber->start < subscriber->end)
+			fds[numFds].events |= POLLOUT;
+
+		numFds++;
+	}
+
+	return numFds;
+}
+
+void MCS_removeSubscriber(struct MCS_Context* mcc,
+		struct MCS_Subscriber* subscriber) {
+	close(subscriber->socket);
+	free(subscriber->buffer);
+
+	subscriber->socket = -1;
+	subscriber->buffer = NULL;
+	mcc->numSubscribers--;
+}
@@ -0,0 +1,19 @@
+#ifndef MCS_NOTIFY_H
+#define MCS_NOTIFY_H
+
+#include "mcs.h"
+
+#include <stdarg.h>
+
+int MCS_addSubscriber(struct MCS_Context* mcc, int clientSocket);
+void MCS_freeSubscribers(struct MCS_Context* mcc);
+int MCS_flushSubscriber(struct MCS_Context* mcc,
+		struct MCS_Subscriber* subscriber);
+void MCS_handleSubscribers(struct MCS_Context* mcc, struct pollfd* fds,
+		int numFds);
+void MCS_notify(struct MCS_Context* mcc, char* format, ...);
+int MCS_pollSubscribers(struct MCS_Context* mcc, struct pollfd* fds);
+void MCS_removeSubscriber(struct MCS_Context* mcc,
+		struct MCS_Subscriber* subscriber);
+
+#endif
@@ -0,0 +1,100 @@
+#include "mcs_queue.h"
+#include "mcs_fed.h"
+#include "mcs_log.h"
+#include "mcs_tree.h"
+
+void MCS_clearQueue(struct MCS_Queue* queue) {
+	queue->head = 0;
+	queue->size = 0;
+	queue->warmedID = 0;
+}
+
+int MCS_enqueueItem(struct MCS_Queue* queue, unsigned int itemID) {
+	if (queue->size == MCS_QUEUE_SIZE)
+		return -1;
+
+	queue->items[(queue->head + queue->size) % MCS_QUEUE_SIZE] = itemID;
+	queue->size++;
+
+	return 0;
+}
+
+int MCS_playNext(struct MCS_Context* mcc, struct MCS_Session* session,
+		long long start) {
+	struct MCS_Queue* queue = &session->queue;
+
+	if (queue->size > 0)
+		mcc->changes++;
+
+	// items are referenced by ID, they may have disappeared after a RESTART.
+	// skip the items that can't be played
+	while (queue->size > 0) {
+		unsigned int itemID = queue->items[queue->head];
+		queue->head = (queue->head + 1) % MCS_QUEUE_SIZE;
+		queue->size--;
+
+		struct MCS_Item* item = MCS_lookupItem(mcc->items, mcc->size, itemID);
+
+		if (item == NULL
+				|| MCS_handlePlayItem(mcc, session, item) != MCS_ERR_OK)
+			continue;
+
+		// time from the end of the previous item (or NEXT) to the spawn
+		long long spawn = MCS_getTime() - start;
+
+		queue->transitions++;
+		queue->lastSpawn = spawn;
+		queue->totalSpawn += spawn;
+
+		if (spawn > queue->maxSpawn)
+			queue->maxSpawn = spawn;
+
+		MCS_log(MCS_LOG_INFO,
+				"Playing next item %d in session %s (spawned in %lld us)\n",
+				itemID, session->name, spawn);
+
+		MCS_warmNext(mcc, session);
+		return MCS_ERR_OK;
+	}
+
+	return MCS_ERR_NOT_FOUND;
+}
+
+void MCS_warmNext(struct MCS_Context* mcc, struct MCS_Session* session) {
+	struct MCS_Queue* queue = &session->queue;
+
+	// only warm up the next item while the current one is playing
+	if (session->child == 0 || queue->size == 0)
+		return;
+
+	unsigned int itemID = queue->items[queue->head];
+
+	if (itemID == queue->warmedID)
+		return;
+
+	struct MCS_Item* item = MCS_lookupItem(mcc->items, mcc->size, itemID);
+
+	// the files of other servers are not read here
+	if (item == NULL || MCS_getItemNode(mcc, item) != NULL)
+		return;
+
+	queue->warmedID = itemID;
+
+	char filepath[MCS_PATH_SIZE];
+
+	if (MCS_getItemPath(item, filepath, MCS_PATH_SIZE) < 0)
+		return;
+
+	// ask the kernel to read the head of the file into the page cache, so
+	// that the drive is spun up and the first seconds are available when
+	// the player starts. the read-ahead happens asynchronously
+	int fd = open(filepath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if (fd < 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_warmNext: Could not open %s\n", filepath);
+		return;
+	}
+
+	posix_fadvise(fd, 0, MCS_READAHEAD_SIZE, POSIX_FADV_WILLNEED);
+	close(fd);
+}
@@ -0,0 +1,12 @@
+#ifndef MCS_QUEUE_H
+#define MCS_QUEUE_H
+
+#include "mcs.h"
+
+void MCS_clearQueue(struct MCS_Queue* queue);
+int MCS_enqueueItem(struct MCS_Queue* queue, unsigned int itemID);
+int MCS_playNext(struct MCS_Context* mcc, struct MCS_Session* session,
+		long long start);
+void MCS_warmNext(struct MCS_Context* mcc, struct MCS_Session* session);
+
+#endif
@@ -0,0 +1,156 @@
+#include "mcs_session.h"
+#include "mcs_log.h"
+
+// sessions are looked up by name and children by pid, both through open
+// addressing hash tables with linear probing. sessions are never removed,
+// once all are in use an idle session is given the new name (see
+// MCS_reclaimSession). removed children leave a tombstone (MCS_CHILD_DELETED)
+
+// rebuilds the table after a session was renamed
+static void MCS_indexSessions(struct MCS_Context* mcc) {
+	memset(mcc->sessionTable, -1, sizeof(mcc->sessionTable));
+
+	int i, j;
+	for (i = 0; i < mcc->numSessions; i++) {
+		char* name = mcc->sessions[i].name;
+		unsigned int h = sax_hash(name, strlen(name), MCS_SESSION_BUCKETS)
+				% MCS_SESSION_BUCKETS;
+
+		for (j = 0; mcc->sessionTable[(h + j) % MCS_SESSION_BUCKETS] >= 0;
+				j++);
+
+		mcc->sessionTable[(h + j) % MCS_SESSION_BUCKETS] = i;
+	}
+}
+
+// returns the session that was stopped the longest ago and has nothing to
+// play, NULL if there is none. a session with a running persistent player
+// is in use
+static struct MCS_Session* MCS_reclaimSession(struct MCS_Context* mcc) {
+	struct MCS_Session* idle = NULL;
+
+	int i, j;
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+
+		if (strcmp(session->name, MCS_SESSION_DEFAULT) == 0
+				|| session->child != 0 || session->playingItem != NULL
+				|| session->node != NULL || session->queue.size > 0)
+			continue;
+
+		for (j = 0; j < mcc->numDaemons; j++) {
+			if (mcc->daemons[j].session == session
+					&& mcc->daemons[j].pid != 0)
+				break;
+		}
+
+		if (j < mcc->numDaemons)
+			continue;
+
+		if (idle == NULL || session->usage.stopped < idle->usage.stopped)
+			idle = session;
+	}
+
+	return idle;
+}
+
+struct MCS_Child* MCS_addChild(struct MCS_Context* mcc, pid_t pid,
+		struct MCS_Session* session) {
+	unsigned int h = pid % MCS_CHILD_BUCKETS;
+
+	int i;
+	for (i = 0; i < MCS_CHILD_BUCKETS; i++) {
+		struct MCS_Child* child = &mcc->children[(h + i) % MCS_CHILD_BUCKETS];
+
+		if (child->pid == MCS_CHILD_EMPTY || child->pid == MCS_CHILD_DELETED) {
+			memset(child, 0, sizeof(struct MCS_Child));
+			child->pid = pid;
+			child->session = session;
+			child->signal = -1;
+			return child;
+		}
+	}
+
+	MCS_log(MCS_LOG_ERROR, "MCS_addChild: Too many child processes\n");
+	return NULL;
+}
+
+struct MCS_Session* MCS_getSession(struct MCS_Context* mcc, char* name,
+		int create) {
+	if (name == NULL || name[0] == '\0')
+		name = MCS_SESSION_DEFAULT;
+
+	int len = strlen(name);
+
+	if (len >= MCS_SESSION_NAME)
+		return NULL;
+
+	unsigned int h = sax_hash(name, len, MCS_SESSION_BUCKETS)
+			% MCS_SESSION_BUCKETS;
+
+	int i;
+	for (i = 0; i < MCS_SESSION_BUCKETS; i++) {
+		int* slot = &mcc->sessionTable[(h + i) % MCS_SESSION_BUCKETS];
+
+		if (*slot < 0) {
+			if (!create)
+				return NULL;
+
+			if (mcc->numSessions == MCS_MAX_SESSIONS) {
+				struct MCS_Session* session = MCS_reclaimSession(mcc);
+
+				if (session == NULL) {
+					MCS_log(MCS_LOG_WARN, "MCS_getSession: Too many "
+							"sessions\n");
+					return NULL;
+				}
+
+				MCS_log(MCS_LOG_INFO, "Reused session %s for %s\n",
+						session->name, name);
+
+				// the slots of its persistent players go with it
+				memset(session, 0, sizeof(struct MCS_Session));
+				strcpy(session->name, name);
+				MCS_indexSessions(mcc);
+
+				return session;
+			}
+
+			struct MCS_Session* session = &mcc->sessions[mcc->numSessions];
+			memset(session, 0, sizeof(struct MCS_Session));
+			strcpy(session->name, name);
+
+			*slot = mcc->numSessions++;
+
+			MCS_log(MCS_LOG_INFO, "Created session %s\n", name);
+			return session;
+		}
+
+		if (strcmp(mcc->sessions[*slot].name, name) == 0)
+			return &mcc->sessions[*slot];
+	}
+
+	return NULL;
+}
+
+struct MCS_Child* MCS_lookupChild(struct MCS_Context* mcc, pid_t pid) {
+	unsigned int h = pid % MCS_CHILD_BUCKETS;
+
+	int i;
+	for (i = 0; i < MCS_CHILD_BUCKETS; i++) {
+		struct MCS_Child* child = &mcc->children[(h + i) % MCS_CHILD_BUCKETS];
+
+		if (child->pid == MCS_CHILD_EMPTY)
+			return NULL;
+
+		if (child->pid == pid)
+			return child;
+	}
+
+	return NULL;
+}
+
+void MCS_removeChild(struct MCS_Context* mcc, struct MCS_Child* child) {
+	child->pid = MCS_CHILD_DELETED;
+	child->session = NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef MCS_SESSION_H
+#define MCS_SESSION_H
+
+#include "mcs.h"
+
+struct MCS_Child* MCS_addChild(struct MCS_Context* mcc, pid_t pid,
+		struct MCS_Session* session);
+struct MCS_Session* MCS_getSession(struct MCS_Context* mcc, char* name,
+		int create);
+struct MCS_Child* MCS_lookupChild(struct MCS_Context* mcc, pid_t pid);
+void MCS_removeChild(struct MCS_Context* mcc, struct MCS_Child* child);
+
+#endif
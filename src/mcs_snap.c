@@ -0,0 +1,263 @@
+#include "mcs_snap.h"
+#include "mcs_map.h"
+#include "mcs_worker.h"
+
+#include <sched.h> // sched_yield
+
+// the workers read the item list and the status while the main loop changes
+// them. the item list is copied into a snapshot that is never modified, a
+// new one replaces it after every change. replaced snapshots are freed once
+// no worker reads them anymore: every worker announces the snapshot it reads
+// in a slot of its own (a hazard pointer). the status is small and changes
+// often, it is copied in place under a seqlock instead
+
+static char* MCS_copyString(char** pool, char* s) {
+	char* copy = *pool;
+	int len = strlen(s) + 1;
+
+	memcpy(copy, s, len);
+	*pool += len;
+
+	return copy;
+}
+
+// the snapshot a worker serves a request from. reading is the slot of the
+// worker, see MCS_releaseSnapshot
+struct MCS_Snapshot* MCS_acquireSnapshot(struct MCS_Context* mcc,
+		struct MCS_Snapshot** reading) {
+	struct MCS_Snapshot* snapshot;
+
+	// the snapshot may be replaced and freed before the slot is set. if it
+	// is still the latest after the slot is set, the main loop sees the
+	// slot before it could free it
+	do {
+		snapshot = __atomic_load_n(&mcc->snapshot, __ATOMIC_SEQ_CST);
+		__atomic_store_n(reading, snapshot, __ATOMIC_SEQ_CST);
+	} while (snapshot != __atomic_load_n(&mcc->snapshot, __ATOMIC_SEQ_CST));
+
+	return snapshot;
+}
+
+// the workers are stopped
+void MCS_freeSnapshots(struct MCS_Context* mcc) {
+	while (mcc->retired != NULL) {
+		struct MCS_Snapshot* snapshot = mcc->retired;
+		mcc->retired = snapshot->retired;
+		free(snapshot);
+	}
+
+	free(mcc->snapshot);
+	mcc->snapshot = NULL;
+}
+
+void MCS_publishSnapshot(struct MCS_Context* mcc) {
+	// one block: the snapshot, the arrays of pointers, the items, the
+	// directories and then their names
+	size_t strings = 0;
+
+	int i;
+	for (i = 0; i < mcc->size; i++) {
+		strings += strlen(mcc->items[i]->label) + 1;
+	}
+
+	for (i = 0; i < mcc->numDirNodes; i++) {
+		strings += strlen(mcc->dirNodes[i]->name) + 1;
+	}
+
+	size_t size = sizeof(struct MCS_Snapshot) + strings
+			+ mcc->size * (sizeof(struct MCS_Item*)
+			+ sizeof(struct MCS_Item)) + mcc->numDirNodes
+			* (sizeof(struct MCS_Dir*) + sizeof(struct MCS_Dir));
+
+	struct MCS_Snapshot* snapshot = (struct MCS_Snapshot*) malloc(size);
+
+	snapshot->version = mcc->version;
+	snapshot->size = mcc->size;
+	snapshot->numDirNodes = mcc->numDirNodes;
+	snapshot->retired = NULL;
+
+	snapshot->items = (struct MCS_Item**) (snapshot + 1);
+	snapshot->dirNodes = (struct MCS_Dir**) (snapshot->items + mcc->size);
+
+	struct MCS_Item* items = (struct MCS_Item*) (snapshot->dirNodes
+			+ mcc->numDirNodes);
+	struct MCS_Dir* dirs = (struct MCS_Dir*) (items + mcc->size);
+	char* pool = (char*) (dirs + mcc->numDirNodes);
+
+	// the ID of a directory is its index
+	for (i = 0; i < mcc->numDirNodes; i++) {
+		struct MCS_Dir* dir = &dirs[i];
+
+		*dir = *mcc->dirNodes[i];
+		dir->name = MCS_copyString(&pool, dir->name);
+
+		if (dir->parent != NULL)
+			dir->parent = &dirs[dir->parent->id];
+
+		snapshot->dirNodes[i] = dir;
+	}
+
+	for (i = 0; i < mcc->size; i++) {
+		struct MCS_Item* item = &items[i];
+
+		*item = *mcc->items[i];
+		item->label = MCS_copyString(&pool, item->label);
+		item->dir = &dirs[item->dir->id];
+
+		snapshot->items[i] = item;
+	}
+
+	struct MCS_Snapshot* old = mcc->snapshot;
+
+	// requests that start from now on are served from the new snapshot
+	__atomic_store_n(&mcc->snapshot, snapshot, __ATOMIC_SEQ_CST);
+
+	if (old != NULL) {
+		old->retired = mcc->retired;
+		mcc->retired = old;
+		MCS_reclaimSnapshots(mcc);
+	}
+
+	// local clients read the same list from the library map
+	MCS_publishMap(mcc);
+}
+
+// copies the sessions and the nodes for STAT, called by the main loop only
+void MCS_publishStatus(struct MCS_Context* mcc) {
+	struct MCS_Status* status = &mcc->status;
+	unsigned int seq = status->seq;
+
+	__atomic_store_n(&status->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	status->version = mcc->version;
+	status->size = mcc->size;
+	status->changes = mcc->changes;
+
+	int i;
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+		struct MCS_SessionStatus* copy = &status->sessions[i];
+		struct MCS_Queue* queue = &session->queue;
+
+		memcpy(copy->name, session->name, MCS_SESSION_NAME);
+		copy->playing = session->playingItem != NULL;
+		copy->itemID = session->playingItem != NULL
+				? session->playingItem->id : 0;
+		copy->queueSize = queue->size;
+		copy->next = queue->size > 0 ? queue->items[queue->head] : 0;
+		copy->transitions = queue->transitions;
+		copy->lastSpawn = queue->lastSpawn;
+		copy->maxSpawn = queue->maxSpawn;
+		copy->totalSpawn = queue->totalSpawn;
+		copy->usage = session->usage;
+	}
+
+	status->numSessions = mcc->numSessions;
+
+	for (i = 0; i < mcc->numNodes; i++) {
+		struct MCS_Node* node = &mcc->nodes[i];
+		struct MCS_NodeStatus* copy = &status->nodes[i];
+
+		strncpy(copy->name, node->name, MCS_PATH_SIZE - 1);
+		copy->name[MCS_PATH_SIZE - 1] = '\0';
+		copy->up = node->up;
+		copy->version = node->version;
+		copy->size = node->dir->numItems;
+		copy->requests = node->requests;
+		copy->lastTime = node->lastTime;
+		copy->maxTime = node->maxTime;
+		copy->totalTime = node->totalTime;
+	}
+
+	status->numNodes = mcc->numNodes;
+
+	__atomic_store_n(&status->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// copies the status with the session of the name as the only session, an
+// empty one if the session does not exist
+void MCS_readStatus(struct MCS_Context* mcc, char* name,
+		struct MCS_Status* status) {
+	struct MCS_Status* src = &mcc->status;
+
+	if (name == NULL || name[0] == '\0')
+		name = MCS_SESSION_DEFAULT;
+
+	// the copy is retried if the main loop wrote in the meantime, the
+	// values of a torn copy are never used
+	unsigned int seq;
+
+	do {
+		seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+
+		status->version = src->version;
+		status->size = src->size;
+		status->changes = src->changes;
+		status->numSessions = 0;
+
+		int numSessions = src->numSessions;
+
+		int i;
+		for (i = 0; i < numSessions && i < MCS_MAX_SESSIONS; i++) {
+			struct MCS_SessionStatus* session = &src->sessions[i];
+
+			if (strncmp(session->name, name, MCS_SESSION_NAME) == 0) {
+				status->sessions[0] = *session;
+				status->numSessions = 1;
+				break;
+			}
+		}
+
+		status->numNodes = src->numNodes;
+
+		if (status->numNodes > MCS_MAX_NODES)
+			status->numNodes = MCS_MAX_NODES;
+
+		memcpy(status->nodes, src->nodes,
+				status->numNodes * sizeof(struct MCS_NodeStatus));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || __atomic_load_n(&src->seq, __ATOMIC_RELAXED) != seq);
+
+	if (status->numSessions == 0) {
+		memset(&status->sessions[0], 0, sizeof(struct MCS_SessionStatus));
+		strncpy(status->sessions[0].name, name, MCS_SESSION_NAME - 1);
+	}
+}
+
+// frees the replaced snapshots that no worker reads anymore, returns the ms
+// until the next check or -1 if none are left
+int MCS_reclaimSnapshots(struct MCS_Context* mcc) {
+	struct MCS_Snapshot** link = &mcc->retired;
+
+	while (*link != NULL) {
+		struct MCS_Snapshot* snapshot = *link;
+
+		int i;
+		for (i = 0; i < mcc->numWorkers; i++) {
+			if (__atomic_load_n(&mcc->workers[i].reading,
+					__ATOMIC_SEQ_CST) == snapshot)
+				break;
+		}
+
+		if (i < mcc->numWorkers) {
+			link = &snapshot->retired;
+			continue;
+		}
+
+		*link = snapshot->retired;
+		free(snapshot);
+	}
+
+	return mcc->retired != NULL ? MCS_RECLAIM_INTERVAL : -1;
+}
+
+void MCS_releaseSnapshot(struct MCS_Snapshot** reading) {
+	__atomic_store_n(reading, NULL, __ATOMIC_RELEASE);
+}
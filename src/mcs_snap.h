@@ -0,0 +1,16 @@
+#ifndef MCS_SNAP_H
+#define MCS_SNAP_H
+
+#include "mcs.h"
+
+struct MCS_Snapshot* MCS_acquireSnapshot(struct MCS_Context* mcc,
+		struct MCS_Snapshot** reading);
+void MCS_freeSnapshots(struct MCS_Context* mcc);
+void MCS_publishSnapshot(struct MCS_Context* mcc);
+void MCS_publishStatus(struct MCS_Context* mcc);
+void MCS_readStatus(struct MCS_Context* mcc, char* name,
+		struct MCS_Status* status);
+int MCS_reclaimSnapshots(struct MCS_Context* mcc);
+void MCS_releaseSnapshot(struct MCS_Snapshot** reading);
+
+#endif
@@ -0,0 +1,160 @@
+#include "mcs_spawn.h"
+#include "mcs_log.h"
+
+void MCS_freePlayer(struct MCS_Player* player) {
+	free(player->args);
+	free(player->argv);
+	free(player->slots);
+
+	memset(player, 0, sizeof(struct MCS_Player));
+}
+
+int MCS_parsePlayer(struct MCS_Player* player, int type, char* command) {
+	memset(player, 0, sizeof(struct MCS_Player));
+	player->type = type;
+
+	// split the command string into arguments by replacing ' ' with '\0'.
+	// arguments that are enclosed in '"' may contain ' ', the quotes are
+	// removed
+	int slen = strlen(command);
+	player->args = (char*) malloc((slen + 1) * sizeof(char));
+
+	// there are at most slen / 2 + 1 arguments
+	player->argv = (char**) malloc((slen / 2 + 2) * sizeof(char*));
+	player->slots = (int*) malloc((slen / 2 + 1) * sizeof(int));
+
+	char* src = command;
+	char* dst = player->args;
+	int quoted = 0;
+
+	while (*src != '\0') {
+		// skip separators between arguments
+		while (*src == ' ')
+			src++;
+
+		if (*src == '\0')
+			break;
+
+		char* arg = dst;
+
+		while (*src != '\0' && (quoted || *src != ' ')) {
+			if (*src == '"') {
+				quoted = !quoted;
+			} else {
+				*dst++ = *src;
+			}
+
+			src++;
+		}
+
+		*dst++ = '\0';
+
+		if (strstr(arg, MCS_SPAWN_SLOT) != NULL) {
+			player->slots[player->numSlots++] = player->argc;
+		}
+
+		player->argv[player->argc++] = arg;
+	}
+
+	player->argv[player->argc] = NULL;
+
+	if (quoted || player->argc == 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_parsePlayer: Invalid command \"%s\"\n",
+				command);
+		MCS_freePlayer(player);
+		return -1;
+	}
+
+	return 0;
+}
+
+int MCS_spawnPlayer(struct MCS_Player* player, char* filepath, int rpipe,
+		int wpipe, char* session, pid_t* pid) {
+	// copy the template and fill the slots. arguments that consist of the
+	// placeholder only point to the file path, others are expanded
+	char* argv[player->argc + 1];
+	char* expanded[player->numSlots + 1];
+
+	memcpy(argv, player->argv, (player->argc + 1) * sizeof(char*));
+
+	int i;
+	for (i = 0; i < player->numSlots; i++) {
+		char* arg = player->argv[player->slots[i]];
+
+		if (strcmp(arg, MCS_SPAWN_SLOT) == 0) {
+			expanded[i] = NULL;
+			argv[player->slots[i]] = filepath;
+			continue;
+		}
+
+		int prefix = strstr(arg, MCS_SPAWN_SLOT) - arg;
+		int len = strlen(arg) - 2 + strlen(filepath);
+
+		expanded[i] = (char*) malloc((len + 1) * sizeof(char));
+		snprintf(expanded[i], len + 1, "%.*s%s%s", prefix, arg, filepath,
+				arg + prefix + 2);
+
+		argv[player->slots[i]] = expanded[i];
+	}
+
+	// the child gets the read end of the pipe as STDIN (and the write end of
+	// another as STDOUT if wpipe >= 0) and its own process group, so that the
+	// player and its children can be killed together. posix_spawn does not
+	// copy the address space of the server, so the launch does not depend on
+	// the size of the item list
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, rpipe, 0);
+
+	if (wpipe >= 0)
+		posix_spawn_file_actions_adddup2(&actions, wpipe, 1);
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	// the server ignores SIGPIPE, the player gets the default action
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+			| POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	// the player learns its session (output zone) through the environment,
+	// i.e. a wrapper script can choose the audio device with it
+	extern char** environ;
+
+	int numEnv = 0;
+	while (environ[numEnv] != NULL)
+		numEnv++;
+
+	char sessionEnv[MCS_SESSION_NAME + 16];
+	snprintf(sessionEnv, sizeof(sessionEnv), "MCS_SESSION=%s", session);
+
+	char* envp[numEnv + 2];
+	memcpy(envp, environ, numEnv * sizeof(char*));
+	envp[numEnv] = sessionEnv;
+	envp[numEnv + 1] = NULL;
+
+	int r = posix_spawn(pid, argv[0], &actions, &attr, argv, envp);
+
+	if (r != 0) {
+		MCS_log(MCS_LOG_ERROR, "MCS_spawnPlayer: Failed to spawn %s (%s)\n",
+				argv[0], strerror(r));
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	for (i = 0; i < player->numSlots; i++) {
+		free(expanded[i]);
+	}
+
+	return r;
+}
@@ -0,0 +1,28 @@
+#ifndef MCS_SPAWN_H
+#define MCS_SPAWN_H
+
+#include "mcs.h"
+
+#include <spawn.h> // posix_spawn
+
+// placeholder in the MCS_BIN_* strings that is replaced with the file path
+#define MCS_SPAWN_SLOT "%s"
+
+// a player command line (MCS_BIN_*) that is parsed once at startup into an
+// argv template. only the placeholder slots are filled in when an item is
+// played
+struct MCS_Player {
+	int type; // item type, 0 for the player of unkown types
+	char* args; // '\0' separated arguments, argv points into it
+	char** argv; // NULL terminated
+	int argc;
+	int* slots; // indices of argv that contain the placeholder
+	int numSlots;
+};
+
+void MCS_freePlayer(struct MCS_Player* player);
+int MCS_parsePlayer(struct MCS_Player* player, int type, char* command);
+int MCS_spawnPlayer(struct MCS_Player* player, char* filepath, int rpipe,
+		int wpipe, char* session, pid_t* pid);
+
+#endif
@@ -5,6 +5,6 @@
 
 #include <tag_c.h>
 
-int MCS_sendTagLibInfo(struct MCS_Item* item, int clientSocket);
+int MCS_readTagLibInfo(struct MCS_Item* item, struct MCS_Info* info);
 
 #endif
@@ -0,0 +1,175 @@
+#include "mcs_tree.h"
+#include "mcs_enc.h"
+#include "mcs_log.h"
+
+struct MCS_Dir* MCS_addDirNode(struct MCS_Context* mcc, struct MCS_Dir* parent,
+		char* name) {
+	if (mcc->numDirNodes == mcc->dirNodeCapacity) {
+		int capacity = mcc->dirNodeCapacity > 0
+				? mcc->dirNodeCapacity * 2 : 64;
+
+		mcc->dirNodes = (struct MCS_Dir**) realloc(mcc->dirNodes,
+				capacity * sizeof(struct MCS_Dir*));
+		mcc->dirNodeCapacity = capacity;
+	}
+
+	struct MCS_Dir* node = (struct MCS_Dir*) malloc(sizeof(struct MCS_Dir));
+	memset(node, 0, sizeof(struct MCS_Dir));
+
+	int len = strlen(name);
+
+	node->id = mcc->numDirNodes;
+	node->name = (char*) malloc((len + 1) * sizeof(char));
+	memcpy(node->name, name, len + 1);
+	node->parent = parent;
+
+	if (parent != NULL) {
+		if (parent->numDirs == 0)
+			parent->firstDir = node->id;
+
+		parent->numDirs++;
+	}
+
+	mcc->dirNodes[mcc->numDirNodes++] = node;
+
+	return node;
+}
+
+void MCS_freeDirNodes(struct MCS_Dir** nodes, int numNodes) {
+	int i;
+	for (i = 0; i < numNodes; i++) {
+		free(nodes[i]->name);
+		free(nodes[i]);
+	}
+
+	free(nodes);
+}
+
+// writes the path of the item into the buffer, returns the length of the
+// path or -1 if the buffer is too small
+int MCS_getItemPath(struct MCS_Item* item, char* buffer, int size) {
+	struct MCS_Dir* path[MCS_MAX_DEPTH];
+	int depth = 0;
+
+	// the root has no name
+	struct MCS_Dir* node;
+	for (node = item->dir; node->parent != NULL; node = node->parent) {
+		if (depth == MCS_MAX_DEPTH)
+			return -1;
+
+		path[depth++] = node;
+	}
+
+	int len = 0;
+
+	while (depth-- > 0) {
+		char* name = path[depth]->name;
+		int namelen = strlen(name);
+
+		// configured directories may end with '/'
+		int sep = namelen == 0 || name[namelen - 1] != '/';
+
+		if (len + namelen + sep >= size)
+			return -1;
+
+		memcpy(buffer + len, name, namelen);
+		len += namelen;
+
+		if (sep)
+			buffer[len++] = '/';
+	}
+
+	int labellen = strlen(item->label);
+
+	if (len + labellen >= size)
+		return -1;
+
+	memcpy(buffer + len, item->label, labellen + 1);
+
+	return len + labellen;
+}
+
+int MCS_sendDir(struct MCS_Snapshot* snapshot, struct MCS_Dir* node,
+		struct MCS_Request* req) {
+	// the whole directory is sent at once, the buffer is large enough for
+	// the entries of the node
+	int size = 256 + strlen(node->name);
+
+	int i;
+	for (i = 0; i < node->numDirs; i++) {
+		size += 96 + strlen(snapshot->dirNodes[node->firstDir + i]->name);
+	}
+
+	for (i = 0; i < node->numItems; i++) {
+		size += 64 + strlen(snapshot->items[node->firstItem + i]->label);
+	}
+
+	char* buffer = (char*) malloc((size + 1) * sizeof(char));
+
+	char* buffp = buffer;
+	char* buffend = buffer + size;
+
+	int plen;
+
+	if (req->encoding == MCS_ENC_BIN) {
+		plen = MCS_encDir(buffp, buffend - buffp, node);
+	} else {
+		plen = snprintf(buffp, buffend - buffp,
+				"<mediacenter>"
+				"<dir id=\"%u\" parent=\"%u\" name=\"%s\" dirs=\"%d\" "
+				"items=\"%d\">",
+				node->id, node->parent ? node->parent->id : 0, node->name,
+				node->numDirs, node->numItems);
+	}
+
+	buffp += plen;
+
+	for (i = 0; i < node->numDirs && buffp <= buffend; i++) {
+		struct MCS_Dir* child = snapshot->dirNodes[node->firstDir + i];
+
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encDir(buffp, buffend - buffp, child);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<dir id=\"%u\" name=\"%s\" dirs=\"%d\" items=\"%d\"/>",
+					child->id, child->name, child->numDirs, child->numItems);
+		}
+
+		buffp += plen;
+	}
+
+	for (i = 0; i < node->numItems && buffp <= buffend; i++) {
+		struct MCS_Item* item = snapshot->items[node->firstItem + i];
+
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encItem(buffp, buffend - buffp, item);
+		} else {
+			plen = snprintf(buffp, buffend - buffp,
+					"<item id=\"%d\" type=\"%d\" label=\"%s\"/>", item->id,
+					item->type, item->label);
+		}
+
+		buffp += plen;
+	}
+
+	if (buffp <= buffend) {
+		if (req->encoding == MCS_ENC_BIN) {
+			plen = MCS_encEnd(buffp, buffend - buffp);
+		} else {
+			plen = snprintf(buffp, buffend - buffp, "</dir></mediacenter>");
+		}
+
+		buffp += plen;
+	}
+
+	if (buffp > buffend) {
+		MCS_log(MCS_LOG_ERROR, "MCS_sendDir: Buffer too small\n");
+		free(buffer);
+		return MCS_ERR_TOO_LONG;
+	}
+
+	int r = MCS_writeResponse(req, buffer, buffp - buffer);
+
+	free(buffer);
+	return r; // 200 OK was sent with buffer
+}
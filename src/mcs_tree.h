@@ -0,0 +1,13 @@
+#ifndef MCS_TREE_H
+#define MCS_TREE_H
+
+#include "mcs.h"
+
+struct MCS_Dir* MCS_addDirNode(struct MCS_Context* mcc, struct MCS_Dir* parent,
+		char* name);
+void MCS_freeDirNodes(struct MCS_Dir** nodes, int numNodes);
+int MCS_getItemPath(struct MCS_Item* item, char* buffer, int size);
+int MCS_sendDir(struct MCS_Snapshot* snapshot, struct MCS_Dir* node,
+		struct MCS_Request* req);
+
+#endif
@@ -0,0 +1,240 @@
+#include "mcs_usage.h"
+
+// the usage of the child is read from the files of /proc/<pid>. a player
+// that forks only reports its own resources while it plays, the resources
+// of its children are added when it exits (see MCS_finishUsage)
+
+static int MCS_readProcFile(pid_t pid, char* name, char* buffer, int size) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/%s", (int) pid, name);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	int len = read(fd, buffer, size - 1);
+	close(fd);
+
+	if (len < 0)
+		return -1;
+
+	buffer[len] = '\0';
+	return len;
+}
+
+static long MCS_readProcField(char* buffer, char* name) {
+	char* p = strstr(buffer, name);
+
+	return p != NULL ? strtol(p + strlen(name), NULL, 10) : -1;
+}
+
+// returns 1 if the child has read from the played file
+static int MCS_hasRead(struct MCS_Usage* usage, pid_t pid) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/fd", (int) pid);
+
+	DIR* dir = opendir(path);
+
+	if (dir == NULL)
+		return 0;
+
+	int read = 0;
+	struct dirent* entry;
+	struct stat st;
+	char buffer[256];
+
+	while (!read && (entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		// the links of the descriptors are followed to the open files
+		if (fstatat(dirfd(dir), entry->d_name, &st, 0) < 0
+				|| st.st_dev != usage->dev || st.st_ino != usage->ino)
+			continue;
+
+		snprintf(path, sizeof(path), "fdinfo/%d", atoi(entry->d_name));
+
+		if (MCS_readProcFile(pid, path, buffer, sizeof(buffer)) > 0
+				&& MCS_readProcField(buffer, "pos:") > 0)
+			read = 1;
+	}
+
+	closedir(dir);
+	return read;
+}
+
+// reads the CPU time (us) and the bytes read of the child, returns -1 if
+// the child is gone. readBytes is kept if the io file is not readable
+static int MCS_readCounters(pid_t pid, unsigned long long* cpuTime,
+		unsigned long long* readBytes) {
+	char buffer[2048];
+
+	if (MCS_readProcFile(pid, "stat", buffer, sizeof(buffer)) < 0)
+		return -1;
+
+	// the name of the binary may contain spaces, the fields follow the
+	// last ')'
+	char* p = strrchr(buffer, ')');
+	unsigned long long utime;
+	unsigned long long stime;
+
+	if (p == NULL || sscanf(p + 1,
+			" %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+			&utime, &stime) != 2)
+		return -1;
+
+	*cpuTime = (utime + stime) * 1000000ULL / sysconf(_SC_CLK_TCK);
+
+	// only readable by the same user
+	if (MCS_readProcFile(pid, "io", buffer, sizeof(buffer)) > 0) {
+		long rchar = MCS_readProcField(buffer, "rchar:");
+
+		if (rchar >= 0)
+			*readBytes = rchar;
+	}
+
+	return 0;
+}
+
+void MCS_finishUsage(struct MCS_Usage* usage, struct rusage* ru) {
+	// the totals of the kernel include the time after the last sample and
+	// the children of the player
+	unsigned long long cpuTime =
+			(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000ULL
+			+ ru->ru_utime.tv_usec + ru->ru_stime.tv_usec;
+
+	if (cpuTime > usage->cpuTime)
+		usage->cpuTime = cpuTime;
+
+	if (ru->ru_maxrss > usage->maxRss)
+		usage->maxRss = ru->ru_maxrss;
+
+	if ((unsigned long) ru->ru_nvcsw > usage->switches)
+		usage->switches = ru->ru_nvcsw;
+
+	if ((unsigned long) ru->ru_nivcsw > usage->forcedSwitches)
+		usage->forcedSwitches = ru->ru_nivcsw;
+}
+
+int MCS_handleUsageTimeouts(struct MCS_Context* mcc) {
+	if (MCS_USAGE_INTERVAL <= 0)
+		return -1;
+
+	long long now = MCS_getTime();
+	long long next = -1;
+
+	int i;
+	for (i = 0; i < mcc->numSessions; i++) {
+		struct MCS_Session* session = &mcc->sessions[i];
+		struct MCS_Usage* usage = &session->usage;
+
+		if (session->child == 0)
+			continue;
+
+		// the samples are metrics, they don't change the validator of STAT
+		if (usage->deadline <= now)
+			MCS_sampleUsage(usage, session->child, now);
+
+		if (next < 0 || usage->deadline < next)
+			next = usage->deadline;
+	}
+
+	// poll timeout in ms until the next sample is due
+	if (next < 0)
+		return -1;
+
+	return next <= now ? 0 : (int) ((next - now + 999) / 1000);
+}
+
+int MCS_sampleUsage(struct MCS_Usage* usage, pid_t pid, long long now) {
+	// sample faster until the child has read from its file
+	int starting = usage->readTime == 0
+			&& now - usage->started < MCS_USAGE_START_TIMEOUT * 1000LL;
+
+	usage->deadline = now + (starting ? MCS_USAGE_START_INTERVAL
+			: MCS_USAGE_INTERVAL) * 1000LL;
+
+	if (starting && MCS_hasRead(usage, pid))
+		usage->readTime = now - usage->started;
+
+	unsigned long long cpuTime;
+	unsigned long long readBytes = usage->readBytes;
+
+	if (MCS_readCounters(pid, &cpuTime, &readBytes) < 0)
+		return -1;
+
+	char buffer[2048];
+
+	if (MCS_readProcFile(pid, "status", buffer, sizeof(buffer)) > 0) {
+		long rss = MCS_readProcField(buffer, "VmRSS:");
+		long hwm = MCS_readProcField(buffer, "VmHWM:");
+		long switches = MCS_readProcField(buffer,
+				"\nvoluntary_ctxt_switches:");
+		long forcedSwitches = MCS_readProcField(buffer,
+				"nonvoluntary_ctxt_switches:");
+
+		usage->rss = rss > 0 ? rss : 0;
+
+		if (hwm > usage->maxRss)
+			usage->maxRss = hwm;
+
+		if (switches >= 0)
+			usage->switches = switches;
+
+		if (forcedSwitches >= 0)
+			usage->forcedSwitches = forcedSwitches;
+	}
+
+	long long elapsed = now - usage->lastSample;
+
+	if (elapsed > 0) {
+		usage->load = (cpuTime - usage->cpuTime) * 100 / elapsed;
+		usage->readRate = (readBytes - usage->readBytes) * 1000000
+				/ elapsed;
+
+		if (usage->load > usage->maxLoad)
+			usage->maxLoad = usage->load;
+
+		if (usage->readRate > usage->maxReadRate)
+			usage->maxReadRate = usage->readRate;
+	}
+
+	usage->cpuTime = cpuTime;
+	usage->readBytes = readBytes;
+	usage->lastSample = now;
+
+	return 0;
+}
+
+void MCS_startUsage(struct MCS_Usage* usage, pid_t pid, char* filepath,
+		long long started) {
+	memset(usage, 0, sizeof(struct MCS_Usage));
+
+	// the counters of /proc start with the child, a persistent player has
+	// been counting since it was spawned. the first sample only reports
+	// what it did for this item
+	MCS_readCounters(pid, &usage->cpuTime, &usage->readBytes);
+
+	long long now = MCS_getTime();
+
+	// posix_spawn returns after the exec
+	usage->started = started;
+	usage->execTime = now - started;
+	usage->lastSample = now;
+	usage->deadline = now;
+
+	struct stat st;
+
+	if (stat(filepath, &st) == 0) {
+		usage->dev = st.st_dev;
+		usage->ino = st.st_ino;
+	}
+}
+
+void MCS_stopUsage(struct MCS_Usage* usage, long long now) {
+	usage->stopped = now;
+	usage->load = 0;
+	usage->rss = 0;
+	usage->readRate = 0;
+}
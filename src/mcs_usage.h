@@ -0,0 +1,13 @@
+#ifndef MCS_USAGE_H
+#define MCS_USAGE_H
+
+#include "mcs.h"
+
+void MCS_finishUsage(struct MCS_Usage* usage, struct rusage* ru);
+int MCS_handleUsageTimeouts(struct MCS_Context* mcc);
+int MCS_sampleUsage(struct MCS_Usage* usage, pid_t pid, long long now);
+void MCS_startUsage(struct MCS_Usage* usage, pid_t pid, char* filepath,
+		long long started);
+void MCS_stopUsage(struct MCS_Usage* usage, long long now);
+
+#endif
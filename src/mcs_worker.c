@@ -0,0 +1,262 @@
+#include "mcs_worker.h"
+#include "mcs_listen.h"
+#include "mcs_log.h"
+#include "mcs_snap.h"
+#include "mcs_zip.h"
+
+// the workers accept the clients and serve the commands that only read the
+// item list and the status (MCS_handleQuery). the sessions, the children
+// and the nodes belong to the main loop, the workers pass the other requests
+// to it through the handoff pipe together with the client socket. the main
+// loop writes the response and closes the socket
+
+// the threads of the workers have exited
+static void MCS_freeWorkers(struct MCS_Context* mcc, int numWorkers) {
+	// requests that were passed on and are not served anymore
+	struct MCS_Handoff handoff;
+
+	while (read(mcc->handoff[0], &handoff, sizeof(handoff))
+			== sizeof(handoff)) {
+		MCS_closeClient(handoff.clientSocket);
+	}
+
+	mcc->numWorkers = 0;
+
+	int i;
+	for (i = 0; i < numWorkers; i++) {
+		MCS_closeClones(mcc, mcc->workers[i].listeners);
+		MCS_freeZip(mcc->workers[i].zip);
+	}
+
+	close(mcc->wake[0]);
+	close(mcc->handoff[0]);
+	close(mcc->handoff[1]);
+
+	free(mcc->workers);
+	mcc->workers = NULL;
+}
+
+static void MCS_serveClient(struct MCS_Worker* worker, int listenSocket) {
+	struct MCS_Context* mcc = worker->mcc;
+
+	int clientSocket = MCS_acceptSocket(listenSocket);
+
+	if (clientSocket < 0)
+		return;
+
+	struct MCS_Handoff handoff;
+	handoff.clientSocket = clientSocket;
+	handoff.len = MCS_readRequest(clientSocket, handoff.buffer);
+
+	if (handoff.len == 0) {
+		MCS_closeClient(clientSocket);
+		return;
+	}
+
+	int statusCode = 0;
+
+	struct MCS_Request req;
+	memset(&req, 0, sizeof(req));
+	req.clientSocket = clientSocket;
+	req.worker = worker;
+	req.snapshot = MCS_acquireSnapshot(mcc, &worker->reading);
+	req.encoding = MCS_ENC_XML;
+	req.compression = MCS_ZIP_NONE;
+	req.zip = worker->zip;
+
+	int served = MCS_handleQuery(mcc, &req, handoff.buffer, handoff.len,
+			&statusCode);
+
+	MCS_releaseSnapshot(&worker->reading);
+
+	if (served) {
+		// the response has been sent or the status code is set
+	} else if (write(mcc->handoff[1], &handoff, sizeof(handoff))
+			== sizeof(handoff)) {
+		return;
+	} else {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_serveClient: Could not pass on the request\n");
+		statusCode = MCS_ERR_SERVER_ERROR;
+	}
+
+	if (MCS_formatStatus(handoff.buffer, statusCode)) {
+		if (write(clientSocket, handoff.buffer, strlen(handoff.buffer)) < 0) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_serveClient: Could not write to socket\n");
+		}
+	}
+
+	MCS_closeClient(clientSocket);
+}
+
+static void* MCS_runWorker(void* arg) {
+	struct MCS_Worker* worker = (struct MCS_Worker*) arg;
+	struct MCS_Context* mcc = worker->mcc;
+
+	// the main loop closes the write end of the wake pipe to stop the
+	// workers
+	struct pollfd fds[1 + MCS_MAX_LISTENERS];
+	fds[0].fd = mcc->wake[0];
+	fds[0].events = POLLIN;
+
+	int i;
+	for (i = 0; i < mcc->numListeners; i++) {
+		fds[1 + i].fd = worker->listeners[i];
+		fds[1 + i].events = POLLIN;
+	}
+
+	while (1) {
+		if (poll(fds, 1 + mcc->numListeners, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			MCS_log(MCS_LOG_ERROR, "MCS_runWorker: Error polling.\n");
+			break;
+		}
+
+		if (fds[0].revents != 0)
+			break;
+
+		for (i = 0; i < mcc->numListeners; i++) {
+			if (fds[1 + i].revents & POLLIN)
+				MCS_serveClient(worker, fds[1 + i].fd);
+		}
+	}
+
+	return NULL;
+}
+
+// returns the number of workers to start, 0 if the main loop serves the
+// clients itself
+int MCS_getNumWorkers() {
+	long numWorkers = MCS_WORKERS;
+
+	if (numWorkers <= 0)
+		numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (numWorkers > MCS_MAX_WORKERS)
+		numWorkers = MCS_MAX_WORKERS;
+
+	return numWorkers > 1 ? numWorkers : 0;
+}
+
+// serves the requests the workers passed on
+void MCS_handleHandoffs(struct MCS_Context* mcc) {
+	struct MCS_Handoff handoff;
+
+	while (read(mcc->handoff[0], &handoff, sizeof(handoff))
+			== sizeof(handoff)) {
+		if (!MCS_handleCommand(mcc, handoff.clientSocket, handoff.buffer,
+				handoff.len)) {
+			MCS_closeClient(handoff.clientSocket);
+		}
+	}
+}
+
+// the endpoints are open (MCS_openListeners with reusePort). the first
+// worker accepts on the sockets of the main loop, the others open their own
+int MCS_startWorkers(struct MCS_Context* mcc, int numWorkers) {
+	if (pipe2(mcc->handoff, O_CLOEXEC) < 0)
+		return -1;
+
+	if (pipe2(mcc->wake, O_CLOEXEC) < 0) {
+		close(mcc->handoff[0]);
+		close(mcc->handoff[1]);
+		return -1;
+	}
+
+	// the main loop drains the requests without blocking. a worker never
+	// waits for the main loop, it fails the request if the pipe is full
+	fcntl(mcc->handoff[0], F_SETFL, O_NONBLOCK);
+	fcntl(mcc->handoff[1], F_SETFL, O_NONBLOCK);
+
+	mcc->workers = (struct MCS_Worker*) malloc(
+			numWorkers * sizeof(struct MCS_Worker));
+	memset(mcc->workers, 0, numWorkers * sizeof(struct MCS_Worker));
+
+	int i;
+	for (i = 0; i < numWorkers; i++) {
+		struct MCS_Worker* worker = &mcc->workers[i];
+
+		worker->mcc = mcc;
+		worker->index = i;
+		worker->zip = MCS_createZip();
+
+		if (i == 0) {
+			memcpy(worker->listeners, mcc->listeners,
+					sizeof(mcc->listeners));
+		} else {
+			MCS_cloneListeners(mcc, worker->listeners);
+		}
+	}
+
+	mcc->numWorkers = numWorkers;
+
+	// the workers block all signals, SIGCHLD is received by the main loop
+	sigset_t mask;
+	sigset_t oldMask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &oldMask);
+
+	int numStarted;
+	for (numStarted = 0; numStarted < numWorkers; numStarted++) {
+		struct MCS_Worker* worker = &mcc->workers[numStarted];
+
+		if (pthread_create(&worker->thread, NULL, MCS_runWorker,
+				worker) != 0)
+			break;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+
+	if (numStarted < numWorkers) {
+		MCS_log(MCS_LOG_ERROR, "MCS_startWorkers: Failed to start worker %d\n",
+				numStarted);
+
+		// the started ones are stopped, the main loop serves the clients
+		close(mcc->wake[1]);
+
+		for (i = 0; i < numStarted; i++) {
+			pthread_join(mcc->workers[i].thread, NULL);
+		}
+
+		MCS_freeWorkers(mcc, numWorkers);
+		return -1;
+	}
+
+	MCS_log(MCS_LOG_INFO, "Started %d workers\n", numWorkers);
+
+	return 0;
+}
+
+void MCS_stopWorkers(struct MCS_Context* mcc) {
+	if (mcc->workers == NULL)
+		return;
+
+	close(mcc->wake[1]);
+
+	int i;
+	for (i = 0; i < mcc->numWorkers; i++) {
+		pthread_join(mcc->workers[i].thread, NULL);
+	}
+
+	MCS_freeWorkers(mcc, mcc->numWorkers);
+}
+
+// the metrics of the compression contexts of the main loop and the workers
+void MCS_sumZipMetrics(struct MCS_Context* mcc, unsigned long* responses,
+		unsigned long long* bytesIn, unsigned long long* bytesOut) {
+	*responses = __atomic_load_n(&mcc->zip->responses, __ATOMIC_RELAXED);
+	*bytesIn = __atomic_load_n(&mcc->zip->bytesIn, __ATOMIC_RELAXED);
+	*bytesOut = __atomic_load_n(&mcc->zip->bytesOut, __ATOMIC_RELAXED);
+
+	int i;
+	for (i = 0; i < mcc->numWorkers; i++) {
+		struct MCS_Zip* zip = mcc->workers[i].zip;
+
+		*responses += __atomic_load_n(&zip->responses, __ATOMIC_RELAXED);
+		*bytesIn += __atomic_load_n(&zip->bytesIn, __ATOMIC_RELAXED);
+		*bytesOut += __atomic_load_n(&zip->bytesOut, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef MCS_WORKER_H
+#define MCS_WORKER_H
+
+#include "mcs.h"
+
+#include <pthread.h>
+
+// a thread that accepts clients and serves the queries, see mcs_worker.c
+struct MCS_Worker {
+	struct MCS_Context* mcc;
+	int index;
+	pthread_t thread;
+	int listeners[MCS_MAX_LISTENERS]; // -1 if the endpoint is not open
+	struct MCS_Zip* zip;
+
+	// the snapshot of the current request, NULL between requests
+	struct MCS_Snapshot* reading;
+};
+
+// a request that a worker passes to the main loop, written to the pipe in
+// one piece (less than PIPE_BUF)
+struct MCS_Handoff {
+	int clientSocket;
+	int len;
+	char buffer[MCS_REQUEST_SIZE + 1];
+};
+
+int MCS_getNumWorkers();
+void MCS_handleHandoffs(struct MCS_Context* mcc);
+int MCS_startWorkers(struct MCS_Context* mcc, int numWorkers);
+void MCS_stopWorkers(struct MCS_Context* mcc);
+void MCS_sumZipMetrics(struct MCS_Context* mcc, unsigned long* responses,
+		unsigned long long* bytesIn, unsigned long long* bytesOut);
+
+#endif
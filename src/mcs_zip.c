@@ -0,0 +1,153 @@
+#include "mcs_zip.h"
+#include "mcs_log.h"
+
+#if defined(MCS_ZLIB) || defined(MCS_ZSTD)
+static int MCS_reserveZip(struct MCS_Zip* zip, int size) {
+	if (size <= zip->capacity)
+		return 0;
+
+	char* buffer = (char*) realloc(zip->buffer, size * sizeof(char));
+
+	if (buffer == NULL) {
+		MCS_log(MCS_LOG_ERROR, "MCS_reserveZip: Failed to allocate %d bytes\n",
+				size);
+		return -1;
+	}
+
+	zip->buffer = buffer;
+	zip->capacity = size;
+
+	return 0;
+}
+#endif
+
+#ifdef MCS_ZLIB
+static int MCS_compressDeflate(struct MCS_Zip* zip, char* body, int len) {
+	if (!zip->deflateReady) {
+		memset(&zip->deflate, 0, sizeof(zip->deflate));
+
+		if (deflateInit(&zip->deflate, MCS_ZIP_LEVEL) != Z_OK) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_compressDeflate: Failed to initialize zlib\n");
+			return -1;
+		}
+
+		zip->deflateReady = 1;
+	} else if (deflateReset(&zip->deflate) != Z_OK) {
+		MCS_log(MCS_LOG_ERROR, "MCS_compressDeflate: Failed to reset zlib\n");
+		return -1;
+	}
+
+	if (MCS_reserveZip(zip, deflateBound(&zip->deflate, len)) < 0)
+		return -1;
+
+	zip->deflate.next_in = (Bytef*) body;
+	zip->deflate.avail_in = len;
+	zip->deflate.next_out = (Bytef*) zip->buffer;
+	zip->deflate.avail_out = zip->capacity;
+
+	if (deflate(&zip->deflate, Z_FINISH) != Z_STREAM_END) {
+		MCS_log(MCS_LOG_ERROR,
+				"MCS_compressDeflate: Failed to compress body\n");
+		return -1;
+	}
+
+	return zip->deflate.total_out;
+}
+#endif
+
+#ifdef MCS_ZSTD
+static int MCS_compressZstd(struct MCS_Zip* zip, char* body, int len) {
+	if (zip->zstd == NULL) {
+		zip->zstd = ZSTD_createCCtx();
+
+		if (zip->zstd == NULL) {
+			MCS_log(MCS_LOG_ERROR,
+					"MCS_compressZstd: Failed to create context\n");
+			return -1;
+		}
+	}
+
+	if (MCS_reserveZip(zip, ZSTD_compressBound(len)) < 0)
+		return -1;
+
+	size_t zlen = ZSTD_compressCCtx(zip->zstd, zip->buffer, zip->capacity,
+			body, len, MCS_ZIP_LEVEL);
+
+	if (ZSTD_isError(zlen)) {
+		MCS_log(MCS_LOG_ERROR, "MCS_compressZstd: Failed to compress body\n");
+		return -1;
+	}
+
+	return zlen;
+}
+#endif
+
+// returns -1 if the body is sent uncompressed, also if the compressed body
+// is not smaller. only the bodies that are sent compressed are counted
+int MCS_compress(struct MCS_Zip* zip, int method, char* body, int len,
+		char** out) {
+	int zlen = -1;
+
+	switch (method) {
+#ifdef MCS_ZLIB
+	case MCS_ZIP_DEFLATE:
+		zlen = MCS_compressDeflate(zip, body, len);
+		break;
+#endif
+#ifdef MCS_ZSTD
+	case MCS_ZIP_ZSTD:
+		zlen = MCS_compressZstd(zip, body, len);
+		break;
+#endif
+	default:
+		// method not compiled in, send the body uncompressed
+		return -1;
+	}
+
+	if (zlen < 0 || zlen >= len)
+		return -1;
+
+	// STAT of another thread sums the metrics of all contexts
+	__atomic_fetch_add(&zip->responses, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&zip->bytesIn, len, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&zip->bytesOut, zlen, __ATOMIC_RELAXED);
+
+	*out = zip->buffer;
+	return zlen;
+}
+
+struct MCS_Zip* MCS_createZip() {
+	struct MCS_Zip* zip;
+	zip = (struct MCS_Zip*) malloc(sizeof(struct MCS_Zip));
+	memset(zip, 0, sizeof(struct MCS_Zip));
+
+	return zip;
+}
+
+void MCS_freeZip(struct MCS_Zip* zip) {
+	if (zip == NULL)
+		return;
+
+#ifdef MCS_ZLIB
+	if (zip->deflateReady)
+		deflateEnd(&zip->deflate);
+#endif
+#ifdef MCS_ZSTD
+	ZSTD_freeCCtx(zip->zstd);
+#endif
+
+	free(zip->buffer);
+	free(zip);
+}
+
+char* MCS_getZipName(int method) {
+	switch (method) {
+	case MCS_ZIP_DEFLATE:
+		return "deflate";
+	case MCS_ZIP_ZSTD:
+		return "zstd";
+	default:
+		return "none";
+	}
+}
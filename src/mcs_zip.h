@@ -0,0 +1,40 @@
+#ifndef MCS_ZIP_H
+#define MCS_ZIP_H
+
+#include "mcs.h"
+
+#ifdef MCS_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef MCS_ZSTD
+#include <zstd.h>
+#endif
+
+// compression contexts are created once and reused for every response, by
+// one thread (the main loop or a worker)
+struct MCS_Zip {
+#ifdef MCS_ZLIB
+	z_stream deflate;
+	int deflateReady;
+#endif
+#ifdef MCS_ZSTD
+	ZSTD_CCtx* zstd;
+#endif
+	// output buffer, grows with the largest compressed body
+	char* buffer;
+	int capacity;
+
+	// metrics
+	unsigned long responses;
+	unsigned long long bytesIn;
+	unsigned long long bytesOut;
+};
+
+int MCS_compress(struct MCS_Zip* zip, int method, char* body, int len,
+		char** out);
+struct MCS_Zip* MCS_createZip();
+void MCS_freeZip(struct MCS_Zip* zip);
+char* MCS_getZipName(int method);
+
+#endif